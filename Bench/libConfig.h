@@ -0,0 +1,7 @@
+#pragma once
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0601
+#endif // _WIN32
+
+#define LIB_UTILS_LOG
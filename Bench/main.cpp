@@ -0,0 +1,235 @@
+#include <libConfig.h>
+#include "main.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <utilsExits.h>
+#include <utilsLog.h>
+#include <utilsTime.h>
+
+namespace bench
+{
+
+// The formatting which has been replaced, the results are compared with it.
+namespace reference
+{
+
+static bool IsSymbol(char value)
+{
+	return value > 0x20 && value != 0x25 && value != 0x7F;
+}
+
+// utils::log::MakeStringHex through std::stringstream
+std::string MakeStringHex(const std::vector<std::uint8_t>& data, int dataLinesBegin, int dataLinesEnd)
+{
+	const int LinesQty = static_cast<int>((data.size() / 16) + (data.size() % 16 ? 1 : 0));
+	const int LinesToSkip = dataLinesBegin && dataLinesEnd ? static_cast<int>(LinesQty - dataLinesBegin - dataLinesEnd) : 0;
+	if (LinesToSkip > 0)
+	{
+		--dataLinesBegin; // transform to index
+		dataLinesEnd = LinesQty - dataLinesEnd;
+	}
+
+	const auto IsLineSkipped = [&dataLinesBegin, &dataLinesEnd, &LinesToSkip](int linesCounter)->bool { return LinesToSkip > 0 && linesCounter > dataLinesBegin && linesCounter < dataLinesEnd; };
+
+	std::stringstream Stream;
+	bool SkipMsgInserted = false;
+	for (int i = 0; i < LinesQty; ++i)
+	{
+		if (IsLineSkipped(i))
+		{
+			if (!SkipMsgInserted)
+			{
+				SkipMsgInserted = true;
+				Stream << "< " + std::to_string(LinesToSkip) + " lines are skipped >\n";
+			}
+			continue;
+		}
+
+		Stream << std::setfill('0') << std::setw(4) << std::hex << (16 * i) << "   ";
+
+		std::string Substr;
+		std::size_t byteCount = 0;
+		for (std::size_t k = (16 * i); byteCount < 16 && k < data.size(); ++byteCount, ++k)
+		{
+			if (byteCount == 8)
+				Stream << "  ";
+
+			Stream << std::setfill('0') << std::setw(2) << std::hex << static_cast<int>(data[k]) << ' ';
+
+			Substr += IsSymbol(data[k]) ? data[k] : '.';
+		}
+		for (; byteCount < 16; ++byteCount)
+		{
+			if (byteCount == 8)
+				Stream << "  ";
+			Stream << "   ";
+		}
+		Stream << "  " + Substr;
+
+		if (i < LinesQty - 1) // It's not needed for the last string
+			Stream << '\n';
+	}
+
+	return Stream.str();
+}
+
+}
+
+// Nothing is written, so the cost of the formatting is measured. The text is kept when it's compared.
+class tLogNull : public utils::log::tLog
+{
+	bool m_KeepText = false;
+	std::string m_Text;
+
+public:
+	void KeepText(bool keep) { m_KeepText = keep; }
+	const std::string& GetText() const { return m_Text; }
+
+protected:
+	void WriteLog(const std::string& text) override
+	{
+		if (m_KeepText)
+			m_Text = text;
+	}
+};
+
+template<class TFunc>
+double Measure(std::size_t qty, TFunc func) // [us] per call
+{
+	const auto TimeStart = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < qty; ++i)
+		func();
+	const std::chrono::duration<double, std::micro> Duration = std::chrono::steady_clock::now() - TimeStart;
+	return Duration.count() / static_cast<double>(qty);
+}
+
+void PrintResult(std::string_view name, double durationRef, double duration)
+{
+	std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(12) << durationRef << " us" << std::setw(12) << duration << " us" << std::setw(8) << std::setprecision(1) << durationRef / duration << "x\n";
+}
+
+// tLog::WriteHex vs the reference formatting written by tLog::WriteLine, the rest of the path is the same.
+bool BenchHex(std::size_t bytesQty)
+{
+	std::cout << "hex dump (tLog::WriteHex)    stringstream         tables\n";
+
+	std::mt19937 Rand(1);
+	std::uniform_int_distribution<int> Byte(0, 255);
+
+	bool Result = true;
+	for (std::size_t Size : { 16, 1024, 64 * 1024, 1024 * 1024 })
+	{
+		std::vector<std::uint8_t> Data(Size);
+		for (auto& i : Data)
+			i = static_cast<std::uint8_t>(Byte(Rand));
+
+		tLogNull Log;
+		Log.KeepText(true);
+		Log.WriteLine(false, reference::MakeStringHex(Data, 0, 0));
+		const std::string TextRef = Log.GetText();
+		Log.WriteHex(Data);
+		if (Log.GetText() != TextRef)
+		{
+			std::cout << Size << " B: the dump differs from the reference\n";
+			Result = false;
+			continue;
+		}
+		Log.KeepText(false);
+
+		const std::size_t Qty = std::max<std::size_t>(bytesQty / Size, 3);
+		const double DurationRef = Measure(Qty, [&]() { Log.WriteLine(false, reference::MakeStringHex(Data, 0, 0)); });
+		const double Duration = Measure(Qty, [&]() { Log.WriteHex(Data); });
+		PrintResult(std::to_string(Size) + " B", DurationRef, Duration);
+	}
+	return Result;
+}
+
+// The fixed formats of tDateTime vs the same formats through ToString(format) and Parse(value, format) (iostreams, put_time, get_time, mktime).
+bool BenchTime(std::size_t qty)
+{
+	std::cout << "tDateTime (" << qty << " times)        iostreams         fixed\n";
+
+	constexpr char FormatDateTime[] = "%Y-%m-%d %H:%M:%S";
+	constexpr char FormatPath[] = "%Y-%m-%d_%H-%M-%S";
+
+	std::mt19937 Rand(1);
+	std::uniform_int_distribution<std::time_t> Time(946684800, 1893456000); // 2000 .. 2030
+
+	std::vector<utils::time::tDateTime> Times(1024);
+	std::vector<std::string> Strs(Times.size());
+	std::vector<std::string> StrsPath(Times.size());
+	bool Result = true;
+	for (std::size_t i = 0; i < Times.size(); ++i)
+	{
+		Times[i] = Time(Rand);
+		Strs[i] = Times[i].ToString();
+		StrsPath[i] = Times[i].ToStringPath();
+		char Chars[utils::time::tDateTime::StringSize];
+		const std::string_view StrChars(Chars, Times[i].ToChars(Chars));
+		// The round trip is checked for the parsing: the reference one takes the time as a standard one (tm_isdst is 0).
+		if (Strs[i] != Times[i].ToString(FormatDateTime) || StrsPath[i] != Times[i].ToString(FormatPath) || StrChars != Strs[i] ||
+			utils::time::tDateTime::Parse(Strs[i]).ToString() != Strs[i] || utils::time::tDateTime::ParsePath(StrsPath[i]).ToStringPath() != StrsPath[i])
+		{
+			std::cout << Strs[i] << ": the time differs from the reference\n";
+			Result = false;
+		}
+	}
+	if (!Result)
+		return false;
+
+	const std::size_t Mask = Times.size() - 1;
+	std::size_t Size = 0; // the results are used
+	auto MeasureCase = [&](std::string_view name, auto funcRef, auto func)
+	{
+		const double DurationRef = Measure(qty, [&, i = std::size_t(0)]() mutable { Size += funcRef(i++ & Mask); });
+		const double Duration = Measure(qty, [&, i = std::size_t(0)]() mutable { Size += func(i++ & Mask); });
+		PrintResult(name, DurationRef, Duration);
+	};
+	MeasureCase("ToString", [&](std::size_t i) { return Times[i].ToString(FormatDateTime).size(); }, [&](std::size_t i) { return Times[i].ToString().size(); });
+	MeasureCase("ToStringPath", [&](std::size_t i) { return Times[i].ToString(FormatPath).size(); }, [&](std::size_t i) { return Times[i].ToStringPath().size(); });
+	MeasureCase("ToChars", [&](std::size_t i) { return Times[i].ToString(FormatDateTime).size(); }, [&](std::size_t i)
+		{
+			char Chars[utils::time::tDateTime::StringSize];
+			return Times[i].ToChars(Chars);
+		});
+	MeasureCase("Parse", [&](std::size_t i) { return static_cast<std::size_t>(utils::time::tDateTime::Parse(Strs[i], FormatDateTime).GetTM().tm_sec); },
+		[&](std::size_t i) { return static_cast<std::size_t>(utils::time::tDateTime::Parse(std::string_view(Strs[i])).GetTM().tm_sec); });
+	MeasureCase("ParsePath", [&](std::size_t i) { return static_cast<std::size_t>(utils::time::tDateTime::Parse(StrsPath[i], FormatPath).GetTM().tm_sec); },
+		[&](std::size_t i) { return static_cast<std::size_t>(utils::time::tDateTime::ParsePath(StrsPath[i]).GetTM().tm_sec); });
+	return Size > 0;
+}
+
+}
+
+// bench [hex|time|all] [scale] - the formatting is compared with the reference one (the one it has replaced) and the durations are printed
+// scale: hex - megabytes per a case (64), time - thousands of calls per a case (200)
+int main(int argc, char* argv[])
+{
+	const std::string Name = argc > 1 ? argv[1] : "all";
+	const std::size_t Scale = argc > 2 ? std::stoul(argv[2]) : 0;
+
+	if (Name != "hex" && Name != "time" && Name != "all")
+	{
+		std::cerr << "bench [hex|time|all] [scale]\n";
+		return utils::exit_code::EX_USAGE;
+	}
+
+	bool Result = true;
+	if (Name == "hex" || Name == "all")
+		Result = bench::BenchHex((Scale ? Scale : 64) * 1024 * 1024) && Result;
+	if (Name == "time" || Name == "all")
+		Result = bench::BenchTime((Scale ? Scale : 200) * 1000) && Result;
+
+	return Result ? utils::exit_code::EX_OK : utils::exit_code::EX_SOFTWARE;
+}
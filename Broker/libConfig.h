@@ -0,0 +1,15 @@
+#pragma once
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0601
+#endif // _WIN32
+
+#define LIB_UTILS_LOG
+#define LIB_UTILS_LOG_COLOR
+#define LIB_UTILS_LOG_ASYNC // the records are written out by the task of the log
+
+#define LIB_SHARE_BROKER_RECEIVE_BUFFER_SIZE 4096
+#define LIB_SHARE_BROKER_PACKET_SIZE_MAX (256 * 1024)
+#define LIB_SHARE_BROKER_CLIENT_QUEUE_CAPACITY 10000
+#define LIB_SHARE_BROKER_SESSION_QUEUE_CAPACITY 1000
+#define LIB_SHARE_BROKER_INFLIGHT_MAX 64
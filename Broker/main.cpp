@@ -0,0 +1,130 @@
+#include "main.h"
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include <utilsException.h>
+#include <utilsExits.h>
+#include <shareBroker.h>
+#include <shareLog.h>
+#include <shareLogFile.h>
+#include <shareMetrics.h>
+#include <shareTrace.h>
+
+// LOG_FILE - the log is written to the file as well.
+// METRICS_PORT - the metrics are served (Prometheus) on the port.
+// METRICS_ADDRESS - the address the metrics are served on, 127.0.0.1 by default (0.0.0.0 - all the interfaces).
+// TRACE_FILE - the trace (Chrome trace_event JSON) is written to the file on SIGUSR1 and on exit.
+// LOG_CONFIG - the file of the log configuration (share::tLogger::Configure), it is reloaded on SIGHUP.
+static void LoadLogConfig()
+{
+	const char* Path = std::getenv("LOG_CONFIG");
+	if (Path == nullptr)
+		return;
+	if (!g_Log.LoadConfig(Path))
+		g_Log.Exception("The log configuration has errors: " + std::string(Path));
+}
+
+// broker [port [unix_socket_path]]
+int main(int argc, char* argv[])
+{
+	int ExitCode = utils::exit_code::EX_OK;
+
+	try
+	{
+		const char* TracePath = std::getenv("TRACE_FILE");
+		if (TracePath != nullptr)
+			g_Trace.Enable(TracePath);
+
+		if (const char* Path = std::getenv("LOG_FILE"))
+		{
+			share::tLogFileSettings Settings;
+			Settings.Path = Path;
+			Settings.RotationSize = 16 * 1024 * 1024;
+			g_Log.SetFile(std::make_unique<share::tLogFile>(Settings));
+		}
+
+		LoadLogConfig();
+
+		const std::uint16_t Port = argc > 1 ? static_cast<std::uint16_t>(std::stoul(argv[1])) : 1883;
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+		std::unique_ptr<share::tBroker> Broker = argc > 2 ? std::make_unique<share::tBroker>("0.0.0.0", Port, argv[2]) : std::make_unique<share::tBroker>("0.0.0.0", Port);
+#else // BOOST_ASIO_HAS_LOCAL_SOCKETS
+		std::unique_ptr<share::tBroker> Broker = std::make_unique<share::tBroker>("0.0.0.0", Port);
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+		g_Log.Operation("BROKER STARTED, PORT " + std::to_string(Broker->GetPortTCP()));
+
+		std::unique_ptr<share::tMetricsServer> MetricsServer;
+		if (const char* MetricsPort = std::getenv("METRICS_PORT"))
+		{
+			using share::tMetricType;
+			auto AddStats = [&Broker](const char* name, const char* help, tMetricType type, std::uint64_t share::tBrokerStats::* field)
+				{
+					g_Metrics.SetCallback(name, help, {}, type, [&Broker, field]() { return static_cast<double>(Broker->GetStats().*field); });
+				};
+			AddStats("broker_clients", "Clients connected.", tMetricType::Gauge, &share::tBrokerStats::Clients);
+			AddStats("broker_sessions", "Sessions kept.", tMetricType::Gauge, &share::tBrokerStats::Sessions);
+			AddStats("broker_messages_received_total", "PUBLISH received.", tMetricType::Counter, &share::tBrokerStats::MessagesReceived);
+			AddStats("broker_messages_sent_total", "PUBLISH sent.", tMetricType::Counter, &share::tBrokerStats::MessagesSent);
+			AddStats("broker_messages_dropped_total", "PUBLISH dropped, the queue of a client or a session is full.", tMetricType::Counter, &share::tBrokerStats::MessagesDropped);
+			AddStats("broker_retained_messages", "Retained messages.", tMetricType::Gauge, &share::tBrokerStats::RetainedMessages);
+			g_Log.RegisterMetrics(g_Metrics);
+
+			const char* MetricsAddress = std::getenv("METRICS_ADDRESS");
+			const std::string Address = MetricsAddress != nullptr ? MetricsAddress : "127.0.0.1";
+			MetricsServer = std::make_unique<share::tMetricsServer>(g_Metrics, Address, static_cast<std::uint16_t>(std::stoul(MetricsPort)));
+			g_Log.Operation("METRICS " + Address + " PORT " + std::to_string(MetricsServer->GetPort()));
+		}
+
+		boost::asio::io_context ioc;
+#ifdef SIGHUP
+		boost::asio::signal_set SignalsReload(ioc, SIGHUP);
+		std::function<void()> WaitReload = [&]()
+		{
+			SignalsReload.async_wait([&](const boost::system::error_code& error, int signalNumber)
+			{
+				if (error)
+					return;
+				LoadLogConfig();
+				WaitReload();
+			});
+		};
+		WaitReload();
+#endif // SIGHUP
+#ifdef SIGUSR1
+		boost::asio::signal_set SignalsTrace(ioc, SIGUSR1);
+		std::function<void()> WaitTrace = [&]()
+		{
+			SignalsTrace.async_wait([&](const boost::system::error_code& error, int signalNumber)
+			{
+				if (error)
+					return;
+				if (TracePath != nullptr)
+					g_Trace.Write(TracePath);
+				WaitTrace();
+			});
+		};
+		WaitTrace();
+#endif // SIGUSR1
+		boost::asio::signal_set Signals(ioc, SIGINT, SIGTERM);
+		Signals.async_wait([&](const boost::system::error_code& error, int signalNumber) { ioc.stop(); });
+		ioc.run();
+
+		const share::tBrokerStats Stats = Broker->GetStats();
+		g_Log.Operation("BROKER STOPPED, RECEIVED " + std::to_string(Stats.MessagesReceived) + ", SENT " + std::to_string(Stats.MessagesSent) + ", DROPPED " + std::to_string(Stats.MessagesDropped));
+	}
+	catch (std::exception& ex)
+	{
+		g_Log.Exception(ex.what());
+		ExitCode = utils::exit_code::EX_IOERR;
+	}
+
+	return ExitCode;
+}
@@ -6,7 +6,9 @@
 
 #define LIB_UTILS_LOG
 #define LIB_UTILS_LOG_COLOR
+//#define LIB_UTILS_LOG_ASYNC // the records are written out by the task of the log
 
 #define LIB_SHARE_MQTT_CONNECTION_RECEIVE_BUFFER_SIZE 512
 #define LIB_SHARE_MQTT_PACKET_ID_START 100
 #define LIB_SHARE_MQTT_QUEUE_INCOMING_CAPACITY 15
+//#define LIB_SHARE_MQTT_TLS // link with OpenSSL (libssl, libcrypto)
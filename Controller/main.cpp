@@ -1,29 +1,49 @@
 #include "main.h"
 
+#include <cstdlib>
 #include <future>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <utility>
 
 #include <utilsException.h>
 #include <utilsExits.h>
 #include <shareLog.h>
+#include <shareMetrics.h>
+#include <shareTrace.h>
 
-void TaskConnectionHandler(std::string_view host, std::string_view service);
+void TaskConnectionHandler(std::string_view host, std::string_view service, std::size_t workerQty);
 
+// METRICS_FILE - the metrics (Prometheus) are written to the file every 10 s.
+// TRACE_FILE - the trace (Chrome trace_event JSON) is written to the file on exit.
+// WORKERS - the number of the tasks processing the incoming messages (by Topic Name), the number of the cores by default.
 int main()
 {
 	int ExitCode = utils::exit_code::EX_OK;
 
 	try
 	{
+		if (const char* Path = std::getenv("TRACE_FILE"))
+			g_Trace.Enable(Path);
+
 		share::tMeasureDuration Measure("MAIN");
+
+		std::unique_ptr<share::tMetricsFile> MetricsFile;
+		if (const char* Path = std::getenv("METRICS_FILE"))
+		{
+			g_Log.RegisterMetrics(g_Metrics);
+			MetricsFile = std::make_unique<share::tMetricsFile>(g_Metrics, Path, std::chrono::seconds(10));
+		}
+		const char* Workers = std::getenv("WORKERS");
+		const std::size_t WorkerQty = Workers != nullptr ? std::strtoul(Workers, nullptr, 10) : 0;
+
 		//for (;;)
 		{
 
 			try
 			{
-				std::future<void> TaskConnectionFuture = std::async(std::launch::async, TaskConnectionHandler, "test.mosquitto.org", "1883");
+				std::future<void> TaskConnectionFuture = std::async(std::launch::async, TaskConnectionHandler, "test.mosquitto.org", "1883", WorkerQty);
 				//std::future<void> TaskConnectionFuture = std::async(std::launch::deferred, TaskConnectHandler, std::ref(Socket)); // a task is not started by wait_for(..), it'll be deferred forever
 
 				g_Log.TestMessage("SOME IMPORTANT WORK STARTED");
@@ -1,14 +1,20 @@
 #include "main.h"
 
+#include <shareBus.h>
 #include <shareLog.h>
 #include <shareMQTT.h>
+#include <shareSeries.h>
+#include <shareWorkers.h>
 
-void TaskConnectionHandler(std::string_view host, std::string_view service)
+void TaskConnectionHandler(std::string_view host, std::string_view service, std::size_t workerQty)
 {
 	constexpr std::uint16_t KeepAlive = 15; // sec. //[#] - TaskTransactionWait(..) should be taken into consideration
 
 	share::tConnection Connection(host, service, KeepAlive);
 
+	auto Latency = std::make_shared<share::tConnectionLatency>();
+	Connection.SetLatency(Latency);
+
 	const bool SessionPresent = Connection.Connect(mqtt::tSessionStateRequest::Continue, "duper_star_Controller"); // 1883
 	//if (!SessionPresent)
 	{
@@ -18,6 +24,7 @@ void TaskConnectionHandler(std::string_view host, std::string_view service)
 		Filters.emplace_back("SensorA_DateTime_0", mqtt::tQoS::AtMostOnceDelivery);	// [!] it differs from SensorA
 		Filters.emplace_back("SensorA_DateTime_1", mqtt::tQoS::AtLeastOnceDelivery);	// [!] it differs from SensorA
 		Filters.emplace_back("SensorA_DateTime_2", mqtt::tQoS::ExactlyOnceDelivery);	// [!] it differs from SensorA
+		Filters.emplace_back("SensorA_Series", mqtt::tQoS::AtLeastOnceDelivery);
 		//Filters.emplace_back("SensorA_DateTime_0", mqtt::tQoS::AtMostOnceDelivery);	// [!] it differs from SensorA
 		//Filters.emplace_back("SensorA_DateTime_1", mqtt::tQoS::AtMostOnceDelivery);	// [!] it differs from SensorA
 		//Filters.emplace_back("SensorA_DateTime_2", mqtt::tQoS::AtMostOnceDelivery);	// [!] it differs from SensorA
@@ -25,9 +32,30 @@ void TaskConnectionHandler(std::string_view host, std::string_view service)
 	}
 	
 	std::string Settings = "Hello World!";
-	//Connection.Publish_AtMostOnceDelivery(true, "SensorA_Settings", { Settings.begin(), Settings.end() });
-	//Connection.Publish_AtLeastOnceDelivery(true, false, "SensorA_Settings", { Settings.begin(), Settings.end() });
-	Connection.Publish_ExactlyOnceDelivery(true, false, "SensorA_Settings", { Settings.begin(), Settings.end() });
+	//Connection.Publish_AtMostOnceDelivery(true, "SensorA_Settings", share::ToPayload(Settings));
+	//Connection.Publish_AtLeastOnceDelivery(true, false, "SensorA_Settings", share::ToPayload(Settings));
+	Connection.Publish_ExactlyOnceDelivery(true, false, "SensorA_Settings", share::ToPayload(Settings));
+
+	// The local consumers of the messages, they share the payloads.
+	share::tMessageBus Bus;
+	Bus.Subscribe("SensorA_Series", [](const share::tIncomingMessage& msg)
+		{
+			const auto Series = share::DecodeSeries(msg.Payload);
+			if (!Series.has_value())
+			{
+				g_Log.Exception("SensorA_Series: the series is corrupted");
+				return;
+			}
+			if (g_Log.IsEnabled(share::tLogCategory::Operation) && !Series->Integer.empty())
+				g_Log.Operation("SensorA_Series: " + std::to_string(Series->size()) + " samples, last: " + std::to_string(Series->Integer.back()) + " us");
+		});
+	Bus.Subscribe("#", [](const share::tIncomingMessage& msg)
+		{
+			if (g_Log.IsEnabled(share::tLogCategory::Publish))
+				g_Log.PublishMessage(std::string(msg.TopicName), msg.Payload.ToVector());
+		});
+
+	share::tTopicWorkers Workers(workerQty, [&Bus](const share::tIncomingMessage& msg) { Bus.Publish(msg); }, &g_Metrics);
 
 	/////////////////////////////////////
 	for (int i = 0; i < 1500; ++i)
@@ -36,10 +64,7 @@ void TaskConnectionHandler(std::string_view host, std::string_view service)
 			THROW_RUNTIME_ERROR("The connection has been broken by the MQTT broker.");
 
 		while (!Connection.IsIncomingEmpty())
-		{
-			auto IncMsg = Connection.GetIncoming();
-			g_Log.PublishMessage(IncMsg.TopicName, IncMsg.Payload);
-		}
+			Workers.Push(Connection.GetIncoming());
 
 		std::this_thread::sleep_for(std::chrono::seconds(1));
 
@@ -69,5 +94,8 @@ void TaskConnectionHandler(std::string_view host, std::string_view service)
 	}
 	/////////////////////////////////////
 
+	for (auto Type : { share::tLatencyType::CONNACK, share::tLatencyType::PUBCOMP, share::tLatencyType::SUBACK, share::tLatencyType::PINGRESP })
+		g_Log.MeasureDuration(share::tConnectionLatency::ToString(Type) + ": " + Latency->GetSnapshot(Type).ToString());
+
 	Connection.Disconnect();
 }
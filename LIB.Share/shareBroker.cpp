@@ -0,0 +1,891 @@
+#include "shareBroker.h"
+
+#include <algorithm>
+
+#ifndef LIB_SHARE_BROKER_RECEIVE_BUFFER_SIZE
+#define LIB_SHARE_BROKER_RECEIVE_BUFFER_SIZE 4096
+#endif
+
+#ifndef LIB_SHARE_BROKER_PACKET_SIZE_MAX
+#define LIB_SHARE_BROKER_PACKET_SIZE_MAX (1024 * 1024)
+#endif
+
+#ifndef LIB_SHARE_BROKER_CLIENT_QUEUE_CAPACITY
+#define LIB_SHARE_BROKER_CLIENT_QUEUE_CAPACITY 10000 // packets queued for sending to a slow client
+#endif
+
+#ifndef LIB_SHARE_BROKER_SESSION_QUEUE_CAPACITY
+#define LIB_SHARE_BROKER_SESSION_QUEUE_CAPACITY 1000 // QoS 1, 2 messages kept for a client
+#endif
+
+#ifndef LIB_SHARE_BROKER_INFLIGHT_MAX
+#define LIB_SHARE_BROKER_INFLIGHT_MAX 64 // QoS 1, 2 messages sent to a client and not acknowledged yet
+#endif
+
+#ifndef LIB_SHARE_BROKER_CONNECT_TIMEOUT
+#define LIB_SHARE_BROKER_CONNECT_TIMEOUT 10 // seconds
+#endif
+
+namespace share
+{
+namespace hidden
+{
+
+constexpr char StrExceptionBrokerProtocolViolation[] = "Protocol violation.";
+constexpr char StrExceptionBrokerPacketSizeMax[] = "The packet exceeds the maximum size.";
+
+std::size_t PutRemainingLength(std::uint8_t* data, std::uint32_t val)
+{
+	std::size_t Size = 0;
+	do
+	{
+		std::uint8_t Byte = val % 128;
+		val /= 128;
+		if (val > 0)
+			Byte |= 0x80;
+		data[Size++] = Byte;
+	} while (val > 0);
+	return Size;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+tBrokerMessage::tBrokerMessage(std::string_view topicName, std::span<const std::uint8_t> payload, mqtt::tQoS qos)
+	:m_QoS(qos)
+{
+	std::array<std::uint8_t, 5> Header{};
+	Header[0] = static_cast<std::uint8_t>(mqtt::tControlPacketType::PUBLISH) << 4;
+	const std::size_t RemainingLength = 2 + topicName.size() + payload.size();
+	const std::size_t HeaderSize = 1 + PutRemainingLength(Header.data() + 1, static_cast<std::uint32_t>(RemainingLength));
+
+	m_Frame.reserve(HeaderSize + RemainingLength);
+	m_Frame.insert(m_Frame.end(), Header.begin(), Header.begin() + HeaderSize);
+	m_TopicNameOffset = m_Frame.size();
+	m_Frame.push_back(static_cast<std::uint8_t>(topicName.size() >> 8));
+	m_Frame.push_back(static_cast<std::uint8_t>(topicName.size()));
+	m_Frame.insert(m_Frame.end(), topicName.begin(), topicName.end());
+	m_PayloadOffset = m_Frame.size();
+	m_Frame.insert(m_Frame.end(), payload.begin(), payload.end());
+}
+
+std::string_view tBrokerMessage::GetTopicName() const
+{
+	return std::string_view(reinterpret_cast<const char*>(m_Frame.data() + m_TopicNameOffset + 2), m_PayloadOffset - m_TopicNameOffset - 2);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<std::string_view> SplitTopicLevels(std::string_view topic)
+{
+	std::vector<std::string_view> Levels;
+	for (;;)
+	{
+		const std::size_t Pos = topic.find('/');
+		Levels.push_back(topic.substr(0, Pos));
+		if (Pos == std::string_view::npos)
+			break;
+		topic.remove_prefix(Pos + 1);
+	}
+	return Levels;
+}
+
+void tSubscriptionIndex::Subscribe(tBrokerSession* session, std::string_view topicFilter, mqtt::tQoS qos)
+{
+	tNode* Node = &m_Root;
+	for (std::string_view Level : SplitTopicLevels(topicFilter))
+	{
+		auto It = Node->Children.find(Level);
+		if (It == Node->Children.end())
+			It = Node->Children.emplace(std::string(Level), std::make_unique<tNode>()).first;
+		Node = It->second.get();
+	}
+	Node->Subscribers[session] = qos; // 1317 ... it MUST completely replace that existing Subscription with a new Subscription [MQTT-3.8.4-3].
+}
+
+void tSubscriptionIndex::Unsubscribe(tBrokerSession* session, std::string_view topicFilter)
+{
+	Unsubscribe(m_Root, session, topicFilter);
+}
+
+bool tSubscriptionIndex::Unsubscribe(tNode& node, tBrokerSession* session, std::string_view topicFilter)
+{
+	const std::size_t Pos = topicFilter.find('/');
+	auto It = node.Children.find(topicFilter.substr(0, Pos));
+	if (It == node.Children.end())
+		return false;
+
+	bool Empty = false;
+	if (Pos == std::string_view::npos)
+	{
+		It->second->Subscribers.erase(session);
+		Empty = It->second->Subscribers.empty() && It->second->Children.empty();
+	}
+	else
+	{
+		Empty = Unsubscribe(*It->second, session, topicFilter.substr(Pos + 1));
+	}
+
+	if (Empty)
+		node.Children.erase(It);
+	return node.Subscribers.empty() && node.Children.empty();
+}
+
+void tSubscriptionIndex::Match(std::string_view topicName, tSubscribers& subscribers) const
+{
+	Match(m_Root, SplitTopicLevels(topicName), 0, subscribers);
+}
+
+void tSubscriptionIndex::Match(const tNode& node, const std::vector<std::string_view>& levels, std::size_t level, tSubscribers& subscribers)
+{
+	if (level == levels.size())
+	{
+		Add(node, subscribers);
+		auto It = node.Children.find("#"); // "sport/#" matches "sport"
+		if (It != node.Children.end())
+			Add(*It->second, subscribers);
+		return;
+	}
+
+	auto It = node.Children.find(levels[level]);
+	if (It != node.Children.end())
+		Match(*It->second, levels, level + 1, subscribers);
+
+	if (level == 0 && !levels[0].empty() && levels[0][0] == '$') // [MQTT-4.7.2-1]
+		return;
+
+	It = node.Children.find("+");
+	if (It != node.Children.end())
+		Match(*It->second, levels, level + 1, subscribers);
+
+	It = node.Children.find("#");
+	if (It != node.Children.end())
+		Add(*It->second, subscribers);
+}
+
+void tSubscriptionIndex::Add(const tNode& node, tSubscribers& subscribers)
+{
+	for (auto& [Session, QoS] : node.Subscribers)
+	{
+		auto [It, Inserted] = subscribers.emplace(Session, QoS);
+		if (!Inserted)
+			It->second = std::max(It->second, QoS);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+tBrokerClient::tBrokerClient(tBroker& broker, std::unique_ptr<tTransport> transport)
+	:m_Broker(broker), m_Transport(std::move(transport)), m_ReceiveBuffer(LIB_SHARE_BROKER_RECEIVE_BUFFER_SIZE), m_KeepAliveTimer(broker.m_ioc)
+{
+}
+
+void tBrokerClient::Start()
+{
+	ReceiveAsync();
+	KeepAliveAsync();
+}
+
+void tBrokerClient::Close()
+{
+	if (m_Closed)
+		return;
+	m_Closed = true;
+
+	m_Transport->Close();
+	m_KeepAliveTimer.cancel();
+
+	if (m_Session)
+	{
+		// 483 ... The Will Message MUST be published when the Network Connection is subsequently closed unless the
+		// 486 Will Message has been deleted by the Server on receipt of a DISCONNECT Packet [MQTT-3.1.2-8].
+		if (m_Will.has_value())
+			m_Broker.Publish(m_Will->Message, m_Will->Retain);
+		m_Will.reset();
+
+		m_Broker.CloseSession(this);
+		m_Session.reset();
+	}
+
+	m_Broker.m_Clients.erase(shared_from_this());
+	--m_Broker.m_StatsClients;
+}
+
+void tBrokerClient::ReceiveAsync()
+{
+	m_Transport->AsyncReadSome(boost::asio::buffer(m_ReceiveBuffer), [self = shared_from_this()](const boost::system::error_code& error, std::size_t size)
+		{
+			if (error || !size || self->m_Closed) // the connection has been closed
+			{
+				self->Close();
+				return;
+			}
+
+			self->m_TimeReceived = utils::chrono::tClock::now();
+			self->m_ReceivedData.insert(self->m_ReceivedData.end(), self->m_ReceiveBuffer.begin(), self->m_ReceiveBuffer.begin() + size);
+
+			try
+			{
+				mqtt::tSpan Span(self->m_ReceivedData);
+				while (!Span.empty() && !self->m_Closed && !self->m_CloseWritten)
+				{
+					auto Res = mqtt::TestPacket(Span);
+					if (!Res.has_value()) // the rest of the packet has not been received yet
+						break;
+					self->HandlePacket(Res->first, Res->second);
+				}
+				self->m_ReceivedData.erase(self->m_ReceivedData.begin(), self->m_ReceivedData.end() - Span.size());
+
+				if (self->m_ReceivedData.size() > LIB_SHARE_BROKER_PACKET_SIZE_MAX)
+					THROW_RUNTIME_ERROR(StrExceptionBrokerPacketSizeMax);
+			}
+			catch (std::exception& ex)
+			{
+				g_Log.Exception(ex.what());
+				self->Close();
+				return;
+			}
+
+			if (!self->m_Closed && !self->m_CloseWritten)
+				self->ReceiveAsync();
+		});
+}
+
+// 547 If the Keep Alive value is non-zero and the Server does not receive a Control Packet from the Client
+// 548 within one and a half times the Keep Alive time period, it MUST disconnect the Network Connection to the
+// 549 Client as if the network had failed [MQTT-3.1.2-24].
+void tBrokerClient::KeepAliveAsync()
+{
+	if (m_Closed)
+		return;
+
+	if (m_Session && !m_KeepAlive) // 544 A Keep Alive value of zero (0) has the effect of turning off the keep alive mechanism.
+	{
+		m_KeepAliveTimer.cancel();
+		return;
+	}
+
+	m_KeepAliveTimer.expires_at(GetKeepAliveDeadline());
+	m_KeepAliveTimer.async_wait([self = shared_from_this()](const boost::system::error_code& error)
+		{
+			if (error) // cancelled or restarted
+				return;
+			if (utils::chrono::tClock::now() >= self->GetKeepAliveDeadline())
+			{
+				self->Close();
+				return;
+			}
+			self->KeepAliveAsync();
+		});
+}
+
+utils::chrono::tTimePoint tBrokerClient::GetKeepAliveDeadline() const
+{
+	if (!m_Session) // CONNECT is awaited
+		return m_TimeReceived + std::chrono::seconds(LIB_SHARE_BROKER_CONNECT_TIMEOUT);
+	return m_TimeReceived + std::chrono::milliseconds(m_KeepAlive * 1500);
+}
+
+void tBrokerClient::SendPublish(const tBrokerDelivery& delivery, std::optional<std::uint16_t> packetId, bool dup)
+{
+	if (m_Closed)
+		return;
+
+	if (delivery.QoS == mqtt::tQoS::AtMostOnceDelivery && m_Outgoing.size() >= LIB_SHARE_BROKER_CLIENT_QUEUE_CAPACITY)
+	{
+		++m_Broker.m_StatsMessagesDropped;
+		return;
+	}
+
+	tBrokerOutgoing Outgoing;
+	Outgoing.Message = delivery.Message;
+	if (delivery.QoS != mqtt::tQoS::AtMostOnceDelivery || delivery.Retain || dup)
+	{
+		const std::size_t PacketIdSize = packetId.has_value() ? 2 : 0;
+		const std::size_t RemainingLength = delivery.Message->GetTopicNameField().size() + PacketIdSize + delivery.Message->GetPayload().size();
+		mqtt::hidden::tFixedHeaderBaseT<mqtt::tControlPacketType::PUBLISH> FixedHeader(delivery.Retain, delivery.QoS, dup);
+		Outgoing.Header[0] = FixedHeader.ToVector(0)[0];
+		Outgoing.HeaderSize = static_cast<std::uint8_t>(1 + PutRemainingLength(Outgoing.Header.data() + 1, static_cast<std::uint32_t>(RemainingLength)));
+		if (packetId.has_value())
+			Outgoing.PacketId = { static_cast<std::uint8_t>(*packetId >> 8), static_cast<std::uint8_t>(*packetId) };
+	}
+	m_Outgoing.push_back(std::move(Outgoing));
+	++m_Broker.m_StatsMessagesSent;
+	WriteAsync();
+}
+
+void tBrokerClient::SendControl(std::vector<std::uint8_t> data)
+{
+	if (m_Closed)
+		return;
+
+	tBrokerOutgoing Outgoing;
+	Outgoing.Control = std::move(data);
+	m_Outgoing.push_back(std::move(Outgoing));
+	WriteAsync();
+}
+
+void tBrokerClient::WriteAsync()
+{
+	if (m_Writing || m_Outgoing.empty() || m_Closed)
+		return;
+
+	// All the queued packets are sent by one write. The buffers refer to the shared frames, so a message is not copied per subscriber.
+	m_OutgoingWriting.swap(m_Outgoing);
+	m_Buffers.clear();
+	for (const tBrokerOutgoing& Outgoing : m_OutgoingWriting)
+	{
+		if (!Outgoing.Message)
+		{
+			m_Buffers.push_back(boost::asio::buffer(Outgoing.Control));
+			continue;
+		}
+
+		if (!Outgoing.HeaderSize)
+		{
+			m_Buffers.push_back(Outgoing.Message->GetFrame());
+			continue;
+		}
+
+		m_Buffers.push_back(boost::asio::buffer(Outgoing.Header.data(), Outgoing.HeaderSize));
+		m_Buffers.push_back(Outgoing.Message->GetTopicNameField());
+		if (Outgoing.Header[0] & 0x06) // QoS 1, 2
+			m_Buffers.push_back(boost::asio::buffer(Outgoing.PacketId));
+		if (Outgoing.Message->GetPayload().size())
+			m_Buffers.push_back(Outgoing.Message->GetPayload());
+	}
+
+	m_Writing = true;
+	m_Transport->AsyncWrite(m_Buffers, [self = shared_from_this()](const boost::system::error_code& error, std::size_t size)
+		{
+			self->m_Writing = false;
+			self->m_OutgoingWriting.clear();
+			if (error || (self->m_CloseWritten && self->m_Outgoing.empty()))
+			{
+				self->Close();
+				return;
+			}
+			self->WriteAsync();
+		});
+}
+
+void tBrokerClient::HandlePacket(mqtt::tControlPacketType packType, mqtt::tSpan data)
+{
+	// 632 After a Network Connection is established by a Client to a Server, the first Packet sent from the Client to
+	// 633 the Server MUST be a CONNECT Packet [MQTT-3.1.0-1].
+	if (!m_Session && packType != mqtt::tControlPacketType::CONNECT)
+		THROW_RUNTIME_ERROR(StrExceptionBrokerProtocolViolation);
+
+	switch (packType)
+	{
+	case mqtt::tControlPacketType::CONNECT:
+		// 635 A Client can only send the CONNECT Packet once over a Network Connection. The Server MUST
+		// 636 process a second CONNECT Packet sent from a Client as a protocol violation and disconnect the Client [MQTT-3.1.0-2].
+		if (m_Session)
+			THROW_RUNTIME_ERROR(StrExceptionBrokerProtocolViolation);
+		HandleCONNECT(data);
+		break;
+	case mqtt::tControlPacketType::PUBLISH:
+		HandlePUBLISH(data);
+		break;
+	case mqtt::tControlPacketType::PUBACK:
+	case mqtt::tControlPacketType::PUBREC:
+	case mqtt::tControlPacketType::PUBREL:
+	case mqtt::tControlPacketType::PUBCOMP:
+		HandlePacketId(packType, data);
+		break;
+	case mqtt::tControlPacketType::SUBSCRIBE:
+		HandleSUBSCRIBE(data);
+		break;
+	case mqtt::tControlPacketType::UNSUBSCRIBE:
+		HandleUNSUBSCRIBE(data);
+		break;
+	case mqtt::tControlPacketType::PINGREQ:
+		SendControl(mqtt::tPacketPINGRESP().ToVector());
+		break;
+	case mqtt::tControlPacketType::DISCONNECT:
+		m_Will.reset(); // [MQTT-3.1.2-10]
+		Close();
+		break;
+	default: // the packets sent by the server
+		THROW_RUNTIME_ERROR(StrExceptionBrokerProtocolViolation);
+	}
+}
+
+void tBrokerClient::HandleCONNECT(mqtt::tSpan data)
+{
+	auto Pack = mqtt::tPacketCONNECT::Parse(data);
+	if (!Pack.has_value())
+		THROW_RUNTIME_ERROR(StrExceptionReceivedParseError);
+
+	const auto VariableHeader = Pack->GetVariableHeader();
+	const auto Payload = Pack->GetPayload();
+
+	// 411 The Server MUST respond to the CONNECT Packet with a CONNACK return code 0x01 (unacceptable
+	// 412 protocol level) and then disconnect the Client if the Protocol Level is not supported by the Server [MQTT-3.1.2-2].
+	if (VariableHeader.ProtocolName != mqtt::hidden::DefaultProtocolName || VariableHeader.ProtocolLevel != mqtt::hidden::DefaultProtocolLevel)
+	{
+		SendControl(mqtt::tPacketCONNACK(mqtt::tSessionState::New, mqtt::tConnectReturnCode::ConnectionRefused_UnacceptableProtocolVersion).ToVector());
+		m_CloseWritten = true;
+		return;
+	}
+
+	const bool CleanSession = VariableHeader.ConnectFlags.Field.CleanSession;
+	std::string ClientId = Payload.ClientId;
+	if (ClientId.empty())
+	{
+		// 597 If the Client supplies a zero-byte ClientId with CleanSession set to 0, the Server MUST respond to the
+		// 598 CONNECT Packet with a CONNACK return code 0x02 (Identifier rejected) and then close the Network
+		// 599 Connection [MQTT-3.1.3-8].
+		if (!CleanSession)
+		{
+			SendControl(mqtt::tPacketCONNACK(mqtt::tSessionState::New, mqtt::tConnectReturnCode::ConnectionRefused_IdentifierRejected).ToVector());
+			m_CloseWritten = true;
+			return;
+		}
+		ClientId = m_Broker.MakeClientId();
+	}
+
+	if (VariableHeader.ConnectFlags.Field.WillFlag && Payload.WillTopic.has_value() && Payload.WillMessage.has_value())
+	{
+		if (!mqtt::IsTopicNameValid(*Payload.WillTopic))
+			THROW_RUNTIME_ERROR(StrExceptionBrokerProtocolViolation);
+		const auto WillMessage = std::span(reinterpret_cast<const std::uint8_t*>(Payload.WillMessage->data()), Payload.WillMessage->size());
+		const mqtt::tQoS WillQoS = std::min(static_cast<mqtt::tQoS>(VariableHeader.ConnectFlags.Field.WillQoS), mqtt::tQoS::ExactlyOnceDelivery);
+		m_Will = tWill{ std::make_shared<tBrokerMessage>(*Payload.WillTopic, WillMessage, WillQoS), static_cast<bool>(VariableHeader.ConnectFlags.Field.WillRetain) };
+	}
+
+	m_KeepAlive = VariableHeader.KeepAlive.Value;
+
+	auto [Session, SessionPresent] = m_Broker.OpenSession(this, ClientId, CleanSession);
+	m_Session = Session;
+
+	if (g_Log.IsEnabled(tLogCategory::Operation))
+		g_Log.Operation("BROKER CONNECT " + ClientId + (SessionPresent ? " (session present)" : ""));
+
+	SendControl(mqtt::tPacketCONNACK(SessionPresent ? mqtt::tSessionState::Present : mqtt::tSessionState::New, mqtt::tConnectReturnCode::ConnectionAccepted).ToVector());
+
+	KeepAliveAsync();
+
+	if (SessionPresent)
+		m_Broker.Resend(*m_Session);
+}
+
+void tBrokerClient::HandlePUBLISH(mqtt::tSpan data)
+{
+	auto FixedHeader = mqtt::hidden::tFixedHeaderBaseT<mqtt::tControlPacketType::PUBLISH>::Parse(data);
+	if (!FixedHeader.has_value())
+		THROW_RUNTIME_ERROR(StrExceptionReceivedParseError);
+	data.Shorten(FixedHeader->second);
+
+	const mqtt::tQoS QoS = FixedHeader->first.GetQoS();
+	if (QoS > mqtt::tQoS::ExactlyOnceDelivery) // 762 A PUBLISH Packet MUST NOT have both QoS bits set to 1 [MQTT-3.3.1-4].
+		THROW_RUNTIME_ERROR(StrExceptionBrokerProtocolViolation);
+
+	auto TopicName = mqtt::tString::Parse(data);
+	if (!TopicName.has_value() || !mqtt::IsTopicNameValid(*TopicName))
+		THROW_RUNTIME_ERROR(StrExceptionBrokerProtocolViolation);
+
+	std::optional<mqtt::tUInt16> PacketId;
+	if (QoS != mqtt::tQoS::AtMostOnceDelivery)
+	{
+		PacketId = mqtt::tUInt16::Parse(data);
+		if (!PacketId.has_value())
+			THROW_RUNTIME_ERROR(StrExceptionReceivedParseError);
+	}
+
+	++m_Broker.m_StatsMessagesReceived;
+
+	switch (QoS)
+	{
+	case mqtt::tQoS::AtMostOnceDelivery:
+		break;
+	case mqtt::tQoS::AtLeastOnceDelivery:
+		SendControl(mqtt::tPacketPUBACK(*PacketId).ToVector());
+		break;
+	case mqtt::tQoS::ExactlyOnceDelivery:
+		SendControl(mqtt::tPacketPUBREC(*PacketId).ToVector());
+		// 1164 Method B: the message is delivered onwards when PUBLISH is received, the Packet Identifier is kept until PUBREL,
+		// so the resent PUBLISH (DUP) is not delivered twice.
+		if (!m_Session->IncomingQoS2.insert(PacketId->Value).second)
+			return;
+		break;
+	}
+
+	m_Broker.Publish(std::make_shared<tBrokerMessage>(*TopicName, data, QoS), FixedHeader->first.GetRetain());
+}
+
+void tBrokerClient::HandleSUBSCRIBE(mqtt::tSpan data)
+{
+	auto Pack = mqtt::tPacketSUBSCRIBE::Parse(data);
+	if (!Pack.has_value() || Pack->GetPayload().empty()) // 1299 ... A SUBSCRIBE packet with no payload is a protocol violation [MQTT-3.8.3-3].
+		THROW_RUNTIME_ERROR(StrExceptionReceivedParseError);
+
+	std::vector<mqtt::tSubscribeReturnCode> ReturnCodes;
+	std::vector<std::pair<std::string, mqtt::tQoS>> Granted;
+	for (const auto& TopicFilter : Pack->GetPayload())
+	{
+		if (!mqtt::IsTopicFilterValid(TopicFilter.TopicFilter) || TopicFilter.QoS > mqtt::tQoS::ExactlyOnceDelivery)
+		{
+			ReturnCodes.push_back(mqtt::tSubscribeReturnCode::Failure);
+			continue;
+		}
+		ReturnCodes.push_back(static_cast<mqtt::tSubscribeReturnCode>(TopicFilter.QoS));
+		Granted.push_back({ TopicFilter.TopicFilter, TopicFilter.QoS });
+	}
+
+	SendControl(mqtt::tPacketSUBACK(Pack->GetVariableHeader().PacketId, ReturnCodes).ToVector());
+
+	for (auto& [TopicFilter, QoS] : Granted) // the retained messages are sent after SUBACK
+		m_Broker.Subscribe(*m_Session, TopicFilter, QoS);
+}
+
+void tBrokerClient::HandleUNSUBSCRIBE(mqtt::tSpan data)
+{
+	auto Pack = mqtt::tPacketUNSUBSCRIBE::Parse(data);
+	if (!Pack.has_value())
+		THROW_RUNTIME_ERROR(StrExceptionReceivedParseError);
+
+	for (const auto& TopicFilter : Pack->GetPayload())
+		m_Broker.Unsubscribe(*m_Session, TopicFilter);
+
+	// 1408 Even where no Topic Subscriptions are deleted, the Server MUST respond with an UNSUBACK [MQTT-3.10.4-5].
+	SendControl(mqtt::tPacketUNSUBACK(Pack->GetVariableHeader().PacketId).ToVector());
+}
+
+void tBrokerClient::HandlePacketId(mqtt::tControlPacketType packType, mqtt::tSpan data)
+{
+	auto FixedHeader = mqtt::hidden::tFixedHeaderBase::Parse<mqtt::hidden::tFixedHeaderBase>(data);
+	if (!FixedHeader.has_value())
+		THROW_RUNTIME_ERROR(StrExceptionReceivedParseError);
+	auto PacketId = mqtt::tUInt16::Parse(data);
+	if (!PacketId.has_value())
+		THROW_RUNTIME_ERROR(StrExceptionReceivedParseError);
+
+	tBrokerSession& Session = *m_Session;
+	switch (packType)
+	{
+	case mqtt::tControlPacketType::PUBACK: // QoS 1 has been delivered
+	case mqtt::tControlPacketType::PUBCOMP: // QoS 2 has been delivered
+		m_Broker.Acknowledge(Session, PacketId->Value);
+		break;
+	case mqtt::tControlPacketType::PUBREC:
+	{
+		auto It = Session.Inflight.find(PacketId->Value);
+		if (It != Session.Inflight.end())
+			It->second.PUBRECReceived = true; // 1147 ... MUST NOT re-send the PUBLISH once it has sent the corresponding PUBREL packet [MQTT-4.3.3-1]
+		SendControl(mqtt::tPacketPUBREL(*PacketId).ToVector());
+		break;
+	}
+	case mqtt::tControlPacketType::PUBREL:
+		Session.IncomingQoS2.erase(PacketId->Value);
+		SendControl(mqtt::tPacketPUBCOMP(*PacketId).ToVector());
+		break;
+	default:
+		break;
+	}
+}
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+tBroker::tBroker(const std::string& address, std::uint16_t port)
+	:m_Work(boost::asio::make_work_guard(m_ioc))
+{
+	if (port)
+	{
+		const boost::asio::ip::tcp::endpoint Ep(boost::asio::ip::make_address(address), port);
+		m_AcceptorTCP = std::make_unique<boost::asio::ip::tcp::acceptor>(m_ioc, Ep);
+		AcceptTCP();
+	}
+	m_FutureServer = std::async(std::launch::async, [&]() { m_ioc.run(); });
+}
+
+tBroker::tBroker(const std::string& address)
+	:m_Work(boost::asio::make_work_guard(m_ioc))
+{
+	const boost::asio::ip::tcp::endpoint Ep(boost::asio::ip::make_address(address), 0); // the port is chosen by the system
+	m_AcceptorTCP = std::make_unique<boost::asio::ip::tcp::acceptor>(m_ioc, Ep);
+	AcceptTCP();
+	m_FutureServer = std::async(std::launch::async, [&]() { m_ioc.run(); });
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+tBroker::tBroker(const std::string& address, std::uint16_t port, const std::string& pathUnix)
+	:m_Work(boost::asio::make_work_guard(m_ioc))
+{
+	if (port)
+	{
+		const boost::asio::ip::tcp::endpoint Ep(boost::asio::ip::make_address(address), port);
+		m_AcceptorTCP = std::make_unique<boost::asio::ip::tcp::acceptor>(m_ioc, Ep);
+		AcceptTCP();
+	}
+	::unlink(pathUnix.c_str()); // the socket file is left by the previous run
+	m_AcceptorUnix = std::make_unique<boost::asio::local::stream_protocol::acceptor>(m_ioc, boost::asio::local::stream_protocol::endpoint(pathUnix));
+	AcceptUnix();
+	m_FutureServer = std::async(std::launch::async, [&]() { m_ioc.run(); });
+}
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+tBroker::~tBroker()
+{
+	boost::asio::post(m_ioc, [this]() { Stop(); });
+
+	try
+	{
+		m_FutureServer.get();
+	}
+	catch (std::exception& ex)
+	{
+		g_Log.Exception(ex.what());
+	}
+}
+
+void tBroker::Attach(std::shared_ptr<tMemoryPipe> pipe)
+{
+	boost::asio::post(m_ioc, [this, pipe]()
+		{
+			Start(std::make_unique<tTransportMemory>(m_ioc, pipe, tMemoryPipe::tEnd::Server));
+		});
+}
+
+std::uint16_t tBroker::GetPortTCP() const
+{
+	return m_AcceptorTCP ? m_AcceptorTCP->local_endpoint().port() : 0;
+}
+
+tBrokerStats tBroker::GetStats() const
+{
+	tBrokerStats Stats;
+	Stats.Clients = m_StatsClients;
+	Stats.Sessions = m_StatsSessions;
+	Stats.MessagesReceived = m_StatsMessagesReceived;
+	Stats.MessagesSent = m_StatsMessagesSent;
+	Stats.MessagesDropped = m_StatsMessagesDropped;
+	Stats.RetainedMessages = m_StatsRetainedMessages;
+	return Stats;
+}
+
+void tBroker::AcceptTCP()
+{
+	m_AcceptorTCP->async_accept([this](const boost::system::error_code& error, boost::asio::ip::tcp::socket socket)
+		{
+			if (error) // the acceptor has been closed
+				return;
+			socket.set_option(boost::asio::ip::tcp::no_delay(true));
+			Start(std::make_unique<tTransportTCP>(std::move(socket)));
+			AcceptTCP();
+		});
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+void tBroker::AcceptUnix()
+{
+	m_AcceptorUnix->async_accept([this](const boost::system::error_code& error, boost::asio::local::stream_protocol::socket socket)
+		{
+			if (error) // the acceptor has been closed
+				return;
+			Start(std::make_unique<tTransportUnix>(std::move(socket)));
+			AcceptUnix();
+		});
+}
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+void tBroker::Start(std::unique_ptr<tTransport> transport)
+{
+	auto Client = std::make_shared<hidden::tBrokerClient>(*this, std::move(transport));
+	m_Clients.insert(Client);
+	++m_StatsClients;
+	Client->Start();
+}
+
+void tBroker::Stop()
+{
+	boost::system::error_code Error;
+	if (m_AcceptorTCP)
+		m_AcceptorTCP->close(Error);
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	if (m_AcceptorUnix)
+		m_AcceptorUnix->close(Error);
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+	auto Clients = m_Clients; // they are removed from m_Clients when closed
+	for (auto& Client : Clients)
+	{
+		Client->m_Will.reset(); // the server is shut down, it's not a failure of the client
+		Client->Close();
+	}
+
+	m_Work.reset();
+}
+
+std::pair<tBroker::tSessionPtr, bool> tBroker::OpenSession(hidden::tBrokerClient* client, const std::string& clientId, bool cleanSession)
+{
+	auto It = m_Sessions.find(clientId);
+	if (It != m_Sessions.end() && It->second->Client)
+	{
+		// 655 If the ClientId represents a Client already connected to the Server then the Server MUST
+		// 656 disconnect the existing Client [MQTT-3.1.4-2].
+		It->second->Client->Close(); // the session is removed if it's a clean one
+		It = m_Sessions.find(clientId);
+	}
+
+	// 460 If CleanSession is set to 1, the Client and Server MUST discard any previous Session and start a new one.
+	if (It != m_Sessions.end() && cleanSession)
+	{
+		for (auto& [TopicFilter, QoS] : It->second->Subscriptions)
+			m_Subscriptions.Unsubscribe(It->second.get(), TopicFilter);
+		m_Sessions.erase(It);
+		--m_StatsSessions;
+		It = m_Sessions.end();
+	}
+
+	const bool SessionPresent = It != m_Sessions.end();
+	if (!SessionPresent)
+	{
+		auto Session = std::make_shared<hidden::tBrokerSession>();
+		Session->ClientId = clientId;
+		It = m_Sessions.emplace(clientId, Session).first;
+		++m_StatsSessions;
+	}
+
+	It->second->CleanSession = cleanSession;
+	It->second->Client = client;
+	return { It->second, SessionPresent };
+}
+
+void tBroker::CloseSession(hidden::tBrokerClient* client)
+{
+	auto It = m_Sessions.find(client->m_Session->ClientId);
+	if (It == m_Sessions.end() || It->second != client->m_Session)
+		return;
+
+	It->second->Client = nullptr;
+
+	// 464 ... The Session lasts as long as the Network Connection.
+	if (!It->second->CleanSession)
+		return;
+
+	for (auto& [TopicFilter, QoS] : It->second->Subscriptions)
+		m_Subscriptions.Unsubscribe(It->second.get(), TopicFilter);
+	m_Sessions.erase(It);
+	--m_StatsSessions;
+}
+
+std::string tBroker::MakeClientId()
+{
+	return "auto-" + std::to_string(++m_ClientIdGenerated);
+}
+
+void tBroker::Publish(const hidden::tBrokerMessagePtr& message, bool retain)
+{
+	if (retain)
+	{
+		// 740 A PUBLISH Packet with a RETAIN flag set to 1 and a payload containing zero bytes will be processed as
+		// 741 normal by the Server and sent to Clients with a subscription matching the topic name. Additionally any
+		// 742 existing retained message with the same topic name MUST be removed ... [MQTT-3.3.1-10].
+		if (message->IsPayloadEmpty())
+		{
+			auto It = m_Retained.find(message->GetTopicName());
+			if (It != m_Retained.end())
+				m_Retained.erase(It);
+		}
+		else
+		{
+			m_Retained[std::string(message->GetTopicName())] = message;
+		}
+		m_StatsRetainedMessages = m_Retained.size();
+	}
+
+	hidden::tSubscriptionIndex::tSubscribers Subscribers;
+	m_Subscriptions.Match(message->GetTopicName(), Subscribers);
+	for (auto& [Session, QoS] : Subscribers)
+	{
+		// 734 When sending a PUBLISH Packet to a Client the Server MUST set the RETAIN flag to 1 if a message is
+		// 735 sent as a result of a new subscription being made by a Client [MQTT-3.3.1-8]. It MUST set the RETAIN
+		// 736 flag to 0 when a PUBLISH Packet is sent to a Client because it matches an established subscription
+		// 737 regardless of how the flag was set in the message it received [MQTT-3.3.1-9].
+		Deliver(*Session, { message, std::min(QoS, message->GetQoS()), false });
+	}
+}
+
+void tBroker::Subscribe(hidden::tBrokerSession& session, std::string_view topicFilter, mqtt::tQoS qos)
+{
+	session.Subscriptions[std::string(topicFilter)] = qos;
+	m_Subscriptions.Subscribe(&session, topicFilter, qos);
+
+	// 1310 ... If a Server receives a SUBSCRIBE Packet ... any existing retained messages matching the Topic Filter MUST be re-sent [MQTT-3.8.4-3].
+	for (auto& [TopicName, Message] : m_Retained)
+	{
+		if (mqtt::IsTopicFilterMatch(topicFilter, TopicName))
+			Deliver(session, { Message, std::min(qos, Message->GetQoS()), true });
+	}
+}
+
+void tBroker::Unsubscribe(hidden::tBrokerSession& session, std::string_view topicFilter)
+{
+	auto It = session.Subscriptions.find(topicFilter);
+	if (It == session.Subscriptions.end())
+		return;
+	m_Subscriptions.Unsubscribe(&session, topicFilter);
+	session.Subscriptions.erase(It);
+}
+
+void tBroker::Deliver(hidden::tBrokerSession& session, const hidden::tBrokerDelivery& delivery)
+{
+	if (delivery.QoS == mqtt::tQoS::AtMostOnceDelivery)
+	{
+		if (session.Client)
+			session.Client->SendPublish(delivery, {}, false);
+		return;
+	}
+
+	// 1191 When a Client reconnects with CleanSession set to 0, both the Client and Server MUST re-send any
+	// 1192 unacknowledged PUBLISH Packets (where QoS > 0) and PUBREL Packets using their original Packet Identifiers [MQTT-4.4.0-1].
+	if (session.Pending.size() >= LIB_SHARE_BROKER_SESSION_QUEUE_CAPACITY)
+	{
+		++m_StatsMessagesDropped;
+		return;
+	}
+	session.Pending.push_back(delivery);
+	DeliverPending(session);
+}
+
+void tBroker::DeliverPending(hidden::tBrokerSession& session)
+{
+	while (session.Client && !session.Pending.empty() && session.Inflight.size() < LIB_SHARE_BROKER_INFLIGHT_MAX)
+	{
+		std::optional<std::uint16_t> PacketId = session.PacketIdPool.Allocate();
+		if (!PacketId.has_value())
+			break;
+		hidden::tBrokerDelivery Delivery = std::move(session.Pending.front());
+		session.Pending.pop_front();
+		session.Client->SendPublish(Delivery, PacketId, false);
+		session.Inflight.emplace(*PacketId, hidden::tBrokerSession::tInflight{ std::move(Delivery), false });
+	}
+}
+
+void tBroker::Resend(hidden::tBrokerSession& session)
+{
+	for (auto& [PacketId, Inflight] : session.Inflight)
+	{
+		if (Inflight.PUBRECReceived)
+		{
+			session.Client->SendControl(mqtt::tPacketPUBREL(PacketId).ToVector());
+		}
+		else
+		{
+			session.Client->SendPublish(Inflight.Delivery, PacketId, true);
+		}
+	}
+	DeliverPending(session);
+}
+
+void tBroker::Acknowledge(hidden::tBrokerSession& session, std::uint16_t packetId)
+{
+	if (session.Inflight.erase(packetId))
+		session.PacketIdPool.Release(packetId);
+	DeliverPending(session);
+}
+
+}
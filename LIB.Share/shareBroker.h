@@ -0,0 +1,259 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareBroker
+// 2026-10-18
+// C++20
+//
+// MQTT 3.1.1 server: QoS 0, 1, 2; retained messages; will messages; persistent sessions.
+// The broker is run by its own task, all the sessions are handled within one io_context (no locks on the routing path).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <shareMQTT.h>
+#include <shareTransport.h>
+
+namespace share
+{
+
+class tBroker;
+
+namespace hidden
+{
+
+// PUBLISH is encoded once when it is received, the frame is shared by all the subscribers and by the retained messages.
+// It is the frame for QoS 0 without RETAIN, for other deliveries the fixed header and Packet Identifier are sent
+// in front of the shared parts of the frame (gather write).
+class tBrokerMessage
+{
+	std::vector<std::uint8_t> m_Frame;
+	std::size_t m_TopicNameOffset = 0; // the length and the string
+	std::size_t m_PayloadOffset = 0;
+	mqtt::tQoS m_QoS = mqtt::tQoS::AtMostOnceDelivery; // the publisher's one
+
+public:
+	tBrokerMessage(std::string_view topicName, std::span<const std::uint8_t> payload, mqtt::tQoS qos);
+
+	std::string_view GetTopicName() const;
+	mqtt::tQoS GetQoS() const { return m_QoS; }
+	bool IsPayloadEmpty() const { return m_PayloadOffset == m_Frame.size(); }
+
+	boost::asio::const_buffer GetFrame() const { return boost::asio::buffer(m_Frame); }
+	boost::asio::const_buffer GetTopicNameField() const { return boost::asio::buffer(m_Frame.data() + m_TopicNameOffset, m_PayloadOffset - m_TopicNameOffset); }
+	boost::asio::const_buffer GetPayload() const { return boost::asio::buffer(m_Frame.data() + m_PayloadOffset, m_Frame.size() - m_PayloadOffset); }
+};
+
+using tBrokerMessagePtr = std::shared_ptr<const tBrokerMessage>;
+
+struct tBrokerDelivery
+{
+	tBrokerMessagePtr Message;
+	mqtt::tQoS QoS = mqtt::tQoS::AtMostOnceDelivery; // min(the publisher's QoS, the subscriber's QoS)
+	bool Retain = false;
+};
+
+struct tBrokerSession
+{
+	struct tInflight
+	{
+		tBrokerDelivery Delivery;
+		bool PUBRECReceived = false; // QoS 2: PUBREL has been sent, PUBCOMP is awaited
+	};
+
+	std::string ClientId;
+	bool CleanSession = true;
+	class tBrokerClient* Client = nullptr; // it is connected
+	std::map<std::string, mqtt::tQoS, std::less<>> Subscriptions;
+	std::map<std::uint16_t, tInflight> Inflight; // QoS 1, 2 sent to the client
+	std::deque<tBrokerDelivery> Pending; // QoS 1, 2 waiting for the client or for the room in Inflight
+	std::set<std::uint16_t> IncomingQoS2; // PUBREC has been sent, PUBREL is awaited
+	tPacketIdPool PacketIdPool{ 1 };
+};
+
+// Topic tree, the levels of the Topic Filters are the nodes.
+class tSubscriptionIndex
+{
+	struct tNode
+	{
+		std::map<std::string, std::unique_ptr<tNode>, std::less<>> Children; // including "+" and "#"
+		std::map<tBrokerSession*, mqtt::tQoS> Subscribers;
+	};
+
+	tNode m_Root;
+
+public:
+	using tSubscribers = std::map<tBrokerSession*, mqtt::tQoS>;
+
+	void Subscribe(tBrokerSession* session, std::string_view topicFilter, mqtt::tQoS qos);
+	void Unsubscribe(tBrokerSession* session, std::string_view topicFilter);
+
+	// 1286 When Clients make subscriptions with Topic Filters that include wildcards, it is possible for a Client's
+	// 1287 subscriptions to overlap so that a published message might match multiple filters. In this case the Server
+	// 1288 MUST deliver the message to the Client respecting the maximum QoS of all the matching subscriptions [MQTT-3.3.5-1].
+	void Match(std::string_view topicName, tSubscribers& subscribers) const;
+
+private:
+	static void Match(const tNode& node, const std::vector<std::string_view>& levels, std::size_t level, tSubscribers& subscribers);
+	static void Add(const tNode& node, tSubscribers& subscribers);
+	static bool Unsubscribe(tNode& node, tBrokerSession* session, std::string_view topicFilter); // returns true if the node is empty
+};
+
+struct tBrokerOutgoing // a packet queued for sending
+{
+	tBrokerMessagePtr Message; // PUBLISH
+	std::array<std::uint8_t, 5> Header{}; // PUBLISH: fixed header, if it differs from the one in the frame
+	std::uint8_t HeaderSize = 0;
+	std::array<std::uint8_t, 2> PacketId{}; // PUBLISH QoS 1, 2
+	std::vector<std::uint8_t> Control; // other packets
+};
+
+class tBrokerClient : public std::enable_shared_from_this<tBrokerClient>
+{
+	friend class share::tBroker;
+
+	struct tWill
+	{
+		tBrokerMessagePtr Message;
+		bool Retain = false;
+	};
+
+	tBroker& m_Broker;
+	std::unique_ptr<tTransport> m_Transport;
+	std::vector<std::uint8_t> m_ReceiveBuffer;
+	std::vector<std::uint8_t> m_ReceivedData; // a packet which is not completely received yet
+	boost::asio::steady_timer m_KeepAliveTimer;
+	utils::chrono::tTimePoint m_TimeReceived = utils::chrono::tClock::now();
+	std::uint16_t m_KeepAlive = 0;
+	std::deque<tBrokerOutgoing> m_Outgoing;
+	std::deque<tBrokerOutgoing> m_OutgoingWriting; // they are kept until the writing is completed
+	tTransport::tBuffers m_Buffers;
+	bool m_Writing = false;
+	bool m_Closed = false;
+	bool m_CloseWritten = false; // the connection is closed when the queued packets have been written (CONNACK refusing the connection)
+	std::shared_ptr<tBrokerSession> m_Session; // CONNECT has been received
+	std::optional<tWill> m_Will;
+
+public:
+	tBrokerClient(tBroker& broker, std::unique_ptr<tTransport> transport);
+
+	void Start();
+	void Close();
+
+	void SendPublish(const tBrokerDelivery& delivery, std::optional<std::uint16_t> packetId, bool dup);
+	void SendControl(std::vector<std::uint8_t> data);
+
+	bool IsConnected() const { return m_Session != nullptr && !m_Closed; }
+
+private:
+	void ReceiveAsync();
+	void KeepAliveAsync();
+	utils::chrono::tTimePoint GetKeepAliveDeadline() const;
+	void WriteAsync();
+
+	void HandlePacket(mqtt::tControlPacketType packType, mqtt::tSpan data); // it throws on a protocol violation
+	void HandleCONNECT(mqtt::tSpan data);
+	void HandlePUBLISH(mqtt::tSpan data);
+	void HandleSUBSCRIBE(mqtt::tSpan data);
+	void HandleUNSUBSCRIBE(mqtt::tSpan data);
+	void HandlePacketId(mqtt::tControlPacketType packType, mqtt::tSpan data); // PUBACK, PUBREC, PUBREL, PUBCOMP
+};
+
+}
+
+struct tBrokerStats
+{
+	std::uint64_t Clients = 0;
+	std::uint64_t Sessions = 0;
+	std::uint64_t MessagesReceived = 0;
+	std::uint64_t MessagesSent = 0;
+	std::uint64_t MessagesDropped = 0; // the queue of a client or a session is full
+	std::uint64_t RetainedMessages = 0;
+};
+
+class tBroker
+{
+	friend class hidden::tBrokerClient;
+
+	using tSessionPtr = std::shared_ptr<hidden::tBrokerSession>;
+
+	boost::asio::io_context m_ioc;
+	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_Work;
+	std::unique_ptr<boost::asio::ip::tcp::acceptor> m_AcceptorTCP;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	std::unique_ptr<boost::asio::local::stream_protocol::acceptor> m_AcceptorUnix;
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+	std::future<void> m_FutureServer;
+
+	std::set<std::shared_ptr<hidden::tBrokerClient>> m_Clients;
+	std::map<std::string, tSessionPtr, std::less<>> m_Sessions; // ClientId
+	hidden::tSubscriptionIndex m_Subscriptions;
+	std::map<std::string, hidden::tBrokerMessagePtr, std::less<>> m_Retained; // Topic Name
+	std::uint64_t m_ClientIdGenerated = 0;
+
+	std::atomic<std::uint64_t> m_StatsClients = 0;
+	std::atomic<std::uint64_t> m_StatsSessions = 0;
+	std::atomic<std::uint64_t> m_StatsMessagesReceived = 0;
+	std::atomic<std::uint64_t> m_StatsMessagesSent = 0;
+	std::atomic<std::uint64_t> m_StatsMessagesDropped = 0;
+	std::atomic<std::uint64_t> m_StatsRetainedMessages = 0;
+
+public:
+	tBroker() = delete;
+	tBroker(const std::string& address, std::uint16_t port); // port 0 - TCP is not used
+	explicit tBroker(const std::string& address); // TCP on an ephemeral port, it's returned by GetPortTCP()
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	tBroker(const std::string& address, std::uint16_t port, const std::string& pathUnix);
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+	tBroker(const tBroker&) = delete;
+	tBroker(tBroker&&) = delete;
+	~tBroker();
+
+	tBroker& operator=(const tBroker&) = delete;
+	tBroker& operator=(tBroker&&) = delete;
+
+	// In-process client: the client end of the pipe is used by tConnection (tTransportMemory).
+	void Attach(std::shared_ptr<tMemoryPipe> pipe);
+
+	std::uint16_t GetPortTCP() const;
+	tBrokerStats GetStats() const;
+
+private:
+	void AcceptTCP();
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	void AcceptUnix();
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+	void Start(std::unique_ptr<tTransport> transport);
+	void Stop();
+
+	// The functions below are called by the clients within the io_context.
+	std::pair<tSessionPtr, bool> OpenSession(hidden::tBrokerClient* client, const std::string& clientId, bool cleanSession); // returns the session and Session Present
+	void CloseSession(hidden::tBrokerClient* client);
+	std::string MakeClientId();
+
+	void Publish(const hidden::tBrokerMessagePtr& message, bool retain);
+	void Subscribe(hidden::tBrokerSession& session, std::string_view topicFilter, mqtt::tQoS qos);
+	void Unsubscribe(hidden::tBrokerSession& session, std::string_view topicFilter);
+
+	void Deliver(hidden::tBrokerSession& session, const hidden::tBrokerDelivery& delivery);
+	void DeliverPending(hidden::tBrokerSession& session);
+	void Resend(hidden::tBrokerSession& session); // the session is resumed
+	void Acknowledge(hidden::tBrokerSession& session, std::uint16_t packetId); // PUBACK, PUBCOMP
+};
+
+}
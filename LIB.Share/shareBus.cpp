@@ -0,0 +1,78 @@
+#include "shareBus.h"
+
+#include <utilsException.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace share
+{
+namespace hidden
+{
+
+constexpr char StrExceptionBusTopicFilter[] = "The Topic Filter is not valid.";
+
+}
+
+tMessageBus::tSubscriptionId tMessageBus::Subscribe(std::string_view topicFilter, tHandler handler)
+{
+	if (!mqtt::IsTopicFilterValid(topicFilter))
+		THROW_RUNTIME_ERROR(hidden::StrExceptionBusTopicFilter);
+
+	std::unique_lock Lock(m_Mtx);
+	auto Subscription = std::make_shared<tSubscription>();
+	Subscription->Id = m_SubscriptionIdNext++;
+	Subscription->TopicFilter = topicFilter;
+	Subscription->Handler = std::move(handler);
+	m_Subscriptions.push_back(std::move(Subscription));
+	m_Routes.clear();
+	return m_Subscriptions.back()->Id;
+}
+
+void tMessageBus::Unsubscribe(tSubscriptionId id)
+{
+	std::unique_lock Lock(m_Mtx);
+	std::erase_if(m_Subscriptions, [id](const auto& subscription) { return subscription->Id == id; });
+	m_Routes.clear();
+}
+
+std::size_t tMessageBus::Publish(const tIncomingMessage& msg)
+{
+	const std::shared_ptr<const tRoute> Route = GetRoute(msg);
+	for (const auto& Subscription : *Route)
+		Subscription->Handler(msg);
+	return Route->size();
+}
+
+std::size_t tMessageBus::GetSubscriptionQty() const
+{
+	std::shared_lock Lock(m_Mtx);
+	return m_Subscriptions.size();
+}
+
+std::shared_ptr<const tMessageBus::tRoute> tMessageBus::GetRoute(const tIncomingMessage& msg)
+{
+	{
+		std::shared_lock Lock(m_Mtx);
+		if (msg.TopicId < m_Routes.size() && m_Routes[msg.TopicId])
+			return m_Routes[msg.TopicId];
+	}
+
+	auto Route = std::make_shared<tRoute>();
+	std::unique_lock Lock(m_Mtx);
+	for (const auto& Subscription : m_Subscriptions)
+	{
+		if (mqtt::IsTopicFilterMatch(Subscription->TopicFilter, msg.TopicName))
+			Route->push_back(Subscription);
+	}
+
+	if (msg.TopicId != tTopicTable::IdNone) // the topic is in g_Topics
+	{
+		if (msg.TopicId >= m_Routes.size())
+			m_Routes.resize(msg.TopicId + 1);
+		m_Routes[msg.TopicId] = Route;
+	}
+	return Route;
+}
+
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareBus
+// 2026-10-19
+// C++20
+//
+// In-process fan-out of the incoming messages: the local consumers subscribe with Topic Filters, a message is given
+// to all the consumers of its topic, the payload is shared by them (tPayload), it's not copied.
+// The consumers of a topic are found once, the route is kept for the tTopicId until the subscriptions are changed.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <shareMQTT.h>
+
+namespace share
+{
+
+class tMessageBus
+{
+public:
+	using tHandler = std::function<void(const tIncomingMessage&)>; // it's called by the task publishing the message
+	using tSubscriptionId = std::uint64_t;
+
+private:
+	struct tSubscription
+	{
+		tSubscriptionId Id = 0;
+		std::string TopicFilter;
+		tHandler Handler;
+	};
+
+	using tRoute = std::vector<std::shared_ptr<const tSubscription>>;
+
+	mutable std::shared_mutex m_Mtx;
+	std::vector<std::shared_ptr<const tSubscription>> m_Subscriptions;
+	std::vector<std::shared_ptr<const tRoute>> m_Routes; // the index is tTopicId, nullptr - the route has not been found yet
+	tSubscriptionId m_SubscriptionIdNext = 1;
+
+public:
+	tMessageBus() = default;
+	tMessageBus(const tMessageBus&) = delete;
+	tMessageBus(tMessageBus&&) = delete;
+
+	tMessageBus& operator=(const tMessageBus&) = delete;
+	tMessageBus& operator=(tMessageBus&&) = delete;
+
+	// The subscriptions can be changed from any task, a handler can be called once more when it's been unsubscribed
+	// (the message has been being published).
+	tSubscriptionId Subscribe(std::string_view topicFilter, tHandler handler); // it throws if the Topic Filter is not valid
+	void Unsubscribe(tSubscriptionId id);
+
+	std::size_t Publish(const tIncomingMessage& msg); // returns the number of the consumers; thread safe
+
+	std::size_t GetSubscriptionQty() const;
+
+private:
+	std::shared_ptr<const tRoute> GetRoute(const tIncomingMessage& msg);
+};
+
+}
@@ -0,0 +1,139 @@
+#include "shareCapture.h"
+#include "shareLog.h"
+
+#include <utilsException.h>
+
+#include <algorithm>
+#include <array>
+
+#ifndef LIB_SHARE_CAPTURE_BUFFER_SIZE
+#define LIB_SHARE_CAPTURE_BUFFER_SIZE (64 * 1024)
+#endif
+
+namespace share
+{
+namespace hidden
+{
+
+constexpr char CaptureSignature[] = "MQTTCAP1";
+constexpr std::size_t CaptureSignatureSize = sizeof(CaptureSignature) - 1;
+constexpr std::size_t CaptureRecordHeaderSize = 16;
+constexpr std::uint32_t CaptureFrameSizeMax = 256 * 1024 * 1024 + 5; // 2.2.3 Remaining Length ... 268,435,455 (256 MB) + the fixed header
+
+constexpr char StrExceptionCaptureOpen[] = "The capture file has not been opened.";
+constexpr char StrExceptionCaptureWrite[] = "The capture file has not been written.";
+constexpr char StrExceptionCaptureSignature[] = "The file is not a capture.";
+constexpr char StrExceptionCaptureRecord[] = "The capture record is corrupted.";
+
+template<typename T>
+void PutLE(std::uint8_t* dst, T val)
+{
+	for (std::size_t i = 0; i < sizeof(T); ++i, val >>= 8)
+		dst[i] = static_cast<std::uint8_t>(val);
+}
+
+template<typename T>
+T GetLE(const std::uint8_t* src)
+{
+	T Val = 0;
+	for (std::size_t i = sizeof(T); i > 0; --i)
+		Val = static_cast<T>((Val << 8) | src[i - 1]);
+	return Val;
+}
+
+}
+
+tCaptureWriter::tCaptureWriter(const std::string& path)
+	:m_File(path, std::ios::binary | std::ios::trunc), m_TimeStart(utils::chrono::tClock::now())
+{
+	if (!m_File.is_open())
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureOpen);
+
+	m_Buffer.reserve(LIB_SHARE_CAPTURE_BUFFER_SIZE);
+	m_Buffer.insert(m_Buffer.end(), hidden::CaptureSignature, hidden::CaptureSignature + hidden::CaptureSignatureSize);
+}
+
+tCaptureWriter::~tCaptureWriter()
+{
+	try
+	{
+		Flush();
+	}
+	catch (const std::exception& ex)
+	{
+		g_Log.Exception(ex.what());
+	}
+}
+
+void tCaptureWriter::Write(std::uint16_t stream, tCaptureDirection direction, std::span<const std::uint8_t> frame)
+{
+	const auto Time = std::chrono::duration_cast<utils::chrono::ttime_ns>(utils::chrono::tClock::now() - m_TimeStart);
+
+	std::array<std::uint8_t, hidden::CaptureRecordHeaderSize> Header{};
+	hidden::PutLE<std::uint64_t>(Header.data(), Time.count());
+	hidden::PutLE<std::uint32_t>(Header.data() + 8, static_cast<std::uint32_t>(frame.size()));
+	Header[12] = static_cast<std::uint8_t>(direction);
+	hidden::PutLE<std::uint16_t>(Header.data() + 14, stream);
+
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	if (m_Buffer.size() + Header.size() + frame.size() > LIB_SHARE_CAPTURE_BUFFER_SIZE)
+		WriteFile();
+	m_Buffer.insert(m_Buffer.end(), Header.begin(), Header.end());
+	m_Buffer.insert(m_Buffer.end(), frame.begin(), frame.end());
+}
+
+void tCaptureWriter::Flush()
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	WriteFile();
+	m_File.flush();
+	if (!m_File)
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureWrite);
+}
+
+void tCaptureWriter::WriteFile()
+{
+	m_File.write(reinterpret_cast<const char*>(m_Buffer.data()), m_Buffer.size());
+	m_Buffer.clear(); // the records are lost if it has failed
+	if (!m_File)
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureWrite);
+}
+
+tCaptureReader::tCaptureReader(const std::string& path)
+	:m_File(path, std::ios::binary)
+{
+	if (!m_File.is_open())
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureOpen);
+
+	std::array<char, hidden::CaptureSignatureSize> Signature{};
+	m_File.read(Signature.data(), Signature.size());
+	if (!m_File || !std::equal(Signature.begin(), Signature.end(), hidden::CaptureSignature))
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureSignature);
+}
+
+std::optional<tCaptureRecord> tCaptureReader::Read()
+{
+	std::array<std::uint8_t, hidden::CaptureRecordHeaderSize> Header{};
+	m_File.read(reinterpret_cast<char*>(Header.data()), Header.size());
+	if (m_File.gcount() == 0)
+		return {};
+	if (m_File.gcount() != static_cast<std::streamsize>(Header.size()))
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureRecord);
+
+	tCaptureRecord Record;
+	Record.Time = utils::chrono::ttime_ns(hidden::GetLE<std::uint64_t>(Header.data()));
+	const std::uint32_t FrameSize = hidden::GetLE<std::uint32_t>(Header.data() + 8);
+	if (FrameSize > hidden::CaptureFrameSizeMax || Header[12] > static_cast<std::uint8_t>(tCaptureDirection::Received))
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureRecord);
+	Record.Direction = static_cast<tCaptureDirection>(Header[12]);
+	Record.Stream = hidden::GetLE<std::uint16_t>(Header.data() + 14);
+
+	Record.Frame.resize(FrameSize);
+	m_File.read(reinterpret_cast<char*>(Record.Frame.data()), FrameSize);
+	if (m_File.gcount() != static_cast<std::streamsize>(FrameSize))
+		THROW_RUNTIME_ERROR(hidden::StrExceptionCaptureRecord);
+
+	return Record;
+}
+
+}
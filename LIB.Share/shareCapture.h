@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareCapture
+// 2026-10-18
+// C++20
+//
+// Capture of MQTT frames: the frames sent and received by the connections are written to a file as they are,
+// so the traffic can be replayed (Replay app).
+//
+// File: "MQTTCAP1", then the records.
+// Record (little-endian): time [ns] since the capture has been started (8), frame size (4), direction (1), reserved (1), stream (2), frame.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <utilsChrono.h>
+
+namespace share
+{
+
+enum class tCaptureDirection : std::uint8_t
+{
+	Sent,
+	Received,
+};
+
+struct tCaptureRecord
+{
+	utils::chrono::ttime_ns Time{}; // since the capture has been started
+	std::uint16_t Stream = 0; // a connection
+	tCaptureDirection Direction = tCaptureDirection::Sent;
+	std::vector<std::uint8_t> Frame;
+};
+
+// The records are buffered, the buffer is written to the file when it is full and when the capture is destroyed.
+// Write(..) and Flush() throw if the file can't be written.
+class tCaptureWriter
+{
+	std::ofstream m_File;
+	std::vector<std::uint8_t> m_Buffer;
+	const utils::chrono::tTimePoint m_TimeStart;
+	std::atomic<std::uint16_t> m_StreamNext = 0;
+	std::mutex m_Mtx;
+
+public:
+	tCaptureWriter() = delete;
+	explicit tCaptureWriter(const std::string& path);
+	tCaptureWriter(const tCaptureWriter&) = delete;
+	tCaptureWriter(tCaptureWriter&&) = delete;
+	~tCaptureWriter();
+
+	tCaptureWriter& operator=(const tCaptureWriter&) = delete;
+	tCaptureWriter& operator=(tCaptureWriter&&) = delete;
+
+	std::uint16_t OpenStream() { return m_StreamNext++; }
+
+	void Write(std::uint16_t stream, tCaptureDirection direction, std::span<const std::uint8_t> frame); // thread safe
+	void Flush();
+
+private:
+	void WriteFile(); // m_Mtx is locked
+};
+
+class tCaptureReader
+{
+	std::ifstream m_File;
+
+public:
+	tCaptureReader() = delete;
+	explicit tCaptureReader(const std::string& path);
+
+	std::optional<tCaptureRecord> Read(); // no value at the end of the file
+};
+
+}
@@ -0,0 +1,84 @@
+#include "shareHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace share
+{
+
+std::uint64_t tHistogramSnapshot::GetPercentile(double percentile) const
+{
+	if (Count == 0)
+		return 0;
+
+	const double Rank = std::ceil(Count * std::clamp(percentile, 0.0, 100.0) / 100);
+	const std::uint64_t CountRank = std::max<std::uint64_t>(static_cast<std::uint64_t>(Rank), 1);
+	std::uint64_t CountSum = 0;
+	for (std::size_t i = 0; i < Counts.size(); ++i)
+	{
+		CountSum += Counts[i];
+		if (CountSum >= CountRank)
+			return std::clamp(tLatencyHistogram::GetBucketValueMax(i), Min, Max);
+	}
+	return Max;
+}
+
+std::string tHistogramSnapshot::ToString() const
+{
+	return "n=" + std::to_string(Count) +
+		" p50=" + std::to_string(GetPercentile(50)) +
+		" p99=" + std::to_string(GetPercentile(99)) +
+		" p999=" + std::to_string(GetPercentile(99.9)) +
+		" max=" + std::to_string(Max) + " us";
+}
+
+void tLatencyHistogram::Record(std::uint64_t value)
+{
+	m_Counts[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+	m_Count.fetch_add(1, std::memory_order_relaxed);
+	m_Sum.fetch_add(value, std::memory_order_relaxed);
+
+	std::uint64_t Min = m_Min.load(std::memory_order_relaxed);
+	while (value < Min && !m_Min.compare_exchange_weak(Min, value, std::memory_order_relaxed));
+	std::uint64_t Max = m_Max.load(std::memory_order_relaxed);
+	while (value > Max && !m_Max.compare_exchange_weak(Max, value, std::memory_order_relaxed));
+}
+
+tHistogramSnapshot tLatencyHistogram::GetSnapshot() const
+{
+	// The counters are read one by one while they can be recorded, so Count is taken from the buckets.
+	tHistogramSnapshot Snapshot;
+	Snapshot.Counts.resize(BucketQty);
+	for (std::size_t i = 0; i < BucketQty; ++i)
+	{
+		Snapshot.Counts[i] = m_Counts[i].load(std::memory_order_relaxed);
+		Snapshot.Count += Snapshot.Counts[i];
+	}
+	Snapshot.Sum = m_Sum.load(std::memory_order_relaxed);
+	Snapshot.Max = m_Max.load(std::memory_order_relaxed);
+	Snapshot.Min = Snapshot.Count ? std::min(m_Min.load(std::memory_order_relaxed), Snapshot.Max) : 0;
+	return Snapshot;
+}
+
+std::size_t tLatencyHistogram::GetBucket(std::uint64_t value)
+{
+	if (value < 2 * SubBucketQty)
+		return static_cast<std::size_t>(value);
+
+	const std::size_t Shift = static_cast<std::size_t>(std::bit_width(value)) - (SubBucketBits + 1);
+	const std::size_t Bucket = (Shift + 1) * SubBucketQty + static_cast<std::size_t>(value >> Shift) - SubBucketQty;
+	return std::min(Bucket, BucketQty - 1);
+}
+
+std::uint64_t tLatencyHistogram::GetBucketValueMax(std::size_t bucket)
+{
+	if (bucket < 2 * SubBucketQty)
+		return bucket;
+
+	const std::size_t Shift = bucket / SubBucketQty - 1;
+	const std::uint64_t SubBucket = bucket % SubBucketQty + SubBucketQty;
+	return ((SubBucket + 1) << Shift) - 1;
+}
+
+}
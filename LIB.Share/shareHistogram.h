@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareHistogram
+// 2026-10-18
+// C++20
+//
+// Latency histogram [us] (HDR-like): the values below 2 * 2^LIB_SHARE_HISTOGRAM_SUB_BUCKET_BITS have their own buckets,
+// above that every power of two is split into 2^LIB_SHARE_HISTOGRAM_SUB_BUCKET_BITS buckets (1.6% for 6 bits).
+// Recording is lock-free (relaxed counters), it can be done by many tasks; a snapshot is taken for the percentiles.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#ifndef LIB_SHARE_HISTOGRAM_SUB_BUCKET_BITS
+#define LIB_SHARE_HISTOGRAM_SUB_BUCKET_BITS 6
+#endif
+
+#ifndef LIB_SHARE_HISTOGRAM_VALUE_BITS
+#define LIB_SHARE_HISTOGRAM_VALUE_BITS 36 // [us] ~19 hours, the values above are counted in the last bucket
+#endif
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <utilsChrono.h>
+
+namespace share
+{
+
+struct tHistogramSnapshot
+{
+	std::vector<std::uint64_t> Counts; // the buckets
+	std::uint64_t Count = 0;
+	std::uint64_t Sum = 0;
+	std::uint64_t Min = 0;
+	std::uint64_t Max = 0;
+
+	std::uint64_t GetPercentile(double percentile) const; // the highest value of the bucket (it's not greater than Max)
+	double GetMean() const { return Count ? static_cast<double>(Sum) / Count : 0; }
+
+	std::string ToString() const; // "n=100 p50=120 p99=340 p999=800 max=1020 us"
+};
+
+class tLatencyHistogram
+{
+public:
+	static constexpr std::size_t SubBucketBits = LIB_SHARE_HISTOGRAM_SUB_BUCKET_BITS;
+	static constexpr std::size_t SubBucketQty = std::size_t(1) << SubBucketBits;
+	static constexpr std::size_t BucketQty = (LIB_SHARE_HISTOGRAM_VALUE_BITS - SubBucketBits + 1) * SubBucketQty;
+
+private:
+	std::array<std::atomic<std::uint64_t>, BucketQty> m_Counts{};
+	std::atomic<std::uint64_t> m_Count = 0;
+	std::atomic<std::uint64_t> m_Sum = 0;
+	std::atomic<std::uint64_t> m_Min = UINT64_MAX;
+	std::atomic<std::uint64_t> m_Max = 0;
+
+public:
+	void Record(std::uint64_t value); // [us]
+	void Record(utils::chrono::ttime_us value) { Record(value.count() > 0 ? static_cast<std::uint64_t>(value.count()) : 0); }
+
+	tHistogramSnapshot GetSnapshot() const;
+
+	static std::size_t GetBucket(std::uint64_t value);
+	static std::uint64_t GetBucketValueMax(std::size_t bucket);
+};
+
+}
@@ -1,3 +1,405 @@
 #include "shareLog.h"
+#include "shareMetrics.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <initializer_list>
+#include <optional>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#ifndef LIB_SHARE_LOG_SAMPLER_KEYS_MAX
+#define LIB_SHARE_LOG_SAMPLER_KEYS_MAX 1024
+#endif
 
 share::tLogger g_Log;
+
+namespace share
+{
+namespace hidden
+{
+
+constexpr std::array<tLogLevel, 6> LogCategoryLevel // tLogCategory
+{
+	tLogLevel::Error, // Exception
+	tLogLevel::Info, // Operation
+	tLogLevel::Info, // Publish
+	tLogLevel::Debug, // Measure
+	tLogLevel::Debug, // Packet
+	tLogLevel::Trace, // Trace
+};
+
+constexpr std::array<std::string_view, 4> LogLevelName{ "error", "info", "debug", "trace" }; // tLogLevel
+constexpr std::array<std::string_view, 6> LogCategoryName{ "exception", "operation", "publish", "measure", "packet", "trace" }; // tLogCategory
+
+template<std::size_t N>
+std::optional<std::size_t> Find(const std::array<std::string_view, N>& names, std::string_view name)
+{
+	for (std::size_t i = 0; i < names.size(); ++i)
+	{
+		if (names[i] == name)
+			return i;
+	}
+	return {};
+}
+
+constexpr char LogSamplerKeyOther[] = "*"; // the keys above LIB_SHARE_LOG_SAMPLER_KEYS_MAX
+
+constexpr std::array<std::string_view, 16> LogPacketKeySent // 2.2.1 MQTT Control Packet type
+{
+	"SND Reserved", "SND CONNECT", "SND CONNACK", "SND PUBLISH", "SND PUBACK", "SND PUBREC", "SND PUBREL", "SND PUBCOMP",
+	"SND SUBSCRIBE", "SND SUBACK", "SND UNSUBSCRIBE", "SND UNSUBACK", "SND PINGREQ", "SND PINGRESP", "SND DISCONNECT", "SND Reserved",
+};
+
+constexpr std::array<std::string_view, 16> LogPacketKeyReceived
+{
+	"RCV Reserved", "RCV CONNECT", "RCV CONNACK", "RCV PUBLISH", "RCV PUBACK", "RCV PUBREC", "RCV PUBREL", "RCV PUBCOMP",
+	"RCV SUBSCRIBE", "RCV SUBACK", "RCV UNSUBSCRIBE", "RCV UNSUBACK", "RCV PINGREQ", "RCV PINGRESP", "RCV DISCONNECT", "RCV Reserved",
+};
+
+double GetBurst(const tLogSamplingSettings& settings)
+{
+	return std::max(settings.Burst > 0 ? settings.Burst : settings.Rate, 1.0);
+}
+
+std::string_view GetPacketKey(bool sent, const std::vector<std::uint8_t>& data)
+{
+	const std::size_t Type = data.empty() ? 0 : data[0] >> 4;
+	return sent ? LogPacketKeySent[Type] : LogPacketKeyReceived[Type];
+}
+
+void tLogSampler::SetSettings(const tLogSamplingSettings& settings, tSuppressed& suppressed)
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	Summarize(utils::chrono::tClock::now(), true, suppressed); // the counts are lost with the keys
+	m_Settings = settings;
+	if (m_Settings.SampleEvery == 0)
+		m_Settings.SampleEvery = 1;
+	m_Keys.clear();
+	m_Active = m_Settings.SampleEvery > 1 || m_Settings.Rate > 0;
+}
+
+tLogSamplingSettings tLogSampler::GetSettings()
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	return m_Settings;
+}
+
+bool tLogSampler::Allow(std::string_view key, tSuppressed& suppressed)
+{
+	if (!m_Active.load(std::memory_order_relaxed))
+		return true;
+
+	const utils::chrono::tTimePoint TimeNow = utils::chrono::tClock::now();
+
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	Summarize(TimeNow, false, suppressed);
+
+	auto KeyIt = m_Keys.find(key);
+	if (KeyIt == m_Keys.end())
+	{
+		if (m_Keys.size() >= LIB_SHARE_LOG_SAMPLER_KEYS_MAX)
+			key = LogSamplerKeyOther;
+		KeyIt = m_Keys.find(key);
+		if (KeyIt == m_Keys.end())
+		{
+			tKey State;
+			State.Tokens = GetBurst(m_Settings);
+			State.TimeRefill = TimeNow;
+			KeyIt = m_Keys.emplace(std::string(key), State).first;
+		}
+	}
+
+	tKey& State = KeyIt->second;
+	if (State.Qty++ % m_Settings.SampleEvery != 0)
+	{
+		++State.SuppressedQty;
+		m_SuppressedQty.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	if (m_Settings.Rate > 0)
+	{
+		const double Elapsed = std::chrono::duration<double>(TimeNow - State.TimeRefill).count();
+		State.Tokens = std::min(GetBurst(m_Settings), State.Tokens + Elapsed * m_Settings.Rate);
+		State.TimeRefill = TimeNow;
+		if (State.Tokens < 1)
+		{
+			++State.SuppressedQty;
+			m_SuppressedQty.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		State.Tokens -= 1;
+	}
+
+	return true;
+}
+
+void tLogSampler::Summarize(tSuppressed& suppressed)
+{
+	if (!m_Active.load(std::memory_order_relaxed))
+		return;
+
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	Summarize(utils::chrono::tClock::now(), false, suppressed);
+}
+
+void tLogSampler::Summarize(utils::chrono::tTimePoint timeNow, bool force, tSuppressed& suppressed)
+{
+	if (!force && timeNow - m_TimeSummary < m_Settings.SummaryPeriod)
+		return;
+
+	m_TimeSummary = timeNow;
+	for (auto& [Key, State] : m_Keys)
+	{
+		if (State.SuppressedQty > 0)
+			suppressed.emplace_back(Key, std::exchange(State.SuppressedQty, 0));
+	}
+}
+
+std::vector<std::string_view> Split(std::string_view str, std::string_view delimiters)
+{
+	std::vector<std::string_view> Items;
+	while (!str.empty())
+	{
+		const std::size_t Pos = str.find_first_of(delimiters);
+		if (Pos != 0)
+			Items.push_back(str.substr(0, Pos));
+		if (Pos == std::string_view::npos)
+			break;
+		str.remove_prefix(Pos + 1);
+	}
+	return Items;
+}
+
+}
+
+void tLogger::SetLevel(tLogLevel level)
+{
+	m_Level = level;
+	UpdateEnabled();
+}
+
+void tLogger::SetCategories(std::uint32_t categories)
+{
+	m_Categories = categories & m_CategoriesAll;
+	UpdateEnabled();
+}
+
+void tLogger::SetCategory(tLogCategory category, bool enabled)
+{
+	const std::uint32_t Mask = 1u << static_cast<std::uint32_t>(category);
+	if (enabled)
+		m_Categories |= Mask;
+	else
+		m_Categories &= ~Mask;
+	UpdateEnabled();
+}
+
+bool tLogger::Configure(std::string_view config)
+{
+	bool Result = true;
+	for (std::string_view Item : hidden::Split(config, " \t\r\n;"))
+	{
+		const std::size_t Pos = Item.find('=');
+		if (Pos == std::string_view::npos)
+		{
+			Result = false;
+			continue;
+		}
+		const std::string_view Key = Item.substr(0, Pos);
+		const std::string_view Value = Item.substr(Pos + 1);
+		if (Key == "level")
+		{
+			if (auto Level = hidden::Find(hidden::LogLevelName, Value))
+			{
+				SetLevel(static_cast<tLogLevel>(*Level));
+				continue;
+			}
+		}
+		else if (Key == "publish_sample" || Key == "publish_rate" || Key == "packet_sample" || Key == "packet_rate")
+		{
+			const tLogCategory Category = Key.starts_with("publish") ? tLogCategory::Publish : tLogCategory::Packet;
+			hidden::tLogSampler& Sampler = Category == tLogCategory::Publish ? m_SamplerPublish : m_SamplerPacket;
+			tLogSamplingSettings Settings = Sampler.GetSettings();
+			try
+			{
+				if (Key.ends_with("sample"))
+					Settings.SampleEvery = static_cast<unsigned int>(std::stoul(std::string(Value)));
+				else
+					Settings.Rate = std::stod(std::string(Value));
+				SetSampling(Sampler, Settings);
+				continue;
+			}
+			catch (...)
+			{
+			}
+		}
+		else if (Key == "categories")
+		{
+			std::uint32_t Categories = 0;
+			bool Known = true;
+			for (std::string_view Name : hidden::Split(Value, ","))
+			{
+				if (Name == "all")
+				{
+					Categories = m_CategoriesAll;
+				}
+				else if (auto Category = hidden::Find(hidden::LogCategoryName, Name))
+				{
+					Categories |= 1u << *Category;
+				}
+				else
+				{
+					Known = false;
+				}
+			}
+			SetCategories(Categories); // "categories=" disables all of them
+			if (Known)
+				continue;
+		}
+		Result = false;
+	}
+	return Result;
+}
+
+void tLogger::SetSampling(tLogCategory category, const tLogSamplingSettings& settings)
+{
+	switch (category)
+	{
+	case tLogCategory::Publish: SetSampling(m_SamplerPublish, settings); break;
+	case tLogCategory::Packet: SetSampling(m_SamplerPacket, settings); break;
+	default: break;
+	}
+}
+
+void tLogger::SetFile(std::unique_ptr<tLogFile> file)
+{
+	const bool FileSet = file != nullptr;
+	std::unique_ptr<tLogFile> FilePrev;
+	{
+		std::lock_guard<std::mutex> Lock(m_FileMtx);
+		FilePrev = std::exchange(m_File, std::move(file));
+	}
+	if (FileSet)
+		StartHousekeeping();
+}
+
+void tLogger::RegisterMetrics(tMetrics& metrics)
+{
+	metrics.SetCallback("log_suppressed_total", "Log messages suppressed by sampling and rate limiting.", "category=\"publish\"", tMetricType::Counter,
+		[this]() { return static_cast<double>(m_SamplerPublish.GetSuppressedQty()); });
+	metrics.SetCallback("log_suppressed_total", "Log messages suppressed by sampling and rate limiting.", "category=\"packet\"", tMetricType::Counter,
+		[this]() { return static_cast<double>(m_SamplerPacket.GetSuppressedQty()); });
+#ifdef LIB_UTILS_LOG_ASYNC
+	metrics.SetCallback("log_dropped_total", "Log records dropped, the ring of a task was full.", {}, tMetricType::Counter,
+		[this]() { return static_cast<double>(GetDroppedQty()); });
+#endif // LIB_UTILS_LOG_ASYNC
+}
+
+void tLogger::FlushFile()
+{
+	{
+		std::lock_guard<std::mutex> Lock(m_FileMtx);
+		if (!m_File)
+			return;
+	}
+
+#ifdef LIB_UTILS_LOG_ASYNC
+	Flush(); // the records are written to the file by the task of the log
+#endif // LIB_UTILS_LOG_ASYNC
+
+	std::lock_guard<std::mutex> Lock(m_FileMtx);
+	if (m_File)
+		m_File->Flush();
+}
+
+bool tLogger::LoadConfig(const std::string& path)
+{
+	std::ifstream File(path);
+	if (!File.is_open())
+		return false;
+
+	std::stringstream Stream;
+	Stream << File.rdbuf();
+	return Configure(Stream.str());
+}
+
+bool tLogger::Sample(hidden::tLogSampler& sampler, std::string_view key)
+{
+	hidden::tLogSampler::tSuppressed Suppressed;
+	const bool Allowed = sampler.Allow(key, Suppressed);
+	WriteSuppressed(sampler, Suppressed);
+	return Allowed;
+}
+
+void tLogger::SetSampling(hidden::tLogSampler& sampler, const tLogSamplingSettings& settings)
+{
+	hidden::tLogSampler::tSuppressed Suppressed;
+	sampler.SetSettings(settings, Suppressed);
+	WriteSuppressed(sampler, Suppressed);
+	if (settings.SampleEvery > 1 || settings.Rate > 0)
+		StartHousekeeping();
+}
+
+void tLogger::WriteSuppressed(const hidden::tLogSampler& sampler, const hidden::tLogSampler::tSuppressed& suppressed)
+{
+	for (const auto& [Key, Qty] : suppressed)
+		WriteLine(true, "suppressed " + std::to_string(Qty) + " " + std::string(sampler.GetWhat()) + " " + Key, utils::log::tColor::LightGray);
+}
+
+void tLogger::StartHousekeeping()
+{
+	std::lock_guard<std::mutex> Lock(m_HousekeepingMtx);
+	if (m_Housekeeping.joinable() || m_HousekeepingStop)
+		return;
+	m_Housekeeping = std::thread(&tLogger::TaskHousekeeping, this);
+}
+
+void tLogger::StopHousekeeping()
+{
+	{
+		std::lock_guard<std::mutex> Lock(m_HousekeepingMtx);
+		m_HousekeepingStop = true;
+	}
+	m_HousekeepingCv.notify_all();
+	if (m_Housekeeping.joinable())
+		m_Housekeeping.join();
+}
+
+void tLogger::TaskHousekeeping()
+{
+	std::unique_lock<std::mutex> Lock(m_HousekeepingMtx);
+	while (!m_HousekeepingCv.wait_for(Lock, std::chrono::milliseconds(LIB_SHARE_LOG_HOUSEKEEPING_PERIOD), [this]() { return m_HousekeepingStop; }))
+	{
+		Lock.unlock();
+		for (hidden::tLogSampler* Sampler : { &m_SamplerPublish, &m_SamplerPacket })
+		{
+			hidden::tLogSampler::tSuppressed Suppressed;
+			Sampler->Summarize(Suppressed);
+			WriteSuppressed(*Sampler, Suppressed);
+		}
+		{
+			std::lock_guard<std::mutex> LockFile(m_FileMtx);
+			if (m_File)
+				m_File->WriteExpired();
+		}
+		Lock.lock();
+	}
+}
+
+void tLogger::UpdateEnabled()
+{
+	const tLogLevel Level = m_Level;
+	std::uint32_t Enabled = 0;
+	for (std::size_t i = 0; i < hidden::LogCategoryLevel.size(); ++i)
+	{
+		if (hidden::LogCategoryLevel[i] <= Level)
+			Enabled |= 1u << i;
+	}
+	m_Enabled.store(Enabled & m_Categories, std::memory_order_relaxed);
+}
+
+}
@@ -2,70 +2,251 @@
 
 #include <libConfig.h>
 
+#ifndef LIB_SHARE_LOG_HOUSEKEEPING_PERIOD
+#define LIB_SHARE_LOG_HOUSEKEEPING_PERIOD 250 // [ms] the summaries of the suppressed messages and the buffer of the file are checked
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <utilsChrono.h>
 #include <utilsLog.h>
 
+#include <shareLogFile.h>
+#include <shareTrace.h>
+
 namespace share
 {
 
+class tMetrics;
+
+enum class tLogLevel : std::uint8_t
+{
+	Error,
+	Info,
+	Debug,
+	Trace,
+};
+
+enum class tLogCategory : std::uint8_t
+{
+	Exception,	// Error
+	Operation,	// Info
+	Publish,	// Info
+	Measure,	// Debug
+	Packet,		// Debug
+	Trace,		// Trace
+};
+
+struct tLogSamplingSettings
+{
+	unsigned int SampleEvery = 1; // 1-in-N messages of a topic (a packet type) are logged
+	double Rate = 0; // [message/s] of a topic (a packet type), token bucket; 0 - not limited
+	double Burst = 0; // the size of the bucket; 0 - Rate (at least 1)
+	std::chrono::seconds SummaryPeriod{ 10 }; // "suppressed N messages" are logged instead of the dropped ones
+};
+
+namespace hidden
+{
+
+class tLogSampler
+{
+	struct tKey
+	{
+		std::uint64_t Qty = 0;
+		double Tokens = 0;
+		utils::chrono::tTimePoint TimeRefill{};
+		std::uint64_t SuppressedQty = 0;
+	};
+
+	const std::string_view m_What; // "suppressed N <what> <key>"
+	std::atomic<bool> m_Active = false; // there is no locking if the messages are not limited
+	std::mutex m_Mtx;
+	tLogSamplingSettings m_Settings;
+	std::map<std::string, tKey, std::less<>> m_Keys;
+	utils::chrono::tTimePoint m_TimeSummary{};
+	std::atomic<std::uint64_t> m_SuppressedQty = 0; // all the time
+
+public:
+	using tSuppressed = std::vector<std::pair<std::string, std::uint64_t>>;
+
+	explicit tLogSampler(std::string_view what) :m_What(what) {}
+
+	void SetSettings(const tLogSamplingSettings& settings, tSuppressed& suppressed); // suppressed - the counts which have not been summarized, the keys are reset
+	tLogSamplingSettings GetSettings();
+
+	bool Allow(std::string_view key, tSuppressed& suppressed); // suppressed - the keys for the summary, when its period has passed
+	void Summarize(tSuppressed& suppressed); // it's called periodically, so the summary is made when the messages have stopped as well
+
+	std::string_view GetWhat() const { return m_What; }
+	std::uint64_t GetSuppressedQty() const { return m_SuppressedQty; }
+
+private:
+	void Summarize(utils::chrono::tTimePoint timeNow, bool force, tSuppressed& suppressed); // m_Mtx is locked
+};
+
+std::string_view GetPacketKey(bool sent, const std::vector<std::uint8_t>& data); // "SND PUBLISH"
+
+}
+
+// The category and the level are checked by one relaxed load, so the call site can check it before the message is built:
+// if (g_Log.IsEnabled(share::tLogCategory::Packet)) g_Log.PacketSent(packet.ToString(), data);
 class tLogger : public utils::log::tLog
 {
+	static constexpr std::uint32_t m_CategoriesAll = (1u << (static_cast<std::uint32_t>(tLogCategory::Trace) + 1)) - 1;
+
+	std::atomic<std::uint32_t> m_Enabled = m_CategoriesAll; // the categories allowed by the level
+	std::atomic<std::uint32_t> m_Categories = m_CategoriesAll;
+	std::atomic<tLogLevel> m_Level = tLogLevel::Trace;
+
+	std::unique_ptr<tLogFile> m_File;
+	std::mutex m_FileMtx;
+
+	hidden::tLogSampler m_SamplerPublish{ "messages on topic" }; // Topic Name
+	hidden::tLogSampler m_SamplerPacket{ "packets" }; // direction and Control Packet type
+
+	std::thread m_Housekeeping; // the summaries of the suppressed messages, the buffer of the file; it's started when it's needed
+	std::mutex m_HousekeepingMtx;
+	std::condition_variable m_HousekeepingCv;
+	bool m_HousekeepingStop = false;
+
 public:
 	tLogger() = default;
+	~tLogger() override
+	{
+		StopHousekeeping();
+#ifdef LIB_UTILS_LOG_ASYNC
+		StopAsync();
+#endif // LIB_UTILS_LOG_ASYNC
+	}
+
+	bool IsEnabled(tLogCategory category) const
+	{
+#ifdef LIB_UTILS_LOG
+		return m_Enabled.load(std::memory_order_relaxed) & (1u << static_cast<std::uint32_t>(category));
+#else // LIB_UTILS_LOG
+		return false;
+#endif // LIB_UTILS_LOG
+	}
+
+	void SetLevel(tLogLevel level);
+	void SetCategories(std::uint32_t categories); // the bits of tLogCategory
+	void SetCategory(tLogCategory category, bool enabled);
+	tLogLevel GetLevel() const { return m_Level; }
+	std::uint32_t GetCategories() const { return m_Categories; }
+
+	void SetSampling(tLogCategory category, const tLogSamplingSettings& settings); // Publish, Packet (PacketSent, PacketReceivedRaw)
+
+	// "level=info categories=operation,exception,publish" (the delimiters are spaces, tabs, ';' or new lines)
+	// "publish_sample=10 publish_rate=100 packet_sample=1 packet_rate=50" - see tLogSamplingSettings
+	bool Configure(std::string_view config); // returns false if there is an unknown keyword, the known ones are applied
+	bool LoadConfig(const std::string& path); // the file contains the configuration as above
+
+	void SetFile(std::unique_ptr<tLogFile> file); // nullptr - the log is not written to a file
+
+	void RegisterMetrics(tMetrics& metrics); // the messages suppressed and dropped, they are read when the metrics are exported
+	void FlushFile(); // the records written before the call are written to the file
 
 	void PacketSent(const std::string& msg, const std::vector<std::uint8_t>& data)
 	{
+		if (!IsEnabled(tLogCategory::Packet) || !Sample(m_SamplerPacket, hidden::GetPacketKey(true, data)))
+			return;
+		tTraceSpan Span("log", "PacketSent");
 		WriteLine(true, msg, utils::log::tColor::LightBlue);
 		WriteHex(true, "SND", data, utils::log::tColor::Blue);
 	}
 
 	void PacketReceivedRaw(const std::vector<std::uint8_t>& data)
 	{
+		if (!IsEnabled(tLogCategory::Packet) || !Sample(m_SamplerPacket, hidden::GetPacketKey(false, data)))
+			return;
+		tTraceSpan Span("log", "PacketReceivedRaw");
 		WriteHex(true, "RCV", data, utils::log::tColor::Green);
 	}
 
 	void PacketReceived(const std::string& msg)
 	{
+		if (!IsEnabled(tLogCategory::Packet))
+			return;
 		WriteLine(true, msg, utils::log::tColor::LightGreen);
 	}
 
 	void MeasureDuration(const std::string& msg)
 	{
+		if (!IsEnabled(tLogCategory::Measure))
+			return;
 		WriteLine(true, msg, utils::log::tColor::LightYellow);
 	}
 
 	void PublishMessage(const std::string& topicName, const std::vector<std::uint8_t>& payload)
 	{
+		if (!IsEnabled(tLogCategory::Publish) || !Sample(m_SamplerPublish, topicName))
+			return;
+		tTraceSpan Span("log", "PublishMessage");
 		WriteHex(true, topicName, payload, utils::log::tColor::LightMagenta);
 	}
 
 	void Operation(const std::string& msg)
 	{
+		if (!IsEnabled(tLogCategory::Operation))
+			return;
 		WriteLine(true, msg, utils::log::tColor::Yellow);
 	}
 
 	void Exception(const std::string& msg)
 	{
+		if (!IsEnabled(tLogCategory::Exception))
+			return;
 		WriteLine(true, msg, utils::log::tColor::Red);
+		FlushFile(); // an error is not kept in the buffer
 	}
 
 	void Trace(const std::string& msg)
 	{
+		if (!IsEnabled(tLogCategory::Trace))
+			return;
 		WriteLine(true, msg, utils::log::tColor::LightCyan);
 	}
 
 	void TestMessage(const std::string& msg)
 	{
+		if (!IsEnabled(tLogCategory::Operation))
+			return;
 		WriteLine(true, msg, utils::log::tColor::White);
 	}
 
+private:
+	void UpdateEnabled();
+	bool Sample(hidden::tLogSampler& sampler, std::string_view key); // the summary of suppressed messages is logged here
+	void SetSampling(hidden::tLogSampler& sampler, const tLogSamplingSettings& settings);
+	void WriteSuppressed(const hidden::tLogSampler& sampler, const hidden::tLogSampler::tSuppressed& suppressed);
+
+	void StartHousekeeping();
+	void StopHousekeeping();
+	void TaskHousekeeping();
+
 protected:
 	void WriteLog(const std::string& msg) override final
 	{
 		std::cout << msg;
 	}
+
+	void WriteLogFile(const std::string& msg) override final
+	{
+		std::lock_guard<std::mutex> Lock(m_FileMtx);
+		if (m_File)
+			m_File->Write(msg);
+	}
 };
 
 }
@@ -78,17 +259,22 @@ namespace share
 class tMeasureDuration : public utils::chrono::tTimeDuration
 {
 	std::string m_Label;
+	tTraceSpan m_Span{ "measure", "MeasureDuration" };
 
 public:
 	explicit tMeasureDuration(const std::string& label)
 		:utils::chrono::tTimeDuration(), m_Label(label)
 	{
+		m_Span.AddArg("label", m_Label);
 		if (!m_Label.empty())
 			m_Label += ": ";
 	}
 
 	~tMeasureDuration()
 	{
+		if (!g_Log.IsEnabled(tLogCategory::Measure))
+			return;
+
 		const std::string Msg = m_Label + std::to_string(Get<utils::chrono::ttime_ms>()) + " ms";
 
 		g_Log.MeasureDuration(Msg);
@@ -0,0 +1,172 @@
+#include "shareLogFile.h"
+
+#include <utilsException.h>
+
+#include <filesystem>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else // _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace share
+{
+namespace hidden
+{
+
+constexpr char StrExceptionLogFileOpen[] = "The log file has not been opened.";
+
+}
+
+tLogFile::tLogFile(const tLogFileSettings& settings)
+	:m_Settings(settings)
+{
+	m_Buffer.reserve(m_Settings.BufferSize);
+	Open();
+	if (m_File < 0)
+		THROW_RUNTIME_ERROR(hidden::StrExceptionLogFileOpen);
+}
+
+tLogFile::~tLogFile()
+{
+	Flush();
+	Close();
+}
+
+void tLogFile::Write(std::string_view text)
+{
+	const utils::chrono::tTimePoint TimeNow = utils::chrono::tClock::now();
+
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	if (!m_Buffer.empty() && m_Buffer.size() + text.size() > m_Settings.BufferSize)
+		WriteFile();
+
+	if (m_Buffer.empty())
+		m_TimeBuffered = TimeNow;
+	m_Buffer.append(text);
+
+	if (m_Buffer.size() >= m_Settings.BufferSize || TimeNow - m_TimeBuffered >= m_Settings.FlushPeriod)
+		WriteFile();
+}
+
+void tLogFile::WriteExpired()
+{
+	const utils::chrono::tTimePoint TimeNow = utils::chrono::tClock::now();
+
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	if (!m_Buffer.empty() && TimeNow - m_TimeBuffered >= m_Settings.FlushPeriod)
+		WriteFile();
+}
+
+void tLogFile::Flush()
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	WriteFile();
+	SyncFile();
+}
+
+void tLogFile::Open()
+{
+#ifdef _WIN32
+	m_File = _open(m_Settings.Path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else // _WIN32
+	m_File = open(m_Settings.Path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif // _WIN32
+
+	std::error_code Error;
+	const auto Size = std::filesystem::file_size(m_Settings.Path, Error);
+	m_FileSize = Error ? 0 : static_cast<std::uint64_t>(Size);
+	m_TimeOpened = utils::chrono::tClock::now();
+	m_TimeSynced = m_TimeOpened;
+}
+
+void tLogFile::Close()
+{
+	if (m_File < 0)
+		return;
+#ifdef _WIN32
+	_close(m_File);
+#else // _WIN32
+	close(m_File);
+#endif // _WIN32
+	m_File = -1;
+}
+
+void tLogFile::Rotate()
+{
+	SyncFile();
+	Close();
+
+	std::error_code Error; // the log is not stopped because of a file which can't be renamed
+	if (m_Settings.RotationQty == 0)
+	{
+		std::filesystem::remove(m_Settings.Path, Error);
+	}
+	else
+	{
+		const std::string& Path = m_Settings.Path;
+		std::filesystem::remove(Path + "." + std::to_string(m_Settings.RotationQty), Error);
+		for (unsigned int i = m_Settings.RotationQty - 1; i > 0; --i)
+			std::filesystem::rename(Path + "." + std::to_string(i), Path + "." + std::to_string(i + 1), Error);
+		std::filesystem::rename(Path, Path + ".1", Error);
+	}
+
+	Open();
+}
+
+void tLogFile::WriteFile()
+{
+	if (m_Buffer.empty())
+		return;
+
+	const utils::chrono::tTimePoint TimeNow = utils::chrono::tClock::now();
+	if ((m_Settings.RotationSize > 0 && m_FileSize > 0 && m_FileSize + m_Buffer.size() > m_Settings.RotationSize) ||
+		(m_Settings.RotationPeriod.count() > 0 && TimeNow - m_TimeOpened >= m_Settings.RotationPeriod))
+		Rotate();
+
+	if (m_File >= 0)
+	{
+		const char* Data = m_Buffer.data();
+		std::size_t Size = m_Buffer.size();
+		while (Size > 0)
+		{
+#ifdef _WIN32
+			const int Written = _write(m_File, Data, static_cast<unsigned int>(Size));
+#else // _WIN32
+			const ssize_t Written = write(m_File, Data, Size);
+			if (Written < 0 && errno == EINTR)
+				continue;
+#endif // _WIN32
+			if (Written <= 0)
+				break; // the lines are lost, the log must not throw
+			Data += Written;
+			Size -= static_cast<std::size_t>(Written);
+		}
+		m_FileSize += m_Buffer.size() - Size;
+
+		if (m_Settings.Sync == tLogFileSync::Write || (m_Settings.Sync == tLogFileSync::Period && TimeNow - m_TimeSynced >= m_Settings.SyncPeriod))
+			SyncFile();
+	}
+
+	m_Buffer.clear();
+}
+
+void tLogFile::SyncFile()
+{
+	if (m_File < 0 || m_Settings.Sync == tLogFileSync::None)
+		return;
+#ifdef _WIN32
+	_commit(m_File);
+#else // _WIN32
+	fsync(m_File);
+#endif // _WIN32
+	m_TimeSynced = utils::chrono::tClock::now();
+}
+
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareLogFile
+// 2026-10-18
+// C++20
+//
+// File of the log: the lines are collected in a buffer which is written to the file (O_APPEND) by one write(2)
+// when it is full, so a hex dump of many lines costs one system call.
+// The file is rotated by its size or by its age: log.txt -> log.txt.1 -> ... -> log.txt.<RotationQty>.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <utilsChrono.h>
+
+namespace share
+{
+
+enum class tLogFileSync : std::uint8_t
+{
+	None, // the data is left to the OS
+	Write, // fsync after every write of the buffer
+	Period, // fsync after a write of the buffer if SyncPeriod has passed since the last one
+};
+
+struct tLogFileSettings
+{
+	std::string Path;
+	std::size_t BufferSize = 64 * 1024;
+	std::chrono::milliseconds FlushPeriod{ 1000 }; // the buffer is written after the period even if it is not full (WriteExpired)
+	std::uint64_t RotationSize = 0; // [byte], 0 - no rotation by size
+	std::chrono::seconds RotationPeriod{ 0 }; // 0 - no rotation by time
+	unsigned int RotationQty = 5; // the rotated files which are kept
+	tLogFileSync Sync = tLogFileSync::None;
+	std::chrono::milliseconds SyncPeriod{ 1000 };
+};
+
+class tLogFile
+{
+	const tLogFileSettings m_Settings;
+	int m_File = -1;
+	std::uint64_t m_FileSize = 0;
+	utils::chrono::tTimePoint m_TimeOpened{};
+	utils::chrono::tTimePoint m_TimeBuffered{}; // the first line in the buffer
+	utils::chrono::tTimePoint m_TimeSynced{};
+	std::string m_Buffer;
+	std::mutex m_Mtx;
+
+public:
+	tLogFile() = delete;
+	explicit tLogFile(const tLogFileSettings& settings);
+	tLogFile(const tLogFile&) = delete;
+	tLogFile(tLogFile&&) = delete;
+	~tLogFile();
+
+	tLogFile& operator=(const tLogFile&) = delete;
+	tLogFile& operator=(tLogFile&&) = delete;
+
+	void Write(std::string_view text); // thread safe
+	void WriteExpired(); // the buffer is written if FlushPeriod has passed since its first line, it's called periodically
+	void Flush(); // the buffer is written and the file is synchronized
+
+private:
+	void Open();
+	void Close();
+	void Rotate();
+	void WriteFile(); // m_Mtx is locked
+	void SyncFile();
+};
+
+}
@@ -9,26 +9,180 @@
 #define LIB_SHARE_MQTT_PACKET_ID_START 0
 #endif
 
+share::tTopicTable g_Topics;
+
 namespace share
 {
+namespace hidden
+{
 
-tConnection::tConnection(std::string_view host, std::string_view service, std::uint16_t keepAlive)
-	:m_KeepConnection(false), m_KeepAlive(keepAlive), m_PacketId(LIB_SHARE_MQTT_PACKET_ID_START)
+constexpr std::size_t TopicTableSlotsInitial = 64; // a power of 2
+
+tConnectionMetrics& GetConnectionMetrics()
+{
+	static tConnectionMetrics Metrics = []()
+		{
+			tConnectionMetrics Metrics
+			{
+				g_Metrics.GetGauge("mqtt_connections", "Connections to the servers."),
+				g_Metrics.GetCounter("mqtt_connects_total", "CONNECT sent, the reconnections included."),
+				g_Metrics.GetCounter("mqtt_connections_broken_total", "Connections closed while they were kept."),
+				g_Metrics.GetCounter("mqtt_bytes_sent_total", "Bytes sent to the servers."),
+				g_Metrics.GetCounter("mqtt_bytes_received_total", "Bytes received from the servers."),
+				{},
+				{},
+				g_Metrics.GetCounter("mqtt_parse_errors_total", "Received packets which have not been parsed."),
+				g_Metrics.GetCounter("mqtt_incoming_dropped_total", "Oldest PUBLISH dropped, the queue of incoming messages is full."),
+				g_Metrics.GetCounter("mqtt_topics_overflow_total", "PUBLISH without TopicId, the table of Topic Names is full."),
+				g_Metrics.GetCounter("mqtt_responses_dropped_total", "Responses which have not been taken by a transaction."),
+				g_Metrics.GetCounter("mqtt_keepalive_pings_total", "PINGREQ sent to keep the connection alive."),
+				g_Metrics.GetCounter("mqtt_keepalive_timeouts_total", "Connections closed, PINGRESP has not been received."),
+			};
+			for (std::size_t i = 0; i < Metrics.PacketsSent.size(); ++i)
+			{
+				const std::string Type = i == 0 || i == 15 ? "Reserved" : mqtt::ToString(static_cast<mqtt::tControlPacketType>(i));
+				Metrics.PacketsSent[i] = &g_Metrics.GetCounter("mqtt_packets_sent_total", "Packets sent to the servers.", "type=\"" + Type + "\"");
+				Metrics.PacketsReceived[i] = &g_Metrics.GetCounter("mqtt_packets_received_total", "Packets received from the servers.", "type=\"" + Type + "\"");
+			}
+			return Metrics;
+		}();
+	return Metrics;
+}
+
+}
+
+tTopicTable::tTopicTable(std::size_t capacity)
+	:m_Slots(hidden::TopicTableSlotsInitial), m_Capacity(capacity)
+{
+}
+
+std::optional<std::pair<tTopicId, std::string_view>> tTopicTable::Intern(std::string_view topicName)
+{
+	const std::size_t Hash = std::hash<std::string_view>{}(topicName);
+	{
+		std::shared_lock Lock(m_Mtx);
+		if (std::optional<tTopicId> Id = Find(topicName, Hash))
+			return std::make_pair(*Id, std::string_view(m_Names[*Id]));
+	}
+
+	std::unique_lock Lock(m_Mtx);
+	if (std::optional<tTopicId> Id = Find(topicName, Hash)) // it has been added by another task
+		return std::make_pair(*Id, std::string_view(m_Names[*Id]));
+
+	if (m_Names.size() >= m_Capacity)
+		return {};
+
+	if ((m_Names.size() + 1) * 2 > m_Slots.size())
+	{
+		std::vector<tSlot> Slots(m_Slots.size() * 2);
+		std::swap(Slots, m_Slots);
+		for (const tSlot& Slot : Slots)
+		{
+			if (Slot.Id != IdNone)
+				Insert(Slot.Hash, Slot.Id);
+		}
+	}
+
+	const tTopicId Id = static_cast<tTopicId>(m_Names.size());
+	m_Names.emplace_back(topicName);
+	Insert(Hash, Id);
+	return std::make_pair(Id, std::string_view(m_Names.back()));
+}
+
+std::optional<tTopicId> tTopicTable::Find(std::string_view topicName) const
+{
+	const std::size_t Hash = std::hash<std::string_view>{}(topicName);
+	std::shared_lock Lock(m_Mtx);
+	return Find(topicName, Hash);
+}
+
+std::string_view tTopicTable::GetName(tTopicId id) const
+{
+	std::shared_lock Lock(m_Mtx);
+	return id < m_Names.size() ? std::string_view(m_Names[id]) : std::string_view();
+}
+
+std::size_t tTopicTable::size() const
+{
+	std::shared_lock Lock(m_Mtx);
+	return m_Names.size();
+}
+
+std::optional<tTopicId> tTopicTable::Find(std::string_view topicName, std::size_t hash) const
+{
+	const std::size_t Mask = m_Slots.size() - 1;
+	for (std::size_t i = hash & Mask; m_Slots[i].Id != IdNone; i = (i + 1) & Mask)
+	{
+		if (m_Slots[i].Hash == hash && m_Names[m_Slots[i].Id] == topicName)
+			return m_Slots[i].Id;
+	}
+	return {};
+}
+
+void tTopicTable::Insert(std::size_t hash, tTopicId id)
+{
+	const std::size_t Mask = m_Slots.size() - 1;
+	std::size_t i = hash & Mask;
+	while (m_Slots[i].Id != IdNone)
+		i = (i + 1) & Mask;
+	m_Slots[i] = { hash, id };
+}
+
+tPayload::tPayload(std::shared_ptr<const std::vector<std::uint8_t>> frame, std::size_t offset, std::size_t size)
+	:m_Frame(std::move(frame)), m_Offset(offset), m_Size(size)
+{
+	if (!m_Frame || m_Offset + m_Size > m_Frame->size())
+		THROW_RUNTIME_ERROR(hidden::StrExceptionPayloadOutOfFrame);
+}
+
+tPayload::tPayload(std::vector<std::uint8_t> data)
+	:m_Frame(std::make_shared<const std::vector<std::uint8_t>>(std::move(data)))
+{
+	m_Size = m_Frame->size();
+}
+
+std::string tConnectionLatency::ToString(tLatencyType type)
+{
+	switch (type)
+	{
+	case tLatencyType::CONNACK: return "CONNECT-CONNACK";
+	case tLatencyType::PUBACK: return "PUBLISH-PUBACK";
+	case tLatencyType::PUBCOMP: return "PUBLISH-PUBCOMP";
+	case tLatencyType::SUBACK: return "SUBSCRIBE-SUBACK";
+	case tLatencyType::PINGRESP: return "PINGREQ-PINGRESP";
+	}
+	return {};
+}
 
+tConnection::tConnection(const tTransportFactory& transportFactory, std::uint16_t keepAlive)
+	:m_ReceiveBuffer(LIB_SHARE_MQTT_CONNECTION_RECEIVE_BUFFER_SIZE), m_KeepAliveTimer(m_ioc), m_KeepConnection(false), m_KeepAlive(keepAlive), m_PacketIdPool(LIB_SHARE_MQTT_PACKET_ID_START)
 {
-	tcp::resolver Resolver(m_ioc);
-	tcp::resolver::results_type Ep = Resolver.resolve(host, service);
-	m_Socket = std::make_unique<tcp::socket>(m_ioc);
-	boost::asio::connect(*m_Socket, Ep);
+	m_Transport = transportFactory(m_ioc);
+	m_TimeSent = utils::chrono::tClock::now().time_since_epoch().count();
 	m_FutureReceiver = std::async(std::launch::async, [&]() { TaskReceiver(); });
-	m_KeepConnectionThread = std::thread(&tConnection::KeepConnectionAlive, this);
+	hidden::GetConnectionMetrics().Connections.Add(1);
 }
 
+tConnection::tConnection(std::string_view host, std::string_view service, std::uint16_t keepAlive)
+	:tConnection([host, service](boost::asio::io_context& ioc) { return std::make_unique<tTransportTCP>(ioc, host, service); }, keepAlive)
+{
+}
+
+#ifdef LIB_SHARE_MQTT_TLS
+tConnection::tConnection(std::shared_ptr<tContextTLS> contextTLS, std::string_view host, std::string_view service, std::uint16_t keepAlive)
+	:tConnection([contextTLS, host, service](boost::asio::io_context& ioc) { return std::make_unique<tTransportTLS>(ioc, contextTLS, host, service); }, keepAlive)
+{
+}
+#endif // LIB_SHARE_MQTT_TLS
+
 tConnection::~tConnection()
 {
-	m_Socket->close();
-	
-	m_KeepConnectionThread.join(); // It seems to be that must be before m_FutureReceiver.get(), because this thread calls m_FutureReceiver.wait_for(..).
+	boost::asio::post(m_ioc, [this]()
+		{
+			m_Transport->Close();
+			m_KeepAliveTimer.cancel();
+		});
+
 	try
 	{
 		m_FutureReceiver.get(); // The receiving operation shall be finished when the socket is closed.
@@ -37,12 +191,18 @@ tConnection::~tConnection()
 	{
 		g_Log.Exception(ex.what());
 	}
+
+	hidden::GetConnectionMetrics().Connections.Add(-1);
 }
 
 bool tConnection::Connect(mqtt::tSessionStateRequest sessionStateRequest, const std::string& clientId, mqtt::tQoS willQos, bool willRetain, const std::string& willTopic, const std::string& willMessage)
 {
 	mqtt::tPacketCONNECT Pack(sessionStateRequest, m_KeepAlive, clientId, willQos, willRetain, willTopic, willMessage);
+	hidden::GetConnectionMetrics().Connects.Add();
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
 	auto PackRsp = Transaction(Pack);
+	if (PackRsp.has_value())
+		RecordLatency(tLatencyType::CONNACK, TimeStart);
 	m_KeepConnection = true; // [TBD] It might be a good idea to check if no error occurred.
 	return PackRsp.has_value() && PackRsp->GetVariableHeader().ConnectAcknowledgeFlags.Field.SessionPresent;
 }
@@ -50,38 +210,55 @@ bool tConnection::Connect(mqtt::tSessionStateRequest sessionStateRequest, const
 bool tConnection::Connect(mqtt::tSessionStateRequest sessionStateRequest, const std::string& clientId)
 {
 	mqtt::tPacketCONNECT Pack(sessionStateRequest, m_KeepAlive, clientId);
+	hidden::GetConnectionMetrics().Connects.Add();
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
 	auto PackRsp = Transaction(Pack);
+	if (PackRsp.has_value())
+		RecordLatency(tLatencyType::CONNACK, TimeStart);
 	m_KeepConnection = true; // [TBD] It might be a good idea to check if no error occurred.
 	return PackRsp.has_value() && PackRsp->GetVariableHeader().ConnectAcknowledgeFlags.Field.SessionPresent;
 }
 
-void tConnection::Publish_AtMostOnceDelivery(bool retain, const std::string& topicName, const std::vector<std::uint8_t>& payload)
+void tConnection::Publish_AtMostOnceDelivery(bool retain, std::string_view topicName, std::span<const std::uint8_t> payload)
 {
-	Transaction(mqtt::tPacketPUBLISH<mqtt::tQoS::AtMostOnceDelivery>(retain, topicName, payload));
+	Transaction(mqtt::tPacketPUBLISH_View<mqtt::tQoS::AtMostOnceDelivery>(retain, topicName, payload));
 }
 
-void tConnection::Publish_AtMostOnceDelivery(bool retain, const std::string& topicName)
+void tConnection::Publish_AtMostOnceDelivery(bool retain, std::string_view topicName)
 {
-	Transaction(mqtt::tPacketPUBLISH<mqtt::tQoS::AtMostOnceDelivery>(retain, topicName));
+	Transaction(mqtt::tPacketPUBLISH_View<mqtt::tQoS::AtMostOnceDelivery>(retain, topicName, {}));
 }
 
-void tConnection::Publish_AtLeastOnceDelivery(bool retain, bool dup, const std::string& topicName, const std::vector<std::uint8_t>& payload)
+void tConnection::Publish_AtLeastOnceDelivery(bool retain, bool dup, std::string_view topicName, std::span<const std::uint8_t> payload)
 {
-	auto PackRsp = Transaction(mqtt::tPacketPUBLISH<mqtt::tQoS::AtLeastOnceDelivery>(retain, dup, topicName, ++m_PacketId, payload));
-	if (PackRsp.has_value())
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	hidden::tPacketIdLease PacketId = AllocatePacketId();
+	auto PackRsp = Transaction(mqtt::tPacketPUBLISH_View<mqtt::tQoS::AtLeastOnceDelivery>(retain, dup, topicName, PacketId.Get(), payload));
+	if (!PackRsp.has_value())
+		return;
+	PacketId.Dismiss(); // PUBACK
+	RecordLatency(tLatencyType::PUBACK, TimeStart);
+	if (g_Log.IsEnabled(tLogCategory::Operation))
 		g_Log.TestMessage("rsp puback: " + std::to_string((int)PackRsp->GetVariableHeader().PacketId.Value));
 }
 
-void tConnection::Publish_ExactlyOnceDelivery(bool retain, bool dup, const std::string& topicName, const std::vector<std::uint8_t>& payload)
+void tConnection::Publish_ExactlyOnceDelivery(bool retain, bool dup, std::string_view topicName, std::span<const std::uint8_t> payload)
 {
 	std::lock_guard Lock(m_TransactionMtx); // There are two transaction in this function, and they must be be executed in sequence.
-	auto PackRsp = Transaction(mqtt::tPacketPUBLISH<mqtt::tQoS::ExactlyOnceDelivery>(retain, dup, topicName, ++m_PacketId, payload));
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	hidden::tPacketIdLease PacketId = AllocatePacketId();
+	auto PackRsp = Transaction(mqtt::tPacketPUBLISH_View<mqtt::tQoS::ExactlyOnceDelivery>(retain, dup, topicName, PacketId.Get(), payload));
 	if (PackRsp.has_value())
 	{
-		g_Log.TestMessage("rsp pubrec: " + std::to_string((int)PackRsp->GetVariableHeader().PacketId.Value));
+		if (g_Log.IsEnabled(tLogCategory::Operation))
+			g_Log.TestMessage("rsp pubrec: " + std::to_string((int)PackRsp->GetVariableHeader().PacketId.Value));
 
 		auto PackRsp2 = Transaction(mqtt::tPacketPUBREL(PackRsp->GetVariableHeader().PacketId));
-		if (PackRsp2.has_value())
+		if (!PackRsp2.has_value())
+			return;
+		PacketId.Dismiss(); // PUBCOMP
+		RecordLatency(tLatencyType::PUBCOMP, TimeStart);
+		if (g_Log.IsEnabled(tLogCategory::Operation))
 		{
 			g_Log.TestMessage("rsp pubcomp: " + std::to_string((int)PackRsp2->GetVariableHeader().PacketId.Value));
 		}
@@ -90,27 +267,43 @@ void tConnection::Publish_ExactlyOnceDelivery(bool retain, bool dup, const std::
 
 void tConnection::Subscribe(const mqtt::tSubscribeTopicFilter& topicFilter)
 {
-	Transaction(mqtt::tPacketSUBSCRIBE(++m_PacketId, topicFilter));
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	hidden::tPacketIdLease PacketId = AllocatePacketId();
+	if (!Transaction(mqtt::tPacketSUBSCRIBE(PacketId.Get(), topicFilter)).has_value())
+		return;
+	PacketId.Dismiss(); // SUBACK
+	RecordLatency(tLatencyType::SUBACK, TimeStart);
 }
 
 void tConnection::Subscribe(const std::vector<mqtt::tSubscribeTopicFilter>& topicFilters)
 {
-	Transaction(mqtt::tPacketSUBSCRIBE(++m_PacketId, topicFilters));
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	hidden::tPacketIdLease PacketId = AllocatePacketId();
+	if (!Transaction(mqtt::tPacketSUBSCRIBE(PacketId.Get(), topicFilters)).has_value())
+		return;
+	PacketId.Dismiss(); // SUBACK
+	RecordLatency(tLatencyType::SUBACK, TimeStart);
 }
 
 void tConnection::Unsubscribe(const mqtt::tString& topicFilter)
 {
-	Transaction(mqtt::tPacketUNSUBSCRIBE(++m_PacketId, topicFilter));
+	hidden::tPacketIdLease PacketId = AllocatePacketId();
+	if (Transaction(mqtt::tPacketUNSUBSCRIBE(PacketId.Get(), topicFilter)).has_value())
+		PacketId.Dismiss(); // UNSUBACK
 }
 
 void tConnection::Unsubscribe(const std::vector<mqtt::tString>& topicFilters)
 {
-	Transaction(mqtt::tPacketUNSUBSCRIBE(++m_PacketId, topicFilters));
+	hidden::tPacketIdLease PacketId = AllocatePacketId();
+	if (Transaction(mqtt::tPacketUNSUBSCRIBE(PacketId.Get(), topicFilters)).has_value())
+		PacketId.Dismiss(); // UNSUBACK
 }
 
 void tConnection::Ping()
 {
-	Transaction(mqtt::tPacketPINGREQ());
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	if (Transaction(mqtt::tPacketPINGREQ()).has_value())
+		RecordLatency(tLatencyType::PINGRESP, TimeStart);
 }
 
 void tConnection::Disconnect()
@@ -124,132 +317,263 @@ bool tConnection::IsConnected() const
 	return IsReceiverInOperation() && m_KeepConnection;
 }
 
-void tConnection::KeepConnectionAlive()
+void tConnection::Send(const std::vector<std::uint8_t>& data)
+{
+	if (data.empty())
+		return;
+
+	tTraceSpan Trace("mqtt", "Send");
+	Trace.AddArg("size", static_cast<std::int64_t>(data.size()));
+
+	WriteCapture(tCaptureDirection::Sent, data);
+
+	m_Transport->Write(boost::asio::buffer(data));
+	m_TimeSent = utils::chrono::tClock::now().time_since_epoch().count();
+
+	hidden::tConnectionMetrics& Metrics = hidden::GetConnectionMetrics();
+	Metrics.BytesSent.Add(data.size());
+	Metrics.PacketsSent[data[0] >> 4]->Add();
+}
+
+void tConnection::SetCapture(std::shared_ptr<tCaptureWriter> capture)
 {
+	if (capture)
+		m_CaptureStream = capture->OpenStream();
+	m_Capture = std::move(capture);
+}
+
+void tConnection::WriteCapture(tCaptureDirection direction, std::span<const std::uint8_t> frame)
+{
+	const std::shared_ptr<tCaptureWriter> Capture = m_Capture.load();
+	if (!Capture)
+		return;
+
 	try
 	{
-		while (IsReceiverInOperation())
-		{
-			if (m_KeepConnection)
-			{
-				std::uint32_t Time = utils::chrono::GetDuration<std::chrono::seconds>(m_TransactionTime, utils::chrono::tClock::now());
-				if (Time >= m_KeepAlive)
-					Ping();
-			}
-			std::this_thread::sleep_for(std::chrono::seconds(1));
-		}
+		Capture->Write(m_CaptureStream, direction, frame);
 	}
 	catch (std::exception& ex)
 	{
-		g_Log.Exception(ex.what());
+		// The capture is a diagnostic one, the traffic goes on without it.
+		if (m_Capture.exchange(nullptr))
+			g_Log.Exception(ex.what());
+	}
+}
+
+void tConnection::SetLatency(std::shared_ptr<tConnectionLatency> latency)
+{
+	m_Latency = std::move(latency);
+}
+
+// 533 It is the responsibility of the Client to ensure that the interval between Control Packets being sent does not
+// 534 exceed the Keep Alive value. In the absence of sending any other Control Packets, the Client MUST send a
+// 535 PINGREQ Packet [MQTT-3.1.2-23].
+// The server doesn't count the packets it sends itself, so only the packets sent by the client postpone PINGREQ.
+// Any packet sent to the server (a transaction or a response to the incoming PUBLISH) restarts the period.
+void tConnection::KeepAliveAsync()
+{
+	if (!m_KeepAlive || !m_Transport->IsOpen()) // the socket is closed when PINGRESP has not been received
+		return;
+
+	m_KeepAliveTimer.expires_at(GetKeepAliveDeadline());
+	m_KeepAliveTimer.async_wait([this](const boost::system::error_code& error)
+		{
+			if (error) // cancelled
+				return;
+			KeepAlive();
+			KeepAliveAsync();
+		});
+}
+
+void tConnection::KeepAlive()
+{
+	if (!m_KeepConnection)
+		return;
+
+	const utils::chrono::tTimePoint TimeNow = utils::chrono::tClock::now();
+	if (m_PINGPending)
+	{
+		if (TimeNow < GetKeepAliveDeadline())
+			return;
+		g_Log.Exception(hidden::StrExceptionKeepAliveNoPINGRESP);
+		hidden::GetConnectionMetrics().KeepAliveTimeouts.Add();
+		m_Transport->Close(); // the receiving operation is aborted and the receiver task is finished
+		return;
 	}
+
+	if (TimeNow < GetKeepAliveDeadline())
+		return;
+
+	mqtt::tPacketPINGREQ Pack;
+	auto PackVector = Pack.ToVector();
+	if (g_Log.IsEnabled(tLogCategory::Packet))
+		g_Log.PacketSent(Pack.ToString(), PackVector);
+	m_TimePING = TimeNow.time_since_epoch().count();
+	m_PINGPending = true;
+	Send(PackVector);
+	hidden::GetConnectionMetrics().KeepAlivePings.Add();
+}
+
+utils::chrono::tTimePoint tConnection::GetKeepAliveDeadline() const
+{
+	if (!m_KeepConnection) // there is no session yet
+		return utils::chrono::tClock::now() + std::chrono::seconds(1);
+
+	const std::chrono::milliseconds KeepAlive(m_KeepAlive * 1000);
+	if (m_PINGPending) // 547 ... within one and a half times the Keep Alive time period ... [MQTT-3.1.2-24]. PINGREQ is sent when the Keep Alive has elapsed, so the rest is a half.
+		return utils::chrono::tTimePoint(utils::chrono::tClock::duration(m_TimePING)) + KeepAlive / 2;
+	return utils::chrono::tTimePoint(utils::chrono::tClock::duration(m_TimeSent)) + KeepAlive;
 }
 
-std::vector<tConnection::tPacketData> tConnection::ReceivePacket()
+void tConnection::ReceiveAsync()
 {
-	auto SocketReadSome = [this](std23::vector<std::uint8_t>& rcvdData)->bool
+	auto Handler = [this](const boost::system::error_code& error, std::size_t size)
 		{
-			std23::vector<std::uint8_t> Buffer(LIB_SHARE_MQTT_CONNECTION_RECEIVE_BUFFER_SIZE); //[#] max received data of packets
-
-			boost::system::error_code Error;
-			const std::size_t SizeRcv = m_Socket->read_some(boost::asio::buffer(Buffer), Error);
-			if (!SizeRcv)
-				return false;
-			Buffer.resize(SizeRcv);
-			if (rcvdData.empty())
+			if (error || !size) // the connection has been closed
 			{
-				rcvdData = std::move(Buffer);
+				m_KeepAliveTimer.cancel();
+				return;
 			}
-			else
+
+			hidden::tConnectionMetrics& Metrics = hidden::GetConnectionMetrics();
+			Metrics.BytesReceived.Add(size);
+
+			for (auto& [ControlPacketType, PacketVector] : ReceivePacket(size))
 			{
-				rcvdData.append_range(Buffer);
+				Metrics.PacketsReceived[static_cast<std::size_t>(ControlPacketType) & 0x0F]->Add();
+
+				WriteCapture(tCaptureDirection::Received, PacketVector);
+
+				g_Log.PacketReceivedRaw(PacketVector);
+
+				ReleasePacketId(ControlPacketType, PacketVector);
+
+				if (HandlePacket(ControlPacketType, PacketVector))
+					continue;
+
+				m_ReceivedMessages.Put(ControlPacketType, PacketVector);
+
+				m_ReceivedMessages.Notify(ControlPacketType);
 			}
-			return true;
+
+			ReceiveAsync();
 		};
 
+	m_Transport->AsyncReadSome(boost::asio::buffer(m_ReceiveBuffer), Handler);
+}
+
+std::vector<tConnection::tPacketData> tConnection::ReceivePacket(std::size_t size)
+{
+	tTraceSpan Trace("mqtt", "ReceivePacket");
+	Trace.AddArg("size", static_cast<std::int64_t>(size));
+
+	m_ReceivedData.insert(m_ReceivedData.end(), m_ReceiveBuffer.begin(), m_ReceiveBuffer.begin() + size);
+
 	std::vector<tPacketData> ReceivedPackets;
-	std23::vector<std::uint8_t> ReceivedData;
-	std::size_t ReceivedDataRemainsSize = 0;
-	do
+	mqtt::tSpan Span(m_ReceivedData);
+	while (!Span.empty())
 	{
-		if (!SocketReadSome(ReceivedData))
-			return ReceivedPackets;
-		ReceivedDataRemainsSize = ReceivedData.size();
-		mqtt::tSpan Span(ReceivedData, ReceivedDataRemainsSize);
-		while (ReceivedDataRemainsSize)
-		{
-			auto Res = mqtt::TestPacket(Span);
-			if (!Res.has_value())
-			{
-				ReceivedData = Span.ToVector();
-				break;
-			}
-			ReceivedPackets.push_back({ Res->first, Res->second.ToVector() });
-			ReceivedDataRemainsSize = Span.size();
-		}
-	} while (ReceivedDataRemainsSize);
+		auto Res = mqtt::TestPacket(Span);
+		if (!Res.has_value()) // the rest of the packet has not been received yet
+			break;
+		ReceivedPackets.push_back({ Res->first, Res->second.ToVector() });
+	}
+	m_ReceivedData.erase(m_ReceivedData.begin(), m_ReceivedData.end() - Span.size());
 	return ReceivedPackets;
 }
 
 void tConnection::TaskReceiver()
 {
-	while (true)
-	{
-		std::vector<tPacketData> ReceivedPackets = ReceivePacket(); // blocking
-		if (ReceivedPackets.empty())
-		{
-			m_ReceivedMessages.NotifyBrokenConnection();
-			return;
-		}
+	ReceiveAsync();
+	KeepAliveAsync();
 
-		for (auto& [ControlPacketType, PacketVector] : ReceivedPackets)
-		{
-			g_Log.PacketReceivedRaw(PacketVector);
-
-			if (HandlePacket(ControlPacketType, PacketVector))
-				continue;
+	m_ioc.run(); // blocking, it returns when the connection is closed
 
-			m_ReceivedMessages.Put(ControlPacketType, PacketVector);
+	if (m_KeepConnection)
+		hidden::GetConnectionMetrics().ConnectionsBroken.Add();
 
-			m_ReceivedMessages.Notify(ControlPacketType);
-		}
-	}
+	m_ReceivedMessages.NotifyBrokenConnection();
 }
 
 template<typename tRsp>
-void SendResponse(std::unique_ptr<tcp::socket>& socket, std::optional<mqtt::tUInt16> packetIdOpt)
+std::vector<std::uint8_t> MakeResponse(std::optional<mqtt::tUInt16> packetIdOpt)
 {
 	// [*] It might be a good idea to close connection in case of absence of PacketId in the incoming packet.
 	if (!packetIdOpt.has_value())
-		return;
+		return {};
 	auto Pack = tRsp(*packetIdOpt);
 	auto PackVector = Pack.ToVector();
-	g_Log.PacketSent(Pack.ToString(), PackVector);
-	socket->write_some(boost::asio::buffer(PackVector));
+	if (g_Log.IsEnabled(tLogCategory::Packet))
+		g_Log.PacketSent(Pack.ToString(), PackVector);
+	return PackVector;
 }
 
 bool tConnection::HandlePacket(mqtt::tControlPacketType packType, std::vector<std::uint8_t>& packData)
 {
+	tTraceSpan Trace("mqtt", "HandlePacket");
+	if (Trace.IsActive())
+		Trace.AddArg("type", mqtt::ToString(packType));
+
 	mqtt::tSpan PacketRawSpan(packData);
 	switch (packType)
 	{
 	case mqtt::tControlPacketType::PUBLISH:
 	{
-		auto Pack_parsed = mqtt::tPacketPUBLISH_Parse::Parse(PacketRawSpan);
-		if (!Pack_parsed.has_value())
-			THROW_RUNTIME_ERROR(hidden::StrExceptionReceivedParseError); // Res.error() - put it into the message
+		// The Topic Name is looked up in g_Topics as it is in the received data, the payload is a part of the received frame (not copied).
+		auto FixedHeader = mqtt::hidden::tFixedHeaderBaseT<mqtt::tControlPacketType::PUBLISH>::Parse(PacketRawSpan);
+		std::optional<mqtt::tUInt16> TopicNameSize;
+		if (FixedHeader.has_value())
+		{
+			PacketRawSpan.Shorten(FixedHeader->second);
+			TopicNameSize = mqtt::tUInt16::Parse(PacketRawSpan);
+		}
+		if (!TopicNameSize.has_value() || PacketRawSpan.size() < TopicNameSize->Value)
+		{
+			hidden::GetConnectionMetrics().ParseErrors.Add();
+			THROW_RUNTIME_ERROR(hidden::StrExceptionReceivedParseError);
+		}
+		const std::string_view TopicName(reinterpret_cast<const char*>(PacketRawSpan.data()), TopicNameSize->Value);
+		PacketRawSpan.Skip(TopicNameSize->Value);
+
+		const mqtt::tQoS QoS = FixedHeader->first.GetQoS();
+		std::optional<mqtt::tUInt16> PacketId;
+		if (QoS != mqtt::tQoS::AtMostOnceDelivery)
+		{
+			PacketId = mqtt::tUInt16::Parse(PacketRawSpan);
+			if (!PacketId.has_value())
+			{
+				hidden::GetConnectionMetrics().ParseErrors.Add();
+				THROW_RUNTIME_ERROR(hidden::StrExceptionReceivedParseError);
+			}
+		}
+
+		// The frame is shared by the message, the topic name and the payload are views into it (the data is not moved).
+		const std::size_t PayloadOffset = PacketRawSpan.data() - packData.data();
+		const std::size_t PayloadSize = PacketRawSpan.size();
+		tIncomingMessage Msg{ tTopicTable::IdNone, TopicName, tPayload(std::make_shared<const std::vector<std::uint8_t>>(std::move(packData)), PayloadOffset, PayloadSize) };
+
+		if (const auto Topic = g_Topics.Intern(TopicName))
+		{
+			Msg.TopicId = Topic->first;
+			Msg.TopicName = Topic->second;
+		}
+		else
+		{
+			hidden::GetConnectionMetrics().TopicsOverflow.Add(); // the message is delivered without its TopicId
+		}
 
-		m_DataSetIncoming.push_back({ Pack_parsed->GetVariableHeader().TopicName, Pack_parsed->GetPayload() });
+		if (!m_DataSetIncoming.push_back(std::move(Msg))) // the oldest message (acknowledged) is dropped, this one is queued
+			hidden::GetConnectionMetrics().IncomingDropped.Add();
 
-		switch (Pack_parsed->GetFixedHeader().GetQoS())
+		switch (QoS)
 		{
 		case mqtt::tQoS::AtMostOnceDelivery:
 			break;
 		case mqtt::tQoS::AtLeastOnceDelivery:
-			SendResponse<mqtt::tPacketPUBACK>(m_Socket, Pack_parsed->GetVariableHeader().PacketId);
+			Send(MakeResponse<mqtt::tPacketPUBACK>(PacketId));
 			break;
 		case mqtt::tQoS::ExactlyOnceDelivery:
-			SendResponse<mqtt::tPacketPUBREC>(m_Socket, Pack_parsed->GetVariableHeader().PacketId);
+			Send(MakeResponse<mqtt::tPacketPUBREC>(PacketId));
 			break;
 		}
 		return true;
@@ -258,17 +582,62 @@ bool tConnection::HandlePacket(mqtt::tControlPacketType packType, std::vector<st
 	{
 		auto Pack_parsed = mqtt::tPacketPUBREL::Parse(PacketRawSpan);
 		if (!Pack_parsed.has_value())
+		{
+			hidden::GetConnectionMetrics().ParseErrors.Add();
 			THROW_RUNTIME_ERROR(hidden::StrExceptionReceivedParseError); // Res.error() - put it into the message
-		SendResponse<mqtt::tPacketPUBCOMP>(m_Socket, Pack_parsed->GetVariableHeader().PacketId);
+		}
+		Send(MakeResponse<mqtt::tPacketPUBCOMP>(Pack_parsed->GetVariableHeader().PacketId));
 		return true;
 	}
+	case mqtt::tControlPacketType::PINGRESP:
+	{
+		if (m_PINGPending.exchange(false)) // keep alive, Ping() records its own round trip
+			RecordLatency(tLatencyType::PINGRESP, utils::chrono::tTimePoint(utils::chrono::tClock::duration(m_TimePING)));
+		return false; // it can be a response to Ping()
+	}
 	}
 	return false;
 }
 
+hidden::tPacketIdLease tConnection::AllocatePacketId()
+{
+	std::optional<std::uint16_t> PacketId = m_PacketIdPool.Allocate();
+	if (!PacketId.has_value())
+		THROW_RUNTIME_ERROR(hidden::StrExceptionPacketIdNoFree);
+	return hidden::tPacketIdLease(m_PacketIdPool, *PacketId);
+}
+
+void tConnection::ReleasePacketId(mqtt::tControlPacketType packType, const std::vector<std::uint8_t>& packData)
+{
+	switch (packType)
+	{
+	case mqtt::tControlPacketType::PUBACK: // QoS 1
+	case mqtt::tControlPacketType::PUBCOMP: // QoS 2 (PUBREC doesn't complete the flow)
+	case mqtt::tControlPacketType::SUBACK:
+	case mqtt::tControlPacketType::UNSUBACK:
+		break;
+	default:
+		return;
+	}
+
+	// The Packet Identifier is the first field of the variable header in all of these packets.
+	mqtt::tSpan PacketRawSpan(packData);
+	if (!mqtt::hidden::tFixedHeaderBase::Parse<mqtt::hidden::tFixedHeaderBase>(PacketRawSpan).has_value())
+		return;
+	std::optional<mqtt::tUInt16> PacketId = mqtt::tUInt16::Parse(PacketRawSpan);
+	if (PacketId.has_value())
+		m_PacketIdPool.Release(PacketId->Value);
+}
+
 bool tConnection::IsReceiverInOperation() const
 {
 	return m_FutureReceiver.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready;
 }
 
+void tConnection::RecordLatency(tLatencyType type, utils::chrono::tTimePoint timeStart)
+{
+	if (m_Latency)
+		m_Latency->Record(type, std::chrono::duration_cast<utils::chrono::ttime_us>(utils::chrono::tClock::now() - timeStart));
+}
+
 }
@@ -11,12 +11,23 @@
 #define LIB_SHARE_MQTT_QUEUE_INCOMING_CAPACITY 10
 #endif
 
+#ifndef LIB_SHARE_MQTT_TOPIC_TABLE_CAPACITY
+#define LIB_SHARE_MQTT_TOPIC_TABLE_CAPACITY 4096 // Topic Names
+#endif
+
+#include <array>
+#include <atomic>
+#include <bit>
 #include <condition_variable>
 #include <deque>
 #include <future>
 #include <map>
 #include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <type_traits>
 #include <utility>
@@ -27,6 +38,11 @@
 #include <utilsMultithread.h>
 #include <utilsPacketMQTTv3_1_1.h>
 #include <shareLog.h>
+#include <shareCapture.h>
+#include <shareHistogram.h>
+#include <shareMetrics.h>
+#include <shareTrace.h>
+#include <shareTransport.h>
 
 using boost::asio::ip::tcp;
 namespace mqtt = utils::packet::mqtt_3_1_1;
@@ -38,6 +54,29 @@ namespace hidden
 
 constexpr char StrExceptionReceivedNoData[] = "No data has been received.";
 constexpr char StrExceptionReceivedParseError[] = "Received response has not been parsed.";
+constexpr char StrExceptionPacketIdNoFree[] = "There is no free packet identifier.";
+constexpr char StrExceptionPayloadOutOfFrame[] = "The payload is out of the frame.";
+constexpr char StrExceptionKeepAliveNoPINGRESP[] = "PINGRESP has not been received within the keep alive period, the connection is closed.";
+
+// The metrics of all the connections (g_Metrics).
+struct tConnectionMetrics
+{
+	tMetricGauge& Connections;
+	tMetricCounter& Connects;
+	tMetricCounter& ConnectionsBroken; // the connection has been closed while it's kept
+	tMetricCounter& BytesSent;
+	tMetricCounter& BytesReceived;
+	std::array<tMetricCounter*, 16> PacketsSent; // 2.2.1 MQTT Control Packet type
+	std::array<tMetricCounter*, 16> PacketsReceived;
+	tMetricCounter& ParseErrors;
+	tMetricCounter& IncomingDropped; // PUBLISH, the queue of incoming messages is full, the oldest message is dropped
+	tMetricCounter& TopicsOverflow; // PUBLISH, the table of Topic Names is full, the message is delivered without its TopicId
+	tMetricCounter& ResponsesDropped; // the response has not been taken by the transaction
+	tMetricCounter& KeepAlivePings;
+	tMetricCounter& KeepAliveTimeouts;
+};
+
+tConnectionMetrics& GetConnectionMetrics();
 
 template<std::size_t QueueCapacity>
 class tReceivedMessages
@@ -46,8 +85,8 @@ class tReceivedMessages
 	std::mutex m_Mtx;
 
 	std::condition_variable m_CondVar;
-	std::mutex m_CondVarMtx;
 	mqtt::tControlPacketType m_CondVarControlPacketType = mqtt::tControlPacketType::_None;
+	bool m_BrokenConnection = false;
 
 public:
 	void Put(mqtt::tControlPacketType packType, std::vector<std::uint8_t>& packData)
@@ -56,7 +95,10 @@ public:
 		m_Queue[packType].push_back(std::move(packData));
 
 		if (m_Queue[packType].size() > QueueCapacity)
+		{
 			m_Queue[packType].pop_front();
+			GetConnectionMetrics().ResponsesDropped.Add();
+		}
 	}
 	//void Put(mqtt::tControlPacketType packType, mqtt::tSpan packData)
 	//{
@@ -80,32 +122,234 @@ public:
 		m_Queue[packType].clear();
 	}
 
-	void Wait(mqtt::tControlPacketType packType)
+	void Wait(mqtt::tControlPacketType packType) // the response can be received before Wait(..) is called, so the queue is checked.
 	{
+		std::unique_lock<std::mutex> Lock(m_Mtx);
 		m_CondVarControlPacketType = packType;
-		std::unique_lock<std::mutex> Lock(m_CondVarMtx);
-		m_CondVar.wait(Lock);
+		m_CondVar.wait(Lock, [&]() { return m_BrokenConnection || m_CondVarControlPacketType != packType || !m_Queue[packType].empty(); });
+		m_CondVarControlPacketType = mqtt::tControlPacketType::_None;
 	}
 	void Notify(mqtt::tControlPacketType packType)
 	{
+		std::lock_guard<std::mutex> Guard(m_Mtx);
 		if (m_CondVarControlPacketType != packType)
 			return;
 		m_CondVar.notify_one();
+	}
+	void Cancel() // the response has not been received in time.
+	{
+		std::lock_guard<std::mutex> Guard(m_Mtx);
 		m_CondVarControlPacketType = mqtt::tControlPacketType::_None;
+		m_CondVar.notify_all();
 	}
 	void NotifyBrokenConnection() // the connection has been broken.
 	{
+		std::lock_guard<std::mutex> Guard(m_Mtx);
+		m_BrokenConnection = true;
 		m_CondVar.notify_all();
-		m_CondVarControlPacketType = mqtt::tControlPacketType::_None;
 	}
 };
 
+// 815 Each time a Client sends a new packet of one of these types it MUST assign it a currently unused Packet
+// 816 Identifier [MQTT-2.3.1-2]. ... A packet identifier becomes available for reuse after the sender has processed
+// 817 the corresponding acknowledgement packet.
+// The identifier 0 is not valid, so it is never allocated.
+class tPacketIdPool
+{
+	static constexpr std::size_t m_WordBits = 64;
+	static constexpr std::size_t m_WordQty = 0x10000 / m_WordBits;
+	static constexpr std::size_t m_IdQtyMax = 0xFFFF;
+
+	std::array<std::uint64_t, m_WordQty> m_InUse{}; // a bit is set if the packet identifier is in flight
+	std::size_t m_InUseQty = 0;
+	std::uint16_t m_Next = 0; // the search for a free identifier starts here, so the identifiers are not reused immediately
+	mutable std::mutex m_Mtx;
+
+public:
+	explicit tPacketIdPool(std::uint16_t idStart)
+		:m_Next(idStart)
+	{
+		m_InUse[0] = 1; // 0 is not a valid packet identifier
+	}
+
+	std::optional<std::uint16_t> Allocate()
+	{
+		std::lock_guard<std::mutex> Guard(m_Mtx);
+		if (m_InUseQty >= m_IdQtyMax)
+			return {};
+
+		std::size_t Index = m_Next / m_WordBits;
+		std::uint64_t Free = ~m_InUse[Index] & (~std::uint64_t(0) << (m_Next % m_WordBits));
+		for (std::size_t i = 0; i <= m_WordQty; ++i) // the first word is visited twice: from m_Next upwards and then below m_Next
+		{
+			if (Free)
+			{
+				const int Bit = std::countr_zero(Free);
+				m_InUse[Index] |= std::uint64_t(1) << Bit;
+				++m_InUseQty;
+				const std::uint16_t Id = static_cast<std::uint16_t>(Index * m_WordBits + Bit);
+				m_Next = static_cast<std::uint16_t>(Id + 1);
+				return Id;
+			}
+			Index = (Index + 1) % m_WordQty;
+			Free = ~m_InUse[Index];
+		}
+		return {};
+	}
+
+	void Release(std::uint16_t id)
+	{
+		if (!id)
+			return;
+		std::lock_guard<std::mutex> Guard(m_Mtx);
+		const std::uint64_t Mask = std::uint64_t(1) << (id % m_WordBits);
+		std::uint64_t& Word = m_InUse[id / m_WordBits];
+		if (!(Word & Mask))
+			return; // an acknowledgement for a packet that is not in flight (e.g. duplicated)
+		Word &= ~Mask;
+		--m_InUseQty;
+	}
+
+	bool IsInUse(std::uint16_t id) const
+	{
+		std::lock_guard<std::mutex> Guard(m_Mtx);
+		return (m_InUse[id / m_WordBits] >> (id % m_WordBits)) & 1;
+	}
+
+	std::size_t GetInUseQty() const
+	{
+		std::lock_guard<std::mutex> Guard(m_Mtx);
+		return m_InUseQty;
+	}
+};
+
+// The identifier is returned to the pool when the transaction fails (it throws, times out or gets no response);
+// it's dismissed when the acknowledgement has been received, the receiver releases the identifier then (ReleasePacketId).
+class tPacketIdLease
+{
+	tPacketIdPool& m_Pool;
+	const std::uint16_t m_Id;
+	bool m_Dismissed = false;
+
+public:
+	tPacketIdLease(tPacketIdPool& pool, std::uint16_t id)
+		:m_Pool(pool), m_Id(id)
+	{
+	}
+	tPacketIdLease(const tPacketIdLease&) = delete;
+	tPacketIdLease(tPacketIdLease&&) = delete;
+	~tPacketIdLease()
+	{
+		if (!m_Dismissed)
+			m_Pool.Release(m_Id);
+	}
+
+	tPacketIdLease& operator=(const tPacketIdLease&) = delete;
+	tPacketIdLease& operator=(tPacketIdLease&&) = delete;
+
+	std::uint16_t Get() const { return m_Id; }
+	void Dismiss() { m_Dismissed = true; }
+};
+
 }
 
+using tTopicId = std::uint32_t;
+
+// Topic Names of the incoming messages: a name is kept once and it's given a small id (0, 1, 2 ...), the ids and the views
+// of the names are valid while the table exists. The names are not removed, the table is filled up to its capacity.
+// The name is hashed once per lookup, the hashes are kept in the slots, so the names are compared only when the hashes are equal.
+class tTopicTable
+{
+public:
+	static constexpr tTopicId IdNone = UINT32_MAX;
+
+private:
+	struct tSlot
+	{
+		std::size_t Hash = 0;
+		tTopicId Id = IdNone; // IdNone - the slot is empty
+	};
+
+	mutable std::shared_mutex m_Mtx;
+	std::vector<tSlot> m_Slots; // open addressing, linear probing; a power of 2, at least twice the number of the names
+	std::deque<std::string> m_Names; // the index is the id, the strings are not moved
+	const std::size_t m_Capacity;
+
+public:
+	explicit tTopicTable(std::size_t capacity = LIB_SHARE_MQTT_TOPIC_TABLE_CAPACITY);
+	tTopicTable(const tTopicTable&) = delete;
+	tTopicTable(tTopicTable&&) = delete;
+
+	tTopicTable& operator=(const tTopicTable&) = delete;
+	tTopicTable& operator=(tTopicTable&&) = delete;
+
+	std::optional<std::pair<tTopicId, std::string_view>> Intern(std::string_view topicName); // no value - the table is full
+	std::optional<tTopicId> Find(std::string_view topicName) const;
+	std::string_view GetName(tTopicId id) const; // empty for an unknown id
+
+	std::size_t size() const;
+
+private:
+	std::optional<tTopicId> Find(std::string_view topicName, std::size_t hash) const; // m_Mtx is locked
+	void Insert(std::size_t hash, tTopicId id); // m_Mtx is locked exclusively
+};
+
+// The characters of the string as a payload (viewed).
+inline std::span<const std::uint8_t> ToPayload(std::string_view data)
+{
+	return { reinterpret_cast<const std::uint8_t*>(data.data()), data.size() };
+}
+
+// Immutable payload: a part of the received frame, the frame is shared by all the copies of the payload (reference counted),
+// so a message can be given to any number of consumers and kept by them without copying the data.
+class tPayload
+{
+	std::shared_ptr<const std::vector<std::uint8_t>> m_Frame;
+	std::size_t m_Offset = 0;
+	std::size_t m_Size = 0;
+
+public:
+	tPayload() = default;
+	tPayload(std::shared_ptr<const std::vector<std::uint8_t>> frame, std::size_t offset, std::size_t size);
+	explicit tPayload(std::vector<std::uint8_t> data); // the data is the whole payload
+
+	const std::uint8_t* data() const { return m_Frame ? m_Frame->data() + m_Offset : nullptr; }
+	std::size_t size() const { return m_Size; }
+	bool empty() const { return m_Size == 0; }
+	const std::uint8_t* begin() const { return data(); }
+	const std::uint8_t* end() const { return data() + m_Size; }
+
+	operator std::span<const std::uint8_t>() const { return { data(), m_Size }; }
+
+	std::vector<std::uint8_t> ToVector() const { return { begin(), end() }; }
+};
+
 struct tIncomingMessage
 {
-	std::string TopicName;
-	std::vector<std::uint8_t> Payload;
+	tTopicId TopicId = tTopicTable::IdNone; // g_Topics, IdNone - the table is full
+	std::string_view TopicName; // it's kept by g_Topics, or by the frame of Payload if TopicId is IdNone
+	tPayload Payload;
+};
+
+// Round trips of the transactions.
+enum class tLatencyType : std::uint8_t
+{
+	CONNACK, // CONNECT -> CONNACK
+	PUBACK, // PUBLISH QoS 1 -> PUBACK
+	PUBCOMP, // PUBLISH QoS 2 -> PUBREC, PUBREL -> PUBCOMP
+	SUBACK, // SUBSCRIBE -> SUBACK
+	PINGRESP, // PINGREQ -> PINGRESP (Ping() and keep alive)
+};
+
+class tConnectionLatency
+{
+	std::array<tLatencyHistogram, 5> m_Histograms;
+
+public:
+	void Record(tLatencyType type, utils::chrono::ttime_us value) { m_Histograms[static_cast<std::size_t>(type)].Record(value); }
+	tHistogramSnapshot GetSnapshot(tLatencyType type) const { return m_Histograms[static_cast<std::size_t>(type)].GetSnapshot(); }
+
+	static std::string ToString(tLatencyType type);
 };
 
 class tConnection
@@ -113,29 +357,41 @@ class tConnection
 	using tDataSet = utils::multithread::tQueue<tIncomingMessage, LIB_SHARE_MQTT_QUEUE_INCOMING_CAPACITY>;
 	using tPacketData = std::pair<mqtt::tControlPacketType, std::vector<std::uint8_t>>;
 
-	boost::asio::io_context m_ioc;
-	std::unique_ptr<tcp::socket> m_Socket;
+	boost::asio::io_context m_ioc; // it is run by the receiver task: receiving and keep alive
+	std::unique_ptr<tTransport> m_Transport;
+	std::vector<std::uint8_t> m_ReceiveBuffer;
+	std::vector<std::uint8_t> m_ReceivedData; // a packet which is not completely received yet
 	std::future<void> m_FutureReceiver;
 	std::recursive_mutex m_TransactionMtx;
-	utils::chrono::tTimePoint m_TransactionTime;
-	std::thread m_KeepConnectionThread;
-	bool m_KeepConnection;
+	boost::asio::steady_timer m_KeepAliveTimer;
+	std::atomic<utils::chrono::tClock::rep> m_TimeSent{}; // the time of the last packet sent to the server
+	std::atomic<utils::chrono::tClock::rep> m_TimePING{}; // the time of PINGREQ which has not been responded yet
+	std::atomic<bool> m_PINGPending = false;
+	std::atomic<bool> m_KeepConnection;
 	hidden::tReceivedMessages<5> m_ReceivedMessages; // [#]
 	const std::uint16_t m_KeepAlive;
-	std::uint16_t m_PacketId;
+	hidden::tPacketIdPool m_PacketIdPool;
 	tDataSet m_DataSetIncoming;
+	std::atomic<std::shared_ptr<tCaptureWriter>> m_Capture; // the frames sent and received, it's detached when it fails
+	std::uint16_t m_CaptureStream = 0;
+	std::shared_ptr<tConnectionLatency> m_Latency; // the round trips of the transactions
 
 public:
 	tConnection() = delete;
+	tConnection(const tTransportFactory& transportFactory, std::uint16_t keepAlive);
 	tConnection(std::string_view host, std::string_view service, std::uint16_t keepAlive);
+#ifdef LIB_SHARE_MQTT_TLS
+	tConnection(std::shared_ptr<tContextTLS> contextTLS, std::string_view host, std::string_view service, std::uint16_t keepAlive);
+#endif // LIB_SHARE_MQTT_TLS
 	~tConnection();
 
 	bool Connect(mqtt::tSessionStateRequest sessionStateRequest, const std::string& clientId, mqtt::tQoS willQos, bool willRetain, const std::string& willTopic, const std::string& willMessage);
 	bool Connect(mqtt::tSessionStateRequest sessionStateRequest, const std::string& clientId);
-	void Publish_AtMostOnceDelivery(bool retain, const std::string& topicName, const std::vector<std::uint8_t>& payload);
-	void Publish_AtMostOnceDelivery(bool retain, const std::string& topicName);
-	void Publish_AtLeastOnceDelivery(bool retain, bool dup, const std::string& topicName, const std::vector<std::uint8_t>& payload);
-	void Publish_ExactlyOnceDelivery(bool retain, bool dup, const std::string& topicName, const std::vector<std::uint8_t>& payload);
+	// The Topic Name and the payload are viewed, they are copied once - into the packet sent (std::vector<std::uint8_t> is taken as std::span).
+	void Publish_AtMostOnceDelivery(bool retain, std::string_view topicName, std::span<const std::uint8_t> payload);
+	void Publish_AtMostOnceDelivery(bool retain, std::string_view topicName);
+	void Publish_AtLeastOnceDelivery(bool retain, bool dup, std::string_view topicName, std::span<const std::uint8_t> payload);
+	void Publish_ExactlyOnceDelivery(bool retain, bool dup, std::string_view topicName, std::span<const std::uint8_t> payload);
 	void Subscribe(const mqtt::tSubscribeTopicFilter& topicFilter);
 	void Subscribe(const std::vector<mqtt::tSubscribeTopicFilter>& topicFilters);
 	void Unsubscribe(const mqtt::tString& topicFilter);
@@ -148,25 +404,43 @@ public:
 	bool IsIncomingEmpty() const { return m_DataSetIncoming.empty(); }
 	tIncomingMessage GetIncoming() { return m_DataSetIncoming.get_front(); }
 
+	const tConnectionStats& GetStats() const { return m_Transport->GetStats(); }
+
+	void SetCapture(std::shared_ptr<tCaptureWriter> capture); // it's set before Connect(..), the capture can be shared by the connections
+	void SetLatency(std::shared_ptr<tConnectionLatency> latency); // it's set before Connect(..), the histograms can be shared by the connections
+
 private:
-	void KeepConnectionAlive();
+	void Send(const std::vector<std::uint8_t>& data);
+	void WriteCapture(tCaptureDirection direction, std::span<const std::uint8_t> frame);
+
+	void KeepAliveAsync();
+	void KeepAlive();
+	utils::chrono::tTimePoint GetKeepAliveDeadline() const;
 
-	std::vector<tPacketData> ReceivePacket();
+	void ReceiveAsync();
+	std::vector<tPacketData> ReceivePacket(std::size_t size);
 	void TaskReceiver();
 
 	bool HandlePacket(mqtt::tControlPacketType packType, std::vector<std::uint8_t>& packData);
 
+	hidden::tPacketIdLease AllocatePacketId();
+	void ReleasePacketId(mqtt::tControlPacketType packType, const std::vector<std::uint8_t>& packData);
+
 	bool IsReceiverInOperation() const;
 
+	void RecordLatency(tLatencyType type, utils::chrono::tTimePoint timeStart);
+
 	template<typename T>
 	std::optional<typename T::response_type> Transaction(const T& packet)
 	{
+		tTraceSpan Trace("mqtt", "Transaction");
+		if (Trace.IsActive())
+			Trace.AddArg("type", mqtt::ToString(T::GetControlPacketType()));
+
 		std::lock_guard Lock(m_TransactionMtx);
 		std::future<std::optional<typename T::response_type>> TaskFuture = std::async(std::launch::async, [&]() { return TaskTransactionHandler<T>(packet); });
 		TaskTransactionWait(TaskFuture, 10000, mqtt::ToString(T::GetControlPacketType())); // [#] 10000 is ok for all types of packets ? - it can be = [TBD] keepAlive at most.
-		auto Res = TaskFuture.get();
-		m_TransactionTime = utils::chrono::tClock::now();
-		return Res; 
+		return TaskFuture.get();
 	}
 
 	template<class T>
@@ -183,6 +457,8 @@ private:
 
 		if (!IsReceiverInOperation())
 			m_ReceivedMessages.NotifyBrokenConnection();
+		else if (future.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+			m_ReceivedMessages.Cancel();
 	}
 
 	template <class tCmd>
@@ -194,11 +470,12 @@ private:
 
 		auto PackVector = packet.ToVector();
 
-		g_Log.PacketSent(packet.ToString(), PackVector);
+		if (g_Log.IsEnabled(share::tLogCategory::Packet))
+			g_Log.PacketSent(packet.ToString(), PackVector);
 
 		m_ReceivedMessages.Clear(tRsp::GetControlPacketType());
 
-		m_Socket->write_some(boost::asio::buffer(PackVector));
+		Send(PackVector);
 
 		if (std::is_same_v<tRsp, mqtt::tPacketNOACK>)
 			return {};
@@ -212,11 +489,17 @@ private:
 		mqtt::tSpan PacketRawSpan(PacketRaw);
 		auto Pack_parsed = tRsp::Parse(PacketRawSpan);
 		if (!Pack_parsed.has_value())
+		{
+			hidden::GetConnectionMetrics().ParseErrors.Add();
 			THROW_RUNTIME_ERROR(hidden::StrExceptionReceivedParseError); // Res.error() - put it into the message
-		g_Log.PacketReceived(Pack_parsed->ToString());
+		}
+		if (g_Log.IsEnabled(share::tLogCategory::Packet))
+			g_Log.PacketReceived(Pack_parsed->ToString());
 
 		return std::optional<tRsp>(*Pack_parsed);//std::move(*Pack_parsed);
 	}
 };
 
 }
+
+extern share::tTopicTable g_Topics;
@@ -0,0 +1,244 @@
+#include "shareMetrics.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+share::tMetrics g_Metrics;
+
+namespace share
+{
+namespace hidden
+{
+
+std::size_t GetMetricShard()
+{
+	static std::atomic<std::size_t> ShardNext = 0;
+	thread_local const std::size_t Shard = ShardNext++ % LIB_SHARE_METRICS_SHARD_QTY;
+	return Shard;
+}
+
+std::string MakeSeries(const std::string& name, const std::string& labels)
+{
+	return labels.empty() ? name : name + "{" + labels + "}";
+}
+
+std::string ToStringValue(double value)
+{
+	char Str[32];
+	const int Size = std::snprintf(Str, sizeof(Str), "%.17g", value);
+	return std::string(Str, Size > 0 ? Size : 0);
+}
+
+}
+
+std::uint64_t tMetricCounter::Get() const
+{
+	std::uint64_t Value = 0;
+	for (const tShard& Shard : m_Shards)
+		Value += Shard.Value.load(std::memory_order_relaxed);
+	return Value;
+}
+
+tMetricCounter& tMetrics::GetCounter(std::string_view name, std::string_view help, std::string_view labels)
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	tMetric& Metric = GetMetric(name, help, labels, tMetricType::Counter);
+	if (!Metric.Counter)
+		Metric.Counter = std::make_unique<tMetricCounter>();
+	return *Metric.Counter;
+}
+
+tMetricGauge& tMetrics::GetGauge(std::string_view name, std::string_view help, std::string_view labels)
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	tMetric& Metric = GetMetric(name, help, labels, tMetricType::Gauge);
+	if (!Metric.Gauge)
+		Metric.Gauge = std::make_unique<tMetricGauge>();
+	return *Metric.Gauge;
+}
+
+void tMetrics::SetCallback(std::string_view name, std::string_view help, std::string_view labels, tMetricType type, std::function<double()> callback)
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	GetMetric(name, help, labels, type).Callback = std::move(callback);
+}
+
+std::string tMetrics::ToPrometheus() const
+{
+	// The callbacks are called when m_Mtx is unlocked, so they can use the registry.
+	// A metric is not removed and its name, help, labels and type are not changed, so it's read without the lock.
+	struct tSeries
+	{
+		const tMetric* Metric = nullptr;
+		std::function<double()> Callback;
+		const tMetricCounter* Counter = nullptr;
+		const tMetricGauge* Gauge = nullptr;
+	};
+	std::vector<tSeries> Series;
+	{
+		std::lock_guard<std::mutex> Lock(m_Mtx);
+		Series.reserve(m_Metrics.size());
+		for (const auto& Metric : m_Metrics)
+			Series.push_back({ Metric.get(), Metric->Callback, Metric->Counter.get(), Metric->Gauge.get() });
+	}
+
+	std::string Str;
+	std::vector<bool> Done(Series.size());
+	for (std::size_t i = 0; i < Series.size(); ++i) // the series of a metric are grouped
+	{
+		if (Done[i])
+			continue;
+
+		const tMetric& Metric = *Series[i].Metric;
+		Str += "# HELP " + Metric.Name + " " + Metric.Help + "\n";
+		Str += "# TYPE " + Metric.Name + (Metric.Type == tMetricType::Counter ? " counter\n" : " gauge\n");
+		for (std::size_t j = i; j < Series.size(); ++j)
+		{
+			const tSeries& Item = Series[j];
+			if (Item.Metric->Name != Metric.Name)
+				continue;
+			Done[j] = true;
+
+			Str += hidden::MakeSeries(Item.Metric->Name, Item.Metric->Labels) + " ";
+			if (Item.Callback)
+				Str += hidden::ToStringValue(Item.Callback());
+			else if (Item.Counter)
+				Str += std::to_string(Item.Counter->Get());
+			else if (Item.Gauge)
+				Str += std::to_string(Item.Gauge->Get());
+			else
+				Str += "0";
+			Str += "\n";
+		}
+	}
+	return Str;
+}
+
+tMetrics::tMetric& tMetrics::GetMetric(std::string_view name, std::string_view help, std::string_view labels, tMetricType type)
+{
+	for (auto& Metric : m_Metrics)
+	{
+		if (Metric->Name == name && Metric->Labels == labels)
+			return *Metric;
+	}
+
+	auto Metric = std::make_unique<tMetric>();
+	Metric->Name = name;
+	Metric->Help = help;
+	Metric->Labels = labels;
+	Metric->Type = type;
+	m_Metrics.push_back(std::move(Metric));
+	return *m_Metrics.back();
+}
+
+tMetricsServer::tMetricsServer(tMetrics& metrics, const std::string& address, std::uint16_t port)
+	:m_Metrics(metrics), m_Acceptor(m_ioc, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(address), port))
+{
+	Accept();
+	m_FutureServer = std::async(std::launch::async, [this]() { m_ioc.run(); });
+}
+
+tMetricsServer::~tMetricsServer()
+{
+	m_ioc.stop();
+	if (m_FutureServer.valid())
+		m_FutureServer.wait();
+}
+
+std::uint16_t tMetricsServer::GetPort() const
+{
+	return m_Acceptor.local_endpoint().port();
+}
+
+void tMetricsServer::Accept()
+{
+	m_Acceptor.async_accept([this](const boost::system::error_code& error, boost::asio::ip::tcp::socket socket)
+		{
+			if (error)
+				return;
+
+			// The request is read up to its end, then the response is written and the connection is closed.
+			// The connection is closed as well if reading or writing takes longer than the timeout.
+			auto Socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(socket));
+			auto Request = std::make_shared<boost::asio::streambuf>(4096);
+			auto Timer = std::make_shared<boost::asio::steady_timer>(m_ioc);
+			auto StartTimeout = [Socket, Timer]()
+				{
+					Timer->expires_after(std::chrono::milliseconds(LIB_SHARE_METRICS_SERVER_TIMEOUT)); // the previous wait is cancelled
+					Timer->async_wait([Socket](const boost::system::error_code& error)
+						{
+							if (error)
+								return;
+							boost::system::error_code Error;
+							Socket->close(Error);
+						});
+				};
+			StartTimeout();
+			boost::asio::async_read_until(*Socket, *Request, "\r\n\r\n", [this, Socket, Request, Timer, StartTimeout](const boost::system::error_code& error, std::size_t size)
+				{
+					if (error)
+					{
+						Timer->cancel();
+						return;
+					}
+					StartTimeout();
+					const std::string Body = m_Metrics.ToPrometheus();
+					auto Response = std::make_shared<std::string>(
+						"HTTP/1.0 200 OK\r\n"
+						"Content-Type: text/plain; version=0.0.4\r\n"
+						"Content-Length: " + std::to_string(Body.size()) + "\r\n"
+						"Connection: close\r\n\r\n" + Body);
+					boost::asio::async_write(*Socket, boost::asio::buffer(*Response), [Socket, Response, Timer](const boost::system::error_code& error, std::size_t size)
+						{
+							Timer->cancel();
+							boost::system::error_code Error;
+							Socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, Error);
+						});
+				});
+
+			Accept();
+		});
+}
+
+tMetricsFile::tMetricsFile(tMetrics& metrics, const std::string& path, std::chrono::milliseconds period)
+	:m_Metrics(metrics), m_Path(path), m_Period(period)
+{
+	m_Thread = std::thread([this]()
+		{
+			std::unique_lock<std::mutex> Lock(m_Mtx);
+			while (!m_Cv.wait_for(Lock, m_Period, [this]() { return m_Stop; }))
+			{
+				Lock.unlock();
+				Write();
+				Lock.lock();
+			}
+		});
+}
+
+tMetricsFile::~tMetricsFile()
+{
+	{
+		std::lock_guard<std::mutex> Lock(m_Mtx);
+		m_Stop = true;
+	}
+	m_Cv.notify_one();
+	m_Thread.join();
+	Write();
+}
+
+void tMetricsFile::Write()
+{
+	const std::string PathTemp = m_Path + ".tmp";
+	{
+		std::ofstream File(PathTemp, std::ios::binary | std::ios::trunc);
+		if (!File.is_open())
+			return;
+		File << m_Metrics.ToPrometheus();
+	}
+	std::error_code Error;
+	std::filesystem::rename(PathTemp, m_Path, Error);
+}
+
+}
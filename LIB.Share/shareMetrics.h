@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareMetrics
+// 2026-10-18
+// C++20
+//
+// Metrics registry: the counters are sharded by the tasks (relaxed atomics, no locks on the hot path),
+// the gauges are atomics, the callbacks are called when the metrics are exported.
+// Export: Prometheus text format (0.0.4) by a tiny HTTP server (tMetricsServer) or by a file rewritten periodically (tMetricsFile).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#ifndef LIB_SHARE_METRICS_SHARD_QTY
+#define LIB_SHARE_METRICS_SHARD_QTY 16
+#endif
+
+#ifndef LIB_SHARE_METRICS_SERVER_TIMEOUT
+#define LIB_SHARE_METRICS_SERVER_TIMEOUT 5000 // [ms] reading of a request, writing of a response
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace share
+{
+namespace hidden
+{
+
+std::size_t GetMetricShard(); // a task gets its shard when it's used first time
+
+}
+
+class tMetricCounter
+{
+	struct alignas(64) tShard
+	{
+		std::atomic<std::uint64_t> Value = 0;
+	};
+
+	std::array<tShard, LIB_SHARE_METRICS_SHARD_QTY> m_Shards;
+
+public:
+	void Add(std::uint64_t value = 1) { m_Shards[hidden::GetMetricShard()].Value.fetch_add(value, std::memory_order_relaxed); }
+	std::uint64_t Get() const;
+};
+
+class tMetricGauge
+{
+	std::atomic<std::int64_t> m_Value = 0;
+
+public:
+	void Set(std::int64_t value) { m_Value.store(value, std::memory_order_relaxed); }
+	void Add(std::int64_t value) { m_Value.fetch_add(value, std::memory_order_relaxed); }
+	std::int64_t Get() const { return m_Value.load(std::memory_order_relaxed); }
+};
+
+enum class tMetricType : std::uint8_t
+{
+	Counter,
+	Gauge,
+};
+
+// A metric is found by its name and labels, so the same metric is returned to all its users.
+// The metrics are not removed, the references are valid until the registry is destroyed.
+class tMetrics
+{
+	struct tMetric
+	{
+		std::string Name;
+		std::string Help;
+		std::string Labels; // type="PUBLISH",dir="in"
+		tMetricType Type = tMetricType::Counter;
+		std::unique_ptr<tMetricCounter> Counter;
+		std::unique_ptr<tMetricGauge> Gauge;
+		std::function<double()> Callback;
+	};
+
+	mutable std::mutex m_Mtx;
+	std::vector<std::unique_ptr<tMetric>> m_Metrics;
+
+public:
+	tMetricCounter& GetCounter(std::string_view name, std::string_view help, std::string_view labels = {});
+	tMetricGauge& GetGauge(std::string_view name, std::string_view help, std::string_view labels = {});
+	void SetCallback(std::string_view name, std::string_view help, std::string_view labels, tMetricType type, std::function<double()> callback); // it's replaced if it's set
+
+	std::string ToPrometheus() const;
+
+private:
+	tMetric& GetMetric(std::string_view name, std::string_view help, std::string_view labels, tMetricType type); // m_Mtx is locked
+};
+
+// GET of any path returns the metrics. It should be bound to the loopback unless the metrics are meant to be public.
+class tMetricsServer
+{
+	tMetrics& m_Metrics;
+	boost::asio::io_context m_ioc;
+	boost::asio::ip::tcp::acceptor m_Acceptor;
+	std::future<void> m_FutureServer;
+
+public:
+	tMetricsServer() = delete;
+	tMetricsServer(tMetrics& metrics, const std::string& address, std::uint16_t port); // port 0 - any
+	tMetricsServer(const tMetricsServer&) = delete;
+	tMetricsServer(tMetricsServer&&) = delete;
+	~tMetricsServer();
+
+	tMetricsServer& operator=(const tMetricsServer&) = delete;
+	tMetricsServer& operator=(tMetricsServer&&) = delete;
+
+	std::uint16_t GetPort() const;
+
+private:
+	void Accept();
+};
+
+// The file is written next to the path and renamed, so a reader never gets a part of it.
+class tMetricsFile
+{
+	tMetrics& m_Metrics;
+	const std::string m_Path;
+	const std::chrono::milliseconds m_Period;
+	std::thread m_Thread;
+	std::mutex m_Mtx;
+	std::condition_variable m_Cv;
+	bool m_Stop = false;
+
+public:
+	tMetricsFile() = delete;
+	tMetricsFile(tMetrics& metrics, const std::string& path, std::chrono::milliseconds period);
+	tMetricsFile(const tMetricsFile&) = delete;
+	tMetricsFile(tMetricsFile&&) = delete;
+	~tMetricsFile();
+
+	tMetricsFile& operator=(const tMetricsFile&) = delete;
+	tMetricsFile& operator=(tMetricsFile&&) = delete;
+
+	void Write();
+};
+
+}
+
+extern share::tMetrics g_Metrics;
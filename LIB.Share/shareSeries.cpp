@@ -0,0 +1,235 @@
+#include "shareSeries.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace share
+{
+namespace hidden
+{
+
+constexpr std::uint8_t SeriesFormat = 0x10; // version 1, the low bits are tSeriesType
+constexpr std::size_t VarintSizeMax = 10;
+constexpr std::uint64_t VarintContinuation8 = 0x8080808080808080ULL;
+
+std::uint64_t ZigZag(std::int64_t value)
+{
+	return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t UnZigZag(std::uint64_t value)
+{
+	return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+void PutVarint(std::vector<std::uint8_t>& dst, std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		dst.push_back(static_cast<std::uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	dst.push_back(static_cast<std::uint8_t>(value));
+}
+
+class tSeriesReader
+{
+	const std::uint8_t* m_Ptr;
+	const std::uint8_t* const m_End;
+
+public:
+	explicit tSeriesReader(std::span<const std::uint8_t> data) :m_Ptr(data.data()), m_End(data.data() + data.size()) {}
+
+	std::size_t GetSize() const { return static_cast<std::size_t>(m_End - m_Ptr); }
+
+	bool Get(std::uint8_t& value)
+	{
+		if (m_Ptr == m_End)
+			return false;
+		value = *m_Ptr++;
+		return true;
+	}
+
+	bool Get(std::span<std::uint8_t> value)
+	{
+		if (GetSize() < value.size())
+			return false;
+		std::memcpy(value.data(), m_Ptr, value.size());
+		m_Ptr += value.size();
+		return true;
+	}
+
+	bool GetVarint(std::uint64_t& value)
+	{
+		value = 0;
+		for (std::size_t i = 0; i < VarintSizeMax && m_Ptr != m_End; ++i)
+		{
+			const std::uint8_t Byte = *m_Ptr++;
+			value |= static_cast<std::uint64_t>(Byte & 0x7F) << (7 * i);
+			if ((Byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// The zigzag varints; eight one-byte varints (the usual case for the deltas) are taken at once (SWAR).
+	bool GetZigZag(std::span<std::int64_t> values)
+	{
+		std::size_t i = 0;
+		while (i < values.size())
+		{
+			if (std::endian::native == std::endian::little && values.size() - i >= 8 && GetSize() >= 8)
+			{
+				std::uint64_t Word;
+				std::memcpy(&Word, m_Ptr, sizeof(Word));
+				if ((Word & VarintContinuation8) == 0)
+				{
+					for (std::size_t j = 0; j < 8; ++j, Word >>= 8)
+						values[i + j] = UnZigZag(Word & 0xFF);
+					m_Ptr += 8;
+					i += 8;
+					continue;
+				}
+			}
+
+			std::uint64_t Value;
+			if (!GetVarint(Value))
+				return false;
+			values[i++] = UnZigZag(Value);
+		}
+		return true;
+	}
+};
+
+std::vector<std::uint8_t> EncodeTime(tSeriesType type, std::span<const std::uint64_t> time)
+{
+	std::vector<std::uint8_t> Payload;
+	Payload.reserve(16 + time.size() * 3);
+	Payload.push_back(SeriesFormat | static_cast<std::uint8_t>(type));
+	PutVarint(Payload, time.size());
+	if (time.empty())
+		return Payload;
+
+	PutVarint(Payload, time[0]);
+	std::int64_t DeltaPrev = 0;
+	for (std::size_t i = 1; i < time.size(); ++i)
+	{
+		const std::int64_t Delta = static_cast<std::int64_t>(time[i] - time[i - 1]);
+		PutVarint(Payload, ZigZag(Delta - DeltaPrev));
+		DeltaPrev = Delta;
+	}
+	return Payload;
+}
+
+}
+
+std::vector<std::uint8_t> EncodeSeries(std::span<const std::uint64_t> time, std::span<const std::int64_t> values)
+{
+	const std::size_t Qty = std::min(time.size(), values.size());
+	std::vector<std::uint8_t> Payload = hidden::EncodeTime(tSeriesType::Integer, time.first(Qty));
+	for (std::size_t i = 0; i < Qty; ++i)
+		hidden::PutVarint(Payload, hidden::ZigZag(i == 0 ? values[0] : static_cast<std::int64_t>(static_cast<std::uint64_t>(values[i]) - static_cast<std::uint64_t>(values[i - 1]))));
+	return Payload;
+}
+
+std::vector<std::uint8_t> EncodeSeries(std::span<const std::uint64_t> time, std::span<const double> values)
+{
+	const std::size_t Qty = std::min(time.size(), values.size());
+	std::vector<std::uint8_t> Payload = hidden::EncodeTime(tSeriesType::Float, time.first(Qty));
+	std::uint64_t Prev = 0;
+	for (std::size_t i = 0; i < Qty; ++i)
+	{
+		const std::uint64_t Value = std::bit_cast<std::uint64_t>(values[i]);
+		if (i == 0)
+		{
+			for (std::size_t j = 0; j < 8; ++j)
+				Payload.push_back(static_cast<std::uint8_t>(Value >> (8 * j)));
+		}
+		else
+		{
+			std::uint64_t Xor = Value ^ Prev;
+			const int Leading = Xor == 0 ? 8 : std::countl_zero(Xor) / 8;
+			const int Trailing = Xor == 0 ? 0 : std::countr_zero(Xor) / 8;
+			const int Size = 8 - Leading - Trailing;
+			Payload.push_back(static_cast<std::uint8_t>((Leading << 4) | Size));
+			Xor >>= 8 * Trailing;
+			for (int j = 0; j < Size; ++j, Xor >>= 8)
+				Payload.push_back(static_cast<std::uint8_t>(Xor));
+		}
+		Prev = Value;
+	}
+	return Payload;
+}
+
+std::optional<tSeries> DecodeSeries(std::span<const std::uint8_t> payload)
+{
+	hidden::tSeriesReader Reader(payload);
+
+	std::uint8_t Format = 0;
+	if (!Reader.Get(Format) || (Format & 0xF0) != hidden::SeriesFormat || (Format & 0x0F) > static_cast<std::uint8_t>(tSeriesType::Float))
+		return {};
+
+	tSeries Series;
+	Series.Type = static_cast<tSeriesType>(Format & 0x0F);
+
+	std::uint64_t Qty = 0;
+	if (!Reader.GetVarint(Qty) || Qty > Reader.GetSize()) // a sample takes one byte at least
+		return {};
+	if (Qty == 0)
+		return Series;
+
+	Series.Time.resize(Qty);
+	std::vector<std::int64_t> Deltas(Qty - 1);
+	if (!Reader.GetVarint(Series.Time[0]) || !Reader.GetZigZag(Deltas))
+		return {};
+	std::int64_t Delta = 0;
+	for (std::size_t i = 1; i < Qty; ++i)
+	{
+		Delta += Deltas[i - 1];
+		Series.Time[i] = Series.Time[i - 1] + static_cast<std::uint64_t>(Delta);
+	}
+
+	if (Series.Type == tSeriesType::Integer)
+	{
+		Series.Integer.resize(Qty);
+		if (!Reader.GetZigZag(Series.Integer))
+			return {};
+		for (std::size_t i = 1; i < Qty; ++i)
+			Series.Integer[i] = static_cast<std::int64_t>(static_cast<std::uint64_t>(Series.Integer[i - 1]) + static_cast<std::uint64_t>(Series.Integer[i]));
+	}
+	else
+	{
+		Series.Float.resize(Qty);
+		std::uint8_t Bytes[8]{};
+		if (!Reader.Get(Bytes))
+			return {};
+		std::uint64_t Value = 0;
+		for (std::size_t j = 8; j > 0; --j)
+			Value = (Value << 8) | Bytes[j - 1];
+		Series.Float[0] = std::bit_cast<double>(Value);
+		for (std::size_t i = 1; i < Qty; ++i)
+		{
+			std::uint8_t Control = 0;
+			if (!Reader.Get(Control))
+				return {};
+			const int Leading = Control >> 4;
+			const int Size = Control & 0x0F;
+			if (Leading + Size > 8 || !Reader.Get(std::span<std::uint8_t>(Bytes, Size)))
+				return {};
+			std::uint64_t Xor = 0;
+			for (int j = Size; j > 0; --j)
+				Xor = (Xor << 8) | Bytes[j - 1];
+			if (Size > 0)
+				Value ^= Xor << (8 * (8 - Leading - Size));
+			Series.Float[i] = std::bit_cast<double>(Value);
+		}
+	}
+
+	if (Reader.GetSize() != 0)
+		return {};
+
+	return Series;
+}
+
+}
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareSeries
+// 2026-10-18
+// C++20
+//
+// Payload codec for numeric time series (sensor samples): a batch of samples is published as one message.
+// The columns are byte-aligned: the timestamps are delta-of-delta varints (1 byte for a regular period),
+// the integers are delta varints, the floating-point values are XOR-ed with the previous ones (Gorilla),
+// the zero bytes on both sides of the XOR are not sent.
+//
+// Payload: format (1), count (varint), first timestamp [ms] (varint), count - 1 delta-of-delta timestamps (zigzag varints), the values.
+// Integer: first value (zigzag varint), count - 1 deltas (zigzag varints).
+// Float: first value (8, little-endian), count - 1 records: leading zero bytes (high 4 bits) and the number of the bytes
+// which follow (low 4 bits), the bytes of the XOR from the lowest one which is not zero.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace share
+{
+
+enum class tSeriesType : std::uint8_t
+{
+	Integer,
+	Float,
+};
+
+struct tSeries
+{
+	tSeriesType Type = tSeriesType::Integer;
+	std::vector<std::uint64_t> Time; // [ms]
+	std::vector<std::int64_t> Integer; // tSeriesType::Integer
+	std::vector<double> Float; // tSeriesType::Float
+
+	std::size_t size() const { return Time.size(); }
+};
+
+std::vector<std::uint8_t> EncodeSeries(std::span<const std::uint64_t> time, std::span<const std::int64_t> values);
+std::vector<std::uint8_t> EncodeSeries(std::span<const std::uint64_t> time, std::span<const double> values);
+std::optional<tSeries> DecodeSeries(std::span<const std::uint8_t> payload); // no value if it's not a series or it's corrupted
+
+// The samples are collected until the batch is full.
+template<typename T>
+class tSeriesBatch
+{
+	const std::size_t m_Qty;
+	std::vector<std::uint64_t> m_Time;
+	std::vector<T> m_Values;
+
+public:
+	explicit tSeriesBatch(std::size_t qty) :m_Qty(qty) {}
+
+	bool Add(std::uint64_t time, T value) // returns true if the batch is full
+	{
+		m_Time.push_back(time);
+		m_Values.push_back(value);
+		return m_Time.size() >= m_Qty;
+	}
+
+	std::vector<std::uint8_t> Take() // the batch is encoded and cleared
+	{
+		std::vector<std::uint8_t> Payload = EncodeSeries(m_Time, m_Values);
+		m_Time.clear();
+		m_Values.clear();
+		return Payload;
+	}
+
+	bool empty() const { return m_Time.empty(); }
+	std::size_t size() const { return m_Time.size(); }
+};
+
+}
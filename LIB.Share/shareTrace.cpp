@@ -0,0 +1,255 @@
+#include "shareTrace.h"
+
+#include <cstdio>
+#include <fstream>
+
+share::tTracer g_Trace;
+
+namespace share
+{
+namespace hidden
+{
+
+void AppendJSONString(std::string& str, std::string_view value)
+{
+	str += '"';
+	for (char Ch : value)
+	{
+		switch (Ch)
+		{
+		case '"': str += "\\\""; break;
+		case '\\': str += "\\\\"; break;
+		case '\n': str += "\\n"; break;
+		case '\r': str += "\\r"; break;
+		case '\t': str += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(Ch) < 0x20)
+			{
+				char Esc[8];
+				std::snprintf(Esc, sizeof(Esc), "\\u%04x", static_cast<unsigned int>(Ch));
+				str += Esc;
+			}
+			else
+			{
+				str += Ch;
+			}
+			break;
+		}
+	}
+	str += '"';
+}
+
+void AppendTime(std::string& str, std::int64_t time) // [ns] -> [us]
+{
+	char Time[32];
+	std::snprintf(Time, sizeof(Time), "%lld.%03lld", static_cast<long long>(time / 1000), static_cast<long long>(time % 1000));
+	str += Time;
+}
+
+constexpr std::size_t TraceChunkSize = LIB_SHARE_TRACE_CHUNK_SIZE;
+
+void AppendEvent(std::string& str, const std::string& tid, const tTraceEvent& event)
+{
+	str += ",\n{\"ph\":\"X\",\"cat\":";
+	AppendJSONString(str, event.Category);
+	str += ",\"name\":";
+	AppendJSONString(str, event.Name);
+	str += ",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+	AppendTime(str, event.Start);
+	str += ",\"dur\":";
+	AppendTime(str, event.Duration);
+	if (!event.Args.empty())
+		str += ",\"args\":{" + event.Args + "}";
+	str += "}";
+}
+
+tTraceBuffer::tTraceBuffer(std::size_t capacity, std::uint32_t threadId)
+	:m_Chunks(std::make_unique<std::unique_ptr<tTraceEvent[]>[]>((capacity + TraceChunkSize - 1) / TraceChunkSize)), m_Capacity(capacity), m_ThreadId(threadId)
+{
+}
+
+void tTraceBuffer::Push(tTraceEvent&& event)
+{
+	const std::size_t Size = m_Size.load(std::memory_order_relaxed);
+	if (Size >= m_Capacity)
+	{
+		Drop();
+		return;
+	}
+	std::unique_ptr<tTraceEvent[]>& Chunk = m_Chunks[Size / TraceChunkSize];
+	if (!Chunk)
+		Chunk = std::make_unique<tTraceEvent[]>(TraceChunkSize); // it's published with the event by m_Size
+	Chunk[Size % TraceChunkSize] = std::move(event);
+	m_Size.store(Size + 1, std::memory_order_release);
+}
+
+const tTraceEvent& tTraceBuffer::operator[](std::size_t index) const
+{
+	return m_Chunks[index / TraceChunkSize][index % TraceChunkSize];
+}
+
+std::atomic<std::uint64_t> TracerIdNext = 0;
+
+}
+
+tTracer::tTracer()
+	:m_Id(++hidden::TracerIdNext)
+{
+}
+
+tTracer::~tTracer()
+{
+	if (!m_PathOnExit.empty())
+		Write(m_PathOnExit);
+}
+
+void tTracer::Enable(const std::string& pathOnExit)
+{
+	{
+		std::lock_guard<std::mutex> Lock(m_Mtx);
+		m_PathOnExit = pathOnExit;
+	}
+	m_Enabled = true;
+}
+
+void tTracer::Disable()
+{
+	m_Enabled = false;
+}
+
+bool tTracer::Write(const std::string& path) const
+{
+	std::vector<std::shared_ptr<hidden::tTraceBuffer>> Buffers;
+	std::vector<std::shared_ptr<const hidden::tTraceEvents>> EventsOfExited;
+	{
+		std::lock_guard<std::mutex> Lock(m_Mtx);
+		Buffers = m_Buffers;
+		EventsOfExited = m_EventsOfExited;
+	}
+
+	std::ofstream File(path, std::ios::binary | std::ios::trunc);
+	if (!File.is_open())
+		return false;
+
+	std::string Str = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool First = true;
+	auto WriteTask = [&](std::uint32_t threadId, std::size_t size, const auto& getEvent, std::uint64_t droppedQty)
+	{
+		const std::string Tid = std::to_string(threadId);
+		Str += First ? "" : ",\n";
+		First = false;
+		Str += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + Tid + ",\"args\":{\"name\":\"task " + Tid + "\"}}";
+
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hidden::AppendEvent(Str, Tid, getEvent(i));
+
+			if (Str.size() >= 64 * 1024)
+			{
+				File << Str;
+				Str.clear();
+			}
+		}
+		if (droppedQty > 0)
+			Str += ",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"dropped " + std::to_string(droppedQty) + " events\",\"pid\":1,\"tid\":" + Tid + ",\"ts\":0}";
+	};
+	for (const auto& Events : EventsOfExited)
+		WriteTask(Events->ThreadId, Events->Events.size(), [&](std::size_t i) -> const hidden::tTraceEvent& { return Events->Events[i]; }, Events->DroppedQty);
+	for (const auto& Buffer : Buffers)
+		WriteTask(Buffer->GetThreadId(), Buffer->GetSize(), [&](std::size_t i) -> const hidden::tTraceEvent& { return (*Buffer)[i]; }, Buffer->GetDroppedQty());
+	Str += "\n]}\n";
+	File << Str;
+	return static_cast<bool>(File);
+}
+
+std::int64_t tTracer::GetTime() const
+{
+	return (utils::chrono::tClockCycles::now() - m_TimeStart).count();
+}
+
+void tTracer::Record(hidden::tTraceEvent&& event)
+{
+	hidden::tTraceBuffer* Buffer = GetBuffer();
+	if (m_EventQty.fetch_add(1, std::memory_order_relaxed) >= LIB_SHARE_TRACE_EVENTS_MAX)
+	{
+		Buffer->Drop();
+		return;
+	}
+	Buffer->Push(std::move(event));
+}
+
+hidden::tTraceBuffer* tTracer::GetBuffer()
+{
+	// The buffer is closed when its task exits, it's released by the tracer then (a task of a transaction is short-lived).
+	struct tBufferOfThread
+	{
+		std::uint64_t TracerId = 0;
+		std::shared_ptr<hidden::tTraceBuffer> Buffer;
+
+		~tBufferOfThread()
+		{
+			if (Buffer)
+				Buffer->Close();
+		}
+	};
+	thread_local tBufferOfThread BufferOfThread;
+
+	if (BufferOfThread.TracerId != m_Id)
+	{
+		if (BufferOfThread.Buffer)
+			BufferOfThread.Buffer->Close();
+
+		std::lock_guard<std::mutex> Lock(m_Mtx);
+		CompactBuffers();
+		auto Buffer = std::make_shared<hidden::tTraceBuffer>(LIB_SHARE_TRACE_BUFFER_SIZE, ++m_ThreadIdLast);
+		m_Buffers.push_back(Buffer);
+		BufferOfThread.TracerId = m_Id;
+		BufferOfThread.Buffer = std::move(Buffer);
+	}
+	return BufferOfThread.Buffer.get();
+}
+
+void tTracer::CompactBuffers()
+{
+	// The events are copied, not moved: Write(..) can be reading the buffer, it keeps the buffer alive until it's done.
+	std::erase_if(m_Buffers, [this](const std::shared_ptr<hidden::tTraceBuffer>& buffer)
+		{
+			if (!buffer->IsClosed())
+				return false;
+			const std::size_t Size = buffer->GetSize();
+			if (Size > 0 || buffer->GetDroppedQty() > 0)
+			{
+				auto Events = std::make_shared<hidden::tTraceEvents>();
+				Events->ThreadId = buffer->GetThreadId();
+				Events->Events.reserve(Size);
+				for (std::size_t i = 0; i < Size; ++i)
+					Events->Events.push_back((*buffer)[i]);
+				Events->DroppedQty = buffer->GetDroppedQty();
+				m_EventsOfExited.push_back(std::move(Events));
+			}
+			return true;
+		});
+}
+
+void tTraceSpan::AddArg(std::string_view key, std::string_view value)
+{
+	if (!IsActive())
+		return;
+	if (!m_Args.empty())
+		m_Args += ',';
+	hidden::AppendJSONString(m_Args, key);
+	m_Args += ':';
+	hidden::AppendJSONString(m_Args, value);
+}
+
+void tTraceSpan::AddArg(std::string_view key, std::int64_t value)
+{
+	if (!IsActive())
+		return;
+	if (!m_Args.empty())
+		m_Args += ',';
+	hidden::AppendJSONString(m_Args, key);
+	m_Args += ':' + std::to_string(value);
+}
+
+}
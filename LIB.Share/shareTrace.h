@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareTrace
+// 2026-10-18
+// C++20
+//
+// Tracing: a span (tTraceSpan) is recorded as a complete event into the buffer of its task when it's finished,
+// the spans of a task are nested by their time. The buffers are written as Chrome trace_event JSON (Perfetto, chrome://tracing).
+// Nothing is recorded unless the tracing is enabled, a span costs a relaxed load then.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#ifndef LIB_SHARE_TRACE_BUFFER_SIZE
+#define LIB_SHARE_TRACE_BUFFER_SIZE 65536 // events of a task, the events above are dropped
+#endif
+
+#ifndef LIB_SHARE_TRACE_CHUNK_SIZE
+#define LIB_SHARE_TRACE_CHUNK_SIZE 256 // events, the buffer of a task is allocated by chunks when they are needed
+#endif
+
+#ifndef LIB_SHARE_TRACE_EVENTS_MAX
+#define LIB_SHARE_TRACE_EVENTS_MAX 1048576 // events of all the tasks, the events above are dropped
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <utilsChrono.h>
+
+namespace share
+{
+namespace hidden
+{
+
+struct tTraceEvent
+{
+	const char* Category = nullptr; // string literals
+	const char* Name = nullptr;
+	std::int64_t Start = 0; // [ns] since the tracer has been created
+	std::int64_t Duration = 0;
+	std::string Args; // "key":value,... (JSON)
+};
+
+// It is written by its task only (single producer), the events are published by m_Size, so it is read without locks.
+// The chunks are allocated when they are needed and they aren't moved, so the published events stay in place.
+class tTraceBuffer
+{
+	std::unique_ptr<std::unique_ptr<tTraceEvent[]>[]> m_Chunks;
+	const std::size_t m_Capacity;
+	std::atomic<std::size_t> m_Size = 0;
+	std::atomic<std::uint64_t> m_DroppedQty = 0;
+	std::atomic<bool> m_Closed = false; // its task has exited
+	const std::uint32_t m_ThreadId;
+
+public:
+	tTraceBuffer(std::size_t capacity, std::uint32_t threadId);
+
+	void Push(tTraceEvent&& event);
+	void Drop() { m_DroppedQty.fetch_add(1, std::memory_order_relaxed); }
+	void Close() { m_Closed.store(true, std::memory_order_release); }
+
+	std::size_t GetSize() const { return m_Size.load(std::memory_order_acquire); }
+	const tTraceEvent& operator[](std::size_t index) const;
+	std::uint64_t GetDroppedQty() const { return m_DroppedQty; }
+	std::uint32_t GetThreadId() const { return m_ThreadId; }
+	bool IsClosed() const { return m_Closed.load(std::memory_order_acquire); }
+};
+
+// The events of an exited task, they are copied out of its buffer, so the buffer is released.
+struct tTraceEvents
+{
+	std::uint32_t ThreadId = 0;
+	std::vector<tTraceEvent> Events;
+	std::uint64_t DroppedQty = 0;
+};
+
+}
+
+class tTracer
+{
+	const std::uint64_t m_Id; // the buffers of a task are found by it
+	const utils::chrono::tClockCycles::time_point m_TimeStart = utils::chrono::tClockCycles::now();
+	std::atomic<bool> m_Enabled = false;
+	std::atomic<std::size_t> m_EventQty = 0;
+	mutable std::mutex m_Mtx;
+	std::vector<std::shared_ptr<hidden::tTraceBuffer>> m_Buffers; // of the running tasks, the buffers of the exited tasks are compacted into m_EventsOfExited
+	std::vector<std::shared_ptr<const hidden::tTraceEvents>> m_EventsOfExited;
+	std::uint32_t m_ThreadIdLast = 0;
+	std::string m_PathOnExit;
+
+public:
+	tTracer();
+	tTracer(const tTracer&) = delete;
+	tTracer(tTracer&&) = delete;
+	~tTracer();
+
+	tTracer& operator=(const tTracer&) = delete;
+	tTracer& operator=(tTracer&&) = delete;
+
+	void Enable(const std::string& pathOnExit = {}); // the trace is written to the file when the tracer is destroyed
+	void Disable();
+	bool IsEnabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+
+	bool Write(const std::string& path) const; // the events recorded so far, it can be called while the spans are recorded
+
+	std::int64_t GetTime() const; // [ns]
+	void Record(hidden::tTraceEvent&& event);
+
+private:
+	hidden::tTraceBuffer* GetBuffer();
+	void CompactBuffers(); // under m_Mtx
+};
+
+}
+
+extern share::tTracer g_Trace;
+
+namespace share
+{
+
+// share::tTraceSpan Span("mqtt", "Transaction"); // the category and the name are string literals
+// if (Span.IsActive()) Span.AddArg("type", mqtt::ToString(packType));
+class tTraceSpan
+{
+	const char* m_Category = nullptr; // it's not set if the tracing is disabled
+	const char* m_Name = nullptr;
+	std::int64_t m_Start = 0;
+	std::string m_Args;
+
+public:
+	tTraceSpan(const char* category, const char* name)
+	{
+		if (!g_Trace.IsEnabled())
+			return;
+		m_Category = category;
+		m_Name = name;
+		m_Start = g_Trace.GetTime();
+	}
+	tTraceSpan(const tTraceSpan&) = delete;
+	tTraceSpan(tTraceSpan&&) = delete;
+	~tTraceSpan()
+	{
+		if (!IsActive())
+			return;
+		g_Trace.Record({ m_Category, m_Name, m_Start, g_Trace.GetTime() - m_Start, std::move(m_Args) });
+	}
+
+	tTraceSpan& operator=(const tTraceSpan&) = delete;
+	tTraceSpan& operator=(tTraceSpan&&) = delete;
+
+	bool IsActive() const { return m_Category != nullptr; }
+
+	void AddArg(std::string_view key, std::string_view value);
+	void AddArg(std::string_view key, std::int64_t value);
+};
+
+}
@@ -0,0 +1,307 @@
+#include "shareTransport.h"
+#include "shareLog.h"
+
+#include <algorithm>
+
+namespace share
+{
+
+#ifdef LIB_SHARE_MQTT_TLS
+namespace hidden
+{
+// The app data (ex_data index 0) of SSL and SSL_CTX is used by boost::asio::ssl.
+int GetExDataIndexContextTLS()
+{
+	static const int Index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+	return Index;
+}
+
+int GetExDataIndexSessionKeyTLS()
+{
+	static const int Index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+	return Index;
+}
+}
+
+tContextTLS::tContextTLS(bool verifyPeer)
+	:m_Context(boost::asio::ssl::context::tls_client), m_VerifyPeer(verifyPeer)
+{
+	m_Context.set_options(boost::asio::ssl::context::default_workarounds | boost::asio::ssl::context::no_sslv2 | boost::asio::ssl::context::no_sslv3 | boost::asio::ssl::context::no_tlsv1 | boost::asio::ssl::context::no_tlsv1_1);
+	m_Context.set_verify_mode(m_VerifyPeer ? boost::asio::ssl::verify_peer : boost::asio::ssl::verify_none);
+	if (m_VerifyPeer)
+		m_Context.set_default_verify_paths();
+
+	// The sessions are kept here, not in the internal cache of OpenSSL (it is not used by clients).
+	// TLS 1.3 tickets are received after the handshake, so the callback is the only way to get them.
+	SSL_CTX* Ctx = m_Context.native_handle();
+	SSL_CTX_set_ex_data(Ctx, hidden::GetExDataIndexContextTLS(), this);
+	SSL_CTX_set_session_cache_mode(Ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(Ctx, &tContextTLS::OnNewSession);
+}
+
+tContextTLS::tContextTLS(bool verifyPeer, const std::string& caFile)
+	:tContextTLS(verifyPeer)
+{
+	m_Context.load_verify_file(caFile);
+}
+
+std::shared_ptr<SSL_SESSION> tContextTLS::GetSession(const std::string& key) const
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	auto It = m_Sessions.find(key);
+	if (It == m_Sessions.end())
+		return {};
+	return It->second;
+}
+
+void tContextTLS::ClearSessions()
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	m_Sessions.clear();
+}
+
+int tContextTLS::OnNewSession(SSL* ssl, SSL_SESSION* session)
+{
+	auto Context = static_cast<tContextTLS*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), hidden::GetExDataIndexContextTLS()));
+	auto Key = static_cast<const std::string*>(SSL_get_ex_data(ssl, hidden::GetExDataIndexSessionKeyTLS()));
+	if (!Context || !Key)
+		return 0;
+
+	std::lock_guard<std::mutex> Lock(Context->m_Mtx);
+	Context->m_Sessions[*Key] = std::shared_ptr<SSL_SESSION>(session, SSL_SESSION_free);
+	return 1; // the session is owned by the cache now
+}
+#endif // LIB_SHARE_MQTT_TLS
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace hidden
+{
+
+template<class TSocket, class TEndpoints>
+utils::chrono::ttime_us Connect(TSocket& socket, const TEndpoints& endpoints)
+{
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	boost::asio::connect(socket, endpoints);
+	return std::chrono::duration_cast<utils::chrono::ttime_us>(utils::chrono::tClock::now() - TimeStart);
+}
+
+}
+
+tTransportTCP::tTransportTCP(boost::asio::io_context& ioc, std::string_view host, std::string_view service)
+	:tTransportSocket(ioc)
+{
+	boost::asio::ip::tcp::resolver Resolver(ioc);
+	m_Stats.ConnectTime = hidden::Connect(m_Socket, Resolver.resolve(host, service));
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+tTransportUnix::tTransportUnix(boost::asio::io_context& ioc, const std::string& path)
+	:tTransportSocket(ioc)
+{
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	m_Socket.connect(boost::asio::local::stream_protocol::endpoint(path));
+	m_Stats.ConnectTime = std::chrono::duration_cast<utils::chrono::ttime_us>(utils::chrono::tClock::now() - TimeStart);
+}
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef LIB_SHARE_MQTT_TLS
+tTransportTLS::tTransportTLS(boost::asio::io_context& ioc, std::shared_ptr<tContextTLS> context, std::string_view host, std::string_view service)
+	:m_ioc(ioc), m_Context(context), m_Socket(ioc), m_SessionKey(std::string(host) + ":" + std::string(service)), m_Stream(m_Socket, context->GetContext())
+{
+	boost::asio::ip::tcp::resolver Resolver(ioc);
+	m_Stats.ConnectTime = hidden::Connect(m_Socket, Resolver.resolve(host, service));
+	Handshake(host);
+}
+
+void tTransportTLS::Handshake(std::string_view host)
+{
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+
+	const std::string Host(host);
+	SSL* Ssl = m_Stream.native_handle();
+	SSL_set_tlsext_host_name(Ssl, Host.c_str()); // SNI
+	SSL_set_ex_data(Ssl, hidden::GetExDataIndexSessionKeyTLS(), &m_SessionKey); // for tContextTLS::OnNewSession(..)
+	if (m_Context->IsVerifyPeer())
+		m_Stream.set_verify_callback(boost::asio::ssl::host_name_verification(Host));
+
+	std::shared_ptr<SSL_SESSION> Session = m_Context->GetSession(m_SessionKey);
+	if (Session)
+		SSL_set_session(Ssl, Session.get());
+
+	m_Stream.handshake(boost::asio::ssl::stream_base::client);
+
+	m_Stats.HandshakeTimeTLS = std::chrono::duration_cast<utils::chrono::ttime_us>(utils::chrono::tClock::now() - TimeStart);
+	m_Stats.SessionResumedTLS = SSL_session_reused(Ssl) == 1;
+
+	if (g_Log.IsEnabled(tLogCategory::Measure))
+		g_Log.MeasureDuration("TLS handshake: " + std::to_string(m_Stats.HandshakeTimeTLS.count()) + " us" + (m_Stats.SessionResumedTLS ? ", session resumed" : ""));
+}
+
+void tTransportTLS::AsyncReadSome(boost::asio::mutable_buffer buffer, tReadHandler handler)
+{
+	m_Stream.async_read_some(buffer, std::move(handler));
+}
+
+void tTransportTLS::Write(boost::asio::const_buffer buffer)
+{
+	if (m_ioc.get_executor().running_in_this_thread())
+	{
+		boost::asio::write(m_Stream, buffer);
+		return;
+	}
+
+	// The TLS stream is not thread safe (the receiver task reads it), so the data is written by the task running the io_context.
+	auto Promise = std::make_shared<std::promise<void>>();
+	std::future<void> Future = Promise->get_future();
+	boost::asio::post(m_ioc, [this, buffer, Promise]()
+		{
+			try
+			{
+				boost::asio::write(m_Stream, buffer);
+				Promise->set_value();
+			}
+			catch (...)
+			{
+				Promise->set_exception(std::current_exception());
+			}
+		});
+	while (Future.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
+	{
+		if (m_ioc.stopped())
+			throw boost::system::system_error(boost::asio::error::not_connected);
+	}
+	Future.get();
+}
+
+void tTransportTLS::AsyncWrite(const tBuffers& buffers, tWriteHandler handler)
+{
+	boost::asio::async_write(m_Stream, buffers, std::move(handler));
+}
+
+void tTransportTLS::Close()
+{
+	// The connection is closed deliberately (the server closes it after DISCONNECT as well), so close_notify is not awaited.
+	// OpenSSL makes the session not resumable if it is freed without the shutdown flag being set.
+	SSL_set_shutdown(m_Stream.native_handle(), SSL_SENT_SHUTDOWN);
+	boost::system::error_code Error;
+	m_Socket.close(Error);
+}
+#endif // LIB_SHARE_MQTT_TLS
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+tTransportMemory::tTransportMemory(boost::asio::io_context& ioc, std::shared_ptr<tMemoryPipe> pipe, tMemoryPipe::tEnd end)
+	:m_ioc(ioc), m_Pipe(pipe), m_End(end)
+{
+}
+
+tTransportMemory::~tTransportMemory()
+{
+	std::lock_guard<std::mutex> Lock(m_Pipe->m_Mtx);
+	GetChannelIn().Closed = true;
+	GetChannelIn().ReadHandler = nullptr; // the io_context is not run any more
+	GetChannelOut().Closed = true;
+	CompleteRead(GetChannelOut(), boost::asio::error::eof);
+}
+
+void tTransportMemory::AsyncReadSome(boost::asio::mutable_buffer buffer, tReadHandler handler)
+{
+	std::lock_guard<std::mutex> Lock(m_Pipe->m_Mtx);
+	tMemoryPipe::tChannel& Channel = GetChannelIn();
+	Channel.ReadBuffer = buffer;
+	// The pending reading is outstanding work of the io_context like for the sockets, otherwise the io_context might be stopped.
+	Channel.ReadHandler = [Work = boost::asio::make_work_guard(m_ioc), Handler = std::move(handler)](const boost::system::error_code& error, std::size_t size)
+		{
+			Handler(error, size);
+		};
+	Channel.ReadContext = &m_ioc;
+	if (!Channel.Data.empty())
+	{
+		CompleteRead(Channel, {});
+	}
+	else if (Channel.Closed)
+	{
+		CompleteRead(Channel, boost::asio::error::eof);
+	}
+}
+
+void tTransportMemory::Write(boost::asio::const_buffer buffer)
+{
+	std::lock_guard<std::mutex> Lock(m_Pipe->m_Mtx);
+	tMemoryPipe::tChannel& Channel = GetChannelOut();
+	if (Channel.Closed)
+		throw boost::system::system_error(boost::asio::error::broken_pipe);
+
+	const auto Data = static_cast<const std::uint8_t*>(buffer.data());
+	Channel.Data.insert(Channel.Data.end(), Data, Data + buffer.size());
+	CompleteRead(Channel, {});
+}
+
+void tTransportMemory::AsyncWrite(const tBuffers& buffers, tWriteHandler handler)
+{
+	boost::system::error_code Error;
+	std::size_t Size = 0;
+	{
+		std::lock_guard<std::mutex> Lock(m_Pipe->m_Mtx);
+		tMemoryPipe::tChannel& Channel = GetChannelOut();
+		if (Channel.Closed)
+		{
+			Error = boost::asio::error::broken_pipe;
+		}
+		else
+		{
+			for (const auto& Buffer : buffers)
+			{
+				const auto Data = static_cast<const std::uint8_t*>(Buffer.data());
+				Channel.Data.insert(Channel.Data.end(), Data, Data + Buffer.size());
+				Size += Buffer.size();
+			}
+			CompleteRead(Channel, {});
+		}
+	}
+	boost::asio::post(m_ioc, [Handler = std::move(handler), Error, Size]()
+		{
+			Handler(Error, Size);
+		});
+}
+
+void tTransportMemory::Close()
+{
+	std::lock_guard<std::mutex> Lock(m_Pipe->m_Mtx);
+	GetChannelIn().Closed = true;
+	CompleteRead(GetChannelIn(), boost::asio::error::operation_aborted);
+	GetChannelOut().Closed = true;
+	CompleteRead(GetChannelOut(), boost::asio::error::eof);
+}
+
+bool tTransportMemory::IsOpen() const
+{
+	std::lock_guard<std::mutex> Lock(m_Pipe->m_Mtx);
+	return !m_Pipe->m_Channels[static_cast<std::size_t>(m_End)].Closed;
+}
+
+void tTransportMemory::CompleteRead(tMemoryPipe::tChannel& channel, const boost::system::error_code& error)
+{
+	if (!channel.ReadHandler)
+		return;
+
+	std::size_t Size = 0;
+	if (!error)
+	{
+		Size = std::min(channel.ReadBuffer.size(), channel.Data.size());
+		std::copy_n(channel.Data.begin(), Size, static_cast<std::uint8_t*>(channel.ReadBuffer.data()));
+		channel.Data.erase(channel.Data.begin(), channel.Data.begin() + Size);
+	}
+
+	// The handler is never called from within AsyncReadSome(..) or Write(..), it is called by the task running the io_context.
+	boost::asio::post(*channel.ReadContext, [Handler = std::move(channel.ReadHandler), error, Size]()
+		{
+			Handler(error, Size);
+		});
+	channel.ReadHandler = nullptr;
+}
+
+}
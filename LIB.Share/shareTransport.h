@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareTransport
+// 2026-10-18
+// C++20
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#ifdef LIB_SHARE_MQTT_TLS
+#include <boost/asio/ssl.hpp>
+#endif // LIB_SHARE_MQTT_TLS
+
+#include <utilsChrono.h>
+
+namespace share
+{
+
+#ifdef LIB_SHARE_MQTT_TLS
+// The context is shared by the connections, so the TLS session established by one connection is resumed
+// by the next one to the same server (abbreviated handshake: session ID in TLS 1.2, session ticket in TLS 1.3).
+class tContextTLS
+{
+	boost::asio::ssl::context m_Context;
+	const bool m_VerifyPeer;
+	std::map<std::string, std::shared_ptr<SSL_SESSION>> m_Sessions; // host:service
+	mutable std::mutex m_Mtx;
+
+public:
+	tContextTLS() = delete;
+	explicit tContextTLS(bool verifyPeer);
+	tContextTLS(bool verifyPeer, const std::string& caFile);
+	tContextTLS(const tContextTLS&) = delete;
+	tContextTLS(tContextTLS&&) = delete;
+
+	tContextTLS& operator=(const tContextTLS&) = delete;
+	tContextTLS& operator=(tContextTLS&&) = delete;
+
+	boost::asio::ssl::context& GetContext() { return m_Context; }
+	bool IsVerifyPeer() const { return m_VerifyPeer; }
+
+	std::shared_ptr<SSL_SESSION> GetSession(const std::string& key) const;
+	void ClearSessions();
+
+private:
+	static int OnNewSession(SSL* ssl, SSL_SESSION* session);
+};
+#endif // LIB_SHARE_MQTT_TLS
+
+struct tConnectionStats
+{
+	utils::chrono::ttime_us ConnectTime{};
+	utils::chrono::ttime_us HandshakeTimeTLS{};
+	bool SessionResumedTLS = false;
+};
+
+// The transport is bound to the io_context of the connection.
+// Reading is done by the task running the io_context, writing is done by any task.
+class tTransport
+{
+protected:
+	tConnectionStats m_Stats;
+
+public:
+	using tReadHandler = std::function<void(const boost::system::error_code& error, std::size_t size)>;
+	using tWriteHandler = tReadHandler;
+	using tBuffers = std::vector<boost::asio::const_buffer>;
+
+	virtual ~tTransport() = default;
+
+	virtual void AsyncReadSome(boost::asio::mutable_buffer buffer, tReadHandler handler) = 0;
+	virtual void Write(boost::asio::const_buffer buffer) = 0; // blocking, thread safe
+	// Gather write, it's called within the io_context. The buffers shall be kept until the handler is called, the next writing is started after that.
+	virtual void AsyncWrite(const tBuffers& buffers, tWriteHandler handler) = 0;
+	virtual void Close() = 0; // it's called within the io_context, the pending reading is aborted
+	virtual bool IsOpen() const = 0;
+
+	const tConnectionStats& GetStats() const { return m_Stats; }
+};
+
+using tTransportFactory = std::function<std::unique_ptr<tTransport>(boost::asio::io_context& ioc)>;
+
+template<class TSocket>
+class tTransportSocket : public tTransport
+{
+protected:
+	TSocket m_Socket;
+	std::mutex m_WriteMtx; // PINGREQ and the responses are sent by the receiver task, the requests are sent by the client task
+
+public:
+	explicit tTransportSocket(boost::asio::io_context& ioc)
+		:m_Socket(ioc)
+	{
+	}
+	explicit tTransportSocket(TSocket&& socket) // accepted by the server
+		:m_Socket(std::move(socket))
+	{
+	}
+
+	void AsyncReadSome(boost::asio::mutable_buffer buffer, tReadHandler handler) override
+	{
+		m_Socket.async_read_some(buffer, std::move(handler));
+	}
+
+	void Write(boost::asio::const_buffer buffer) override
+	{
+		std::lock_guard<std::mutex> Lock(m_WriteMtx);
+		boost::asio::write(m_Socket, buffer);
+	}
+
+	void AsyncWrite(const tBuffers& buffers, tWriteHandler handler) override
+	{
+		boost::asio::async_write(m_Socket, buffers, std::move(handler));
+	}
+
+	void Close() override
+	{
+		boost::system::error_code Error;
+		m_Socket.close(Error);
+	}
+
+	bool IsOpen() const override { return m_Socket.is_open(); }
+};
+
+class tTransportTCP : public tTransportSocket<boost::asio::ip::tcp::socket>
+{
+public:
+	tTransportTCP(boost::asio::io_context& ioc, std::string_view host, std::string_view service);
+	explicit tTransportTCP(boost::asio::ip::tcp::socket&& socket) :tTransportSocket(std::move(socket)) {}
+};
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+// AF_UNIX stream socket, for the broker running on the same host.
+class tTransportUnix : public tTransportSocket<boost::asio::local::stream_protocol::socket>
+{
+public:
+	tTransportUnix(boost::asio::io_context& ioc, const std::string& path);
+	explicit tTransportUnix(boost::asio::local::stream_protocol::socket&& socket) :tTransportSocket(std::move(socket)) {}
+};
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+#ifdef LIB_SHARE_MQTT_TLS
+class tTransportTLS : public tTransport
+{
+	boost::asio::io_context& m_ioc;
+	std::shared_ptr<tContextTLS> m_Context;
+	boost::asio::ip::tcp::socket m_Socket;
+	std::string m_SessionKey;
+	boost::asio::ssl::stream<boost::asio::ip::tcp::socket&> m_Stream;
+
+public:
+	tTransportTLS(boost::asio::io_context& ioc, std::shared_ptr<tContextTLS> context, std::string_view host, std::string_view service);
+
+	void AsyncReadSome(boost::asio::mutable_buffer buffer, tReadHandler handler) override;
+	void Write(boost::asio::const_buffer buffer) override;
+	void AsyncWrite(const tBuffers& buffers, tWriteHandler handler) override;
+	void Close() override;
+	bool IsOpen() const override { return m_Socket.is_open(); }
+
+private:
+	void Handshake(std::string_view host);
+};
+#endif // LIB_SHARE_MQTT_TLS
+
+// In-process loopback: the data written to one end is read from the other one, there is no kernel networking in between.
+// It is shared by both ends, each end is bound to the io_context of its owner.
+class tMemoryPipe
+{
+	friend class tTransportMemory;
+
+public:
+	enum class tEnd : std::uint8_t
+	{
+		Client,
+		Server,
+	};
+
+private:
+	struct tChannel // it is read by one end and written by the other one
+	{
+		std::deque<std::uint8_t> Data;
+		bool Closed = false;
+		boost::asio::mutable_buffer ReadBuffer;
+		tTransport::tReadHandler ReadHandler; // pending reading
+		boost::asio::io_context* ReadContext = nullptr;
+	};
+
+	std::mutex m_Mtx;
+	std::array<tChannel, 2> m_Channels; // [tEnd] - the channel read by the end
+};
+
+class tTransportMemory : public tTransport
+{
+	boost::asio::io_context& m_ioc;
+	std::shared_ptr<tMemoryPipe> m_Pipe;
+	const tMemoryPipe::tEnd m_End;
+
+public:
+	tTransportMemory(boost::asio::io_context& ioc, std::shared_ptr<tMemoryPipe> pipe, tMemoryPipe::tEnd end);
+	~tTransportMemory() override;
+
+	void AsyncReadSome(boost::asio::mutable_buffer buffer, tReadHandler handler) override;
+	void Write(boost::asio::const_buffer buffer) override;
+	void AsyncWrite(const tBuffers& buffers, tWriteHandler handler) override;
+	void Close() override;
+	bool IsOpen() const override;
+
+private:
+	tMemoryPipe::tChannel& GetChannelIn() { return m_Pipe->m_Channels[static_cast<std::size_t>(m_End)]; }
+	tMemoryPipe::tChannel& GetChannelOut() { return m_Pipe->m_Channels[1 - static_cast<std::size_t>(m_End)]; }
+
+	static void CompleteRead(tMemoryPipe::tChannel& channel, const boost::system::error_code& error); // m_Pipe->m_Mtx is locked
+};
+
+}
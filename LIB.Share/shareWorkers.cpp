@@ -0,0 +1,114 @@
+#include "shareWorkers.h"
+
+#include <shareLog.h>
+#include <shareTrace.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+namespace share
+{
+
+tTopicWorkers::tTopicWorkers(std::size_t qty, tHandler handler, tMetrics* metrics)
+	:m_Handler(std::move(handler))
+{
+	if (qty == 0)
+		qty = std::max(std::thread::hardware_concurrency(), 1u);
+
+	m_Workers.reserve(qty);
+	for (std::size_t i = 0; i < qty; ++i)
+	{
+		auto Worker = std::make_unique<tWorker>();
+		if (metrics != nullptr)
+		{
+			const std::string Labels = "worker=\"" + std::to_string(i) + "\"";
+			Worker->Depth = &metrics->GetGauge("workers_queue_depth", "Messages queued for a worker.", Labels);
+			Worker->Messages = &metrics->GetCounter("workers_messages_total", "Messages processed by a worker.", Labels);
+			Worker->QueueFull = &metrics->GetCounter("workers_queue_full_total", "Messages which waited for the room in the queue of a worker.", Labels);
+		}
+		m_Workers.push_back(std::move(Worker));
+	}
+
+	for (auto& Worker : m_Workers)
+		Worker->Thread = std::thread(&tTopicWorkers::Run, this, std::ref(*Worker));
+}
+
+tTopicWorkers::~tTopicWorkers()
+{
+	m_Stop.store(true, std::memory_order_release);
+	for (auto& Worker : m_Workers)
+	{
+		Notify(*Worker);
+		Worker->Thread.join();
+	}
+}
+
+void tTopicWorkers::Push(tIncomingMessage&& msg)
+{
+	tWorker& Worker = *m_Workers[GetWorker(msg)];
+	if (!Worker.Queue.try_push(std::move(msg)))
+	{
+		if (Worker.QueueFull != nullptr)
+			Worker.QueueFull->Add();
+		do
+		{
+			Notify(Worker);
+			std::this_thread::yield();
+		}
+		while (!Worker.Queue.try_push(std::move(msg)));
+	}
+	Notify(Worker);
+
+	if (Worker.Depth != nullptr)
+		Worker.Depth->Set(static_cast<std::int64_t>(Worker.Queue.size()));
+}
+
+std::size_t tTopicWorkers::GetWorker(const tIncomingMessage& msg) const
+{
+	if (msg.TopicId == tTopicTable::IdNone)
+		return std::hash<std::string_view>{}(msg.TopicName) % m_Workers.size();
+	return msg.TopicId % m_Workers.size();
+}
+
+void tTopicWorkers::Run(tWorker& worker)
+{
+	tIncomingMessage Msg;
+	while (true)
+	{
+		const std::uint32_t Signal = worker.Signal.load(std::memory_order_acquire);
+		const bool Stop = m_Stop.load(std::memory_order_acquire); // the messages pushed before it are in the queue
+
+		while (worker.Queue.try_pop(Msg))
+		{
+			try
+			{
+				tTraceSpan Trace("workers", "Handle");
+				m_Handler(Msg);
+			}
+			catch (std::exception& ex)
+			{
+				g_Log.Exception(ex.what());
+			}
+
+			if (worker.Messages != nullptr)
+			{
+				worker.Messages->Add();
+				worker.Depth->Set(static_cast<std::int64_t>(worker.Queue.size()));
+			}
+		}
+
+		if (Stop)
+			return;
+
+		worker.Signal.wait(Signal, std::memory_order_acquire);
+	}
+}
+
+void tTopicWorkers::Notify(tWorker& worker)
+{
+	worker.Signal.fetch_add(1, std::memory_order_release);
+	worker.Signal.notify_one();
+}
+
+}
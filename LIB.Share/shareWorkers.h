@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shareWorkers
+// 2026-10-18
+// C++20
+//
+// Processing of the incoming messages by a pool of tasks: a message is given to the worker of its topic (tTopicId),
+// so the messages of a topic are processed in order, the topics are spread over the workers
+// (by the topic name if the topic is not in g_Topics).
+// A worker has its own lock-free queue, it's fed by one task (the one which receives the messages).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <libConfig.h>
+
+#ifndef LIB_SHARE_WORKERS_QUEUE_CAPACITY
+#define LIB_SHARE_WORKERS_QUEUE_CAPACITY 1024 // a power of 2
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <shareMetrics.h>
+#include <shareMQTT.h>
+
+#include <utilsMultithread.h>
+
+namespace share
+{
+
+class tTopicWorkers
+{
+	struct tWorker
+	{
+		utils::multithread::tQueueSPSC<tIncomingMessage, LIB_SHARE_WORKERS_QUEUE_CAPACITY> Queue;
+		std::atomic<std::uint32_t> Signal = 0; // it's changed when a message is pushed, the worker waits on it
+		tMetricGauge* Depth = nullptr;
+		tMetricCounter* Messages = nullptr;
+		tMetricCounter* QueueFull = nullptr;
+		std::thread Thread;
+	};
+
+public:
+	using tHandler = std::function<void(const tIncomingMessage&)>; // it's called by the workers concurrently
+
+private:
+	const tHandler m_Handler;
+	std::vector<std::unique_ptr<tWorker>> m_Workers;
+	std::atomic<bool> m_Stop = false;
+
+public:
+	tTopicWorkers() = delete;
+	tTopicWorkers(std::size_t qty, tHandler handler, tMetrics* metrics = nullptr); // qty 0 - the number of the cores
+	tTopicWorkers(const tTopicWorkers&) = delete;
+	tTopicWorkers(tTopicWorkers&&) = delete;
+	~tTopicWorkers(); // the queued messages are processed
+
+	tTopicWorkers& operator=(const tTopicWorkers&) = delete;
+	tTopicWorkers& operator=(tTopicWorkers&&) = delete;
+
+	// It waits when the queue of the worker is full (the receiver's queue takes the load then).
+	void Push(tIncomingMessage&& msg); // one task
+
+	std::size_t GetQty() const { return m_Workers.size(); }
+	std::size_t GetWorker(const tIncomingMessage& msg) const;
+	std::size_t GetDepth(std::size_t worker) const { return m_Workers[worker]->Queue.size(); }
+
+private:
+	void Run(tWorker& worker);
+	static void Notify(tWorker& worker);
+};
+
+}
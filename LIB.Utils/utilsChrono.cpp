@@ -1,9 +1,101 @@
 #include "utilsChrono.h"
 
+#include <algorithm>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__arm__) && defined(__linux__) && __ARM_ARCH >= 7
+#include <sys/auxv.h>
+#endif
+
+#ifndef LIB_UTILS_CHRONO_CYCLES_CALIBRATION
+#define LIB_UTILS_CHRONO_CYCLES_CALIBRATION 10 // [ms]
+#endif
+
 namespace utils
 {
 namespace chrono
 {
+namespace hidden
+{
+
+static bool IsCyclesCounter()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int Regs[4]{};
+	__cpuid(Regs, 0x80000000);
+	if (static_cast<unsigned>(Regs[0]) < 0x80000007)
+		return false;
+	__cpuid(Regs, 0x80000007);
+	return (Regs[3] & (1 << 8)) != 0; // Invariant TSC
+#elif defined(__x86_64__) || defined(__i386__)
+	unsigned int Eax = 0, Ebx = 0, Ecx = 0, Edx = 0;
+	if (!__get_cpuid(0x80000007, &Eax, &Ebx, &Ecx, &Edx))
+		return false;
+	return (Edx & (1 << 8)) != 0; // Invariant TSC
+#elif defined(__aarch64__)
+	return true; // the access to CNTVCT_EL0 is always enabled by Linux
+#elif defined(__arm__) && defined(__linux__) && __ARM_ARCH >= 7
+	// ARMv7 CPUs can have no generic timer (Cortex-A8, A9), or the access to CNTVCT can be disabled for user mode (SIGILL).
+	// The event stream is provided by the generic timer, and the kernel which runs it enables the access.
+	return (getauxval(AT_HWCAP) & (1 << 21)) != 0; // HWCAP_EVTSTRM
+#else
+	return false;
+#endif
+}
+
+static std::uint64_t GetCyclesFrequency() // 0 - unknown
+{
+#if defined(__aarch64__)
+	std::uint64_t Val;
+	asm volatile("mrs %0, cntfrq_el0" : "=r"(Val));
+	return Val;
+#elif defined(__arm__) && defined(__linux__) && __ARM_ARCH >= 7
+	std::uint32_t Val;
+	asm volatile("mrc p15, 0, %0, c14, c0, 0" : "=r"(Val)); // CNTFRQ
+	return Val;
+#else
+	return 0;
+#endif
+}
+
+tClockCyclesScale CalibrateClockCycles()
+{
+	tClockCyclesScale Scale;
+	if (!IsCyclesCounter())
+		return Scale;
+
+	constexpr double Fixed = static_cast<double>(1ULL << 32);
+
+	if (const std::uint64_t Frequency = GetCyclesFrequency())
+	{
+		Scale.Counter = true;
+		Scale.Mult = static_cast<std::uint64_t>(1e9 / static_cast<double>(Frequency) * Fixed);
+		return Scale;
+	}
+
+	const tTimePoint TimeStart = tClock::now();
+	const std::uint64_t CyclesStart = GetCycles();
+	tTimePoint TimeNow;
+	do
+	{
+		TimeNow = tClock::now();
+	}
+	while (TimeNow - TimeStart < ttime_ms(LIB_UTILS_CHRONO_CYCLES_CALIBRATION));
+	const std::uint64_t CyclesNow = GetCycles();
+
+	if (CyclesNow <= CyclesStart)
+		return Scale;
+
+	const auto Ns = std::chrono::duration_cast<ttime_ns>(TimeNow - TimeStart).count();
+	Scale.Counter = true;
+	Scale.Mult = static_cast<std::uint64_t>(static_cast<double>(Ns) / static_cast<double>(CyclesNow - CyclesStart) * Fixed);
+	return Scale;
+}
+
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -117,5 +209,309 @@ void tTimePeriodCount::SetRep(uint32_t repPeriod, int repQty)
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+tTimerWheel::tTimerWheel(ttime_ms tick, tExecutor executor)
+	:m_Tick(tick.count() > 0 ? tick : ttime_ms(1)), m_Executor(std::move(executor))
+{
+	m_Slots.fill(NoIndex);
+}
+
+tTimerWheel::tTimerId tTimerWheel::AddOnce(ttime_ms delay, tCallback callback)
+{
+	tTimer Timer;
+	Timer.Callback = std::make_shared<const tCallback>(std::move(callback));
+	Timer.NextStart = ToTicks(delay); // relative, see Add()
+	return Add(std::move(Timer));
+}
+
+tTimerWheel::tTimerId tTimerWheel::AddPeriod(bool sync, ttime_ms period, bool postpone, tCallback callback)
+{
+	return AddPeriodCount(sync, period, ttime_ms(0), 0, postpone, std::move(callback));
+}
+
+tTimerWheel::tTimerId tTimerWheel::AddPeriodCount(bool sync, ttime_ms period, ttime_ms repPeriod, int repQty, bool postpone, tCallback callback)
+{
+	tTimer Timer;
+	Timer.Callback = std::make_shared<const tCallback>(std::move(callback));
+	Timer.Period = std::max<std::uint64_t>(ToTicks(period), 1);
+	Timer.Sync = sync;
+	Timer.NextStart = postpone ? Timer.Period : 0; // relative, see Add()
+	if (repPeriod < period && repQty > 0)
+	{
+		Timer.RepPeriod = std::max<std::uint64_t>(ToTicks(repPeriod), 1);
+		Timer.RepQty = repQty;
+	}
+	return Add(std::move(Timer));
+}
+
+bool tTimerWheel::Cancel(tTimerId id)
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	tTimer* Timer = Find(id);
+	if (Timer == nullptr)
+		return false;
+	const std::uint32_t Index = static_cast<std::uint32_t>(id);
+	Unlink(Index);
+	Free(Index);
+	return true;
+}
+
+void tTimerWheel::Complete(tTimerId id)
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	tTimer* Timer = Find(id);
+	if (Timer == nullptr || Timer->RepQtyCount == 0)
+		return;
+	Timer->RepQtyCount = 0;
+	if (Timer->Expiry == Timer->NextStart)
+		return;
+	const std::uint32_t Index = static_cast<std::uint32_t>(id);
+	Unlink(Index);
+	Timer->Expiry = Timer->NextStart;
+	Link(Index);
+}
+
+std::size_t tTimerWheel::Advance(tTimePoint timeNow)
+{
+	const std::uint64_t TickTarget = timeNow > m_TimeStart ? static_cast<std::uint64_t>((timeNow - m_TimeStart) / m_Tick) : 0;
+
+	{
+		std::lock_guard<std::mutex> Lock(m_Mtx);
+
+		while (m_TickNow <= TickTarget)
+		{
+			if (m_Qty == 0) // nothing to cascade
+			{
+				m_TickNow = TickTarget + 1;
+				break;
+			}
+
+			const std::uint32_t Slot = static_cast<std::uint32_t>(m_TickNow & ((1 << Level0Bits) - 1));
+			if (Slot == 0)
+			{
+				for (std::uint32_t Level = 1; Level <= LevelQty; ++Level)
+				{
+					Cascade(Level);
+					if ((m_TickNow >> (Level0Bits + LevelBits * (Level - 1))) & ((1 << LevelBits) - 1))
+						break;
+				}
+			}
+
+			std::uint32_t Index = m_Slots[Slot];
+			m_Slots[Slot] = NoIndex;
+			while (Index != NoIndex)
+			{
+				tTimer& Timer = m_Timers[Index];
+				const std::uint32_t Next = Timer.Next;
+				Timer.Slot = NoIndex;
+				if (Timer.Expiry > m_TickNow) // it can't be, but it isn't lost if it is so
+				{
+					Link(Index);
+				}
+				else
+				{
+					Expire(Index, TickTarget);
+				}
+				Index = Next;
+			}
+
+			++m_TickNow;
+		}
+	}
+
+	const std::size_t Qty = m_Fired.size();
+	for (auto& Callback : m_Fired)
+	{
+		if (m_Executor)
+		{
+			m_Executor([Callback]() { (*Callback)(); });
+		}
+		else
+		{
+			(*Callback)();
+		}
+	}
+	m_Fired.clear();
+	return Qty;
+}
+
+std::size_t tTimerWheel::GetSize() const
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+	return m_Qty;
+}
+
+tTimerWheel::tTimerId tTimerWheel::Add(tTimer&& timer)
+{
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+
+	std::uint32_t Index = 0;
+	if (m_TimersFree.empty())
+	{
+		Index = static_cast<std::uint32_t>(m_Timers.size());
+		m_Timers.emplace_back();
+	}
+	else
+	{
+		Index = m_TimersFree.back();
+		m_TimersFree.pop_back();
+	}
+
+	tTimer& Timer = m_Timers[Index];
+	timer.Generation = Timer.Generation;
+	Timer = std::move(timer);
+	Timer.NextStart += m_TickNow;
+	Timer.Expiry = Timer.NextStart;
+	Link(Index);
+	++m_Qty;
+
+	return (static_cast<tTimerId>(Timer.Generation) << 32) | Index;
+}
+
+tTimerWheel::tTimer* tTimerWheel::Find(tTimerId id)
+{
+	const std::uint32_t Index = static_cast<std::uint32_t>(id);
+	if (Index >= m_Timers.size())
+		return nullptr;
+	tTimer& Timer = m_Timers[Index];
+	if (Timer.Generation != static_cast<std::uint32_t>(id >> 32) || Timer.Slot == NoIndex)
+		return nullptr;
+	return &Timer;
+}
+
+std::uint64_t tTimerWheel::ToTicks(ttime_ms time) const
+{
+	if (time.count() <= 0)
+		return 0;
+	return static_cast<std::uint64_t>((time + m_Tick - ttime_ms(1)) / m_Tick);
+}
+
+void tTimerWheel::Link(std::uint32_t index)
+{
+	tTimer& Timer = m_Timers[index];
+
+	const std::uint64_t Expiry = std::max(Timer.Expiry, m_TickNow);
+	const std::uint64_t Delta = Expiry - m_TickNow;
+
+	std::uint32_t Slot = 0;
+	if (Delta < (1ULL << Level0Bits))
+	{
+		Slot = static_cast<std::uint32_t>(Expiry & ((1 << Level0Bits) - 1));
+	}
+	else
+	{
+		for (std::uint32_t Level = 1; Level <= LevelQty; ++Level)
+		{
+			const std::uint32_t Shift = Level0Bits + LevelBits * (Level - 1);
+			std::uint64_t ExpirySlot = Expiry;
+			if (Level == LevelQty && Delta >= (1ULL << (Shift + LevelBits)))
+				ExpirySlot = m_TickNow + (1ULL << (Shift + LevelBits)) - 1; // it is cascaded again
+			if (Level == LevelQty || Delta < (1ULL << (Shift + LevelBits)))
+			{
+				Slot = (1 << Level0Bits) + (1 << LevelBits) * (Level - 1) + static_cast<std::uint32_t>((ExpirySlot >> Shift) & ((1 << LevelBits) - 1));
+				break;
+			}
+		}
+	}
+
+	Timer.Slot = Slot;
+	Timer.Prev = NoIndex;
+	Timer.Next = m_Slots[Slot];
+	if (Timer.Next != NoIndex)
+		m_Timers[Timer.Next].Prev = index;
+	m_Slots[Slot] = index;
+}
+
+void tTimerWheel::Unlink(std::uint32_t index)
+{
+	tTimer& Timer = m_Timers[index];
+	if (Timer.Prev != NoIndex)
+	{
+		m_Timers[Timer.Prev].Next = Timer.Next;
+	}
+	else
+	{
+		m_Slots[Timer.Slot] = Timer.Next;
+	}
+	if (Timer.Next != NoIndex)
+		m_Timers[Timer.Next].Prev = Timer.Prev;
+	Timer.Prev = NoIndex;
+	Timer.Next = NoIndex;
+	Timer.Slot = NoIndex;
+}
+
+void tTimerWheel::Free(std::uint32_t index)
+{
+	tTimer& Timer = m_Timers[index];
+	Timer.Callback.reset();
+	Timer.Slot = NoIndex;
+	if (++Timer.Generation == 0)
+		Timer.Generation = 1;
+	m_TimersFree.push_back(index);
+	--m_Qty;
+}
+
+void tTimerWheel::Cascade(std::uint32_t level)
+{
+	const std::uint32_t Shift = Level0Bits + LevelBits * (level - 1);
+	const std::uint32_t Slot = (1 << Level0Bits) + (1 << LevelBits) * (level - 1) + static_cast<std::uint32_t>((m_TickNow >> Shift) & ((1 << LevelBits) - 1));
+
+	std::uint32_t Index = m_Slots[Slot];
+	m_Slots[Slot] = NoIndex;
+	while (Index != NoIndex)
+	{
+		const std::uint32_t Next = m_Timers[Index].Next;
+		Link(Index);
+		Index = Next;
+	}
+}
+
+void tTimerWheel::Expire(std::uint32_t index, std::uint64_t tickNow)
+{
+	tTimer& Timer = m_Timers[index];
+
+	if (Timer.Period == 0)
+	{
+		m_Fired.push_back(std::move(Timer.Callback));
+		Free(index);
+		return;
+	}
+
+	bool Fired = false;
+	if (Timer.NextStart <= tickNow)
+	{
+		const std::uint64_t StartPrev = Timer.NextStart;
+		Timer.NextStart = GetStartTime(Timer.Sync, tickNow, StartPrev, Timer.Period);
+		if (Timer.RepPeriod > 0)
+		{
+			Timer.RepQtyCount = 1;
+			Timer.RepNextStart = GetStartTime(Timer.Sync, tickNow, StartPrev, Timer.RepPeriod);
+		}
+		Fired = true;
+	}
+	else if (Timer.RepQtyCount > 0 && Timer.RepNextStart <= tickNow)
+	{
+		Timer.RepNextStart = GetStartTime(Timer.Sync, tickNow, Timer.RepNextStart, Timer.RepPeriod);
+		if (++Timer.RepQtyCount > Timer.RepQty)
+			Timer.RepQtyCount = 0;
+		Fired = true;
+	}
+
+	if (Fired)
+		m_Fired.push_back(Timer.Callback);
+
+	Timer.Expiry = Timer.RepQtyCount > 0 ? std::min(Timer.NextStart, Timer.RepNextStart) : Timer.NextStart;
+	Link(index);
+}
+
+std::uint64_t tTimerWheel::GetStartTime(bool sync, std::uint64_t tickNow, std::uint64_t startTime, std::uint64_t period)
+{
+	if (!sync)
+		return tickNow + period;
+
+	return startTime + period * ((tickNow - startTime) / period + 1); // the missed periods are skipped at once
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 }
 }
@@ -5,8 +5,17 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
 
 namespace utils
 {
@@ -23,6 +32,76 @@ using ttime_ns = std::chrono::nanoseconds;
 using ttime_us = std::chrono::microseconds;
 using ttime_ms = std::chrono::milliseconds;
 
+namespace hidden
+{
+
+struct tClockCyclesScale
+{
+	bool Counter = false; // the cycle counter is used, otherwise steady_clock
+	std::uint64_t Mult = 1ULL << 32; // [ns / tick] << 32
+};
+
+tClockCyclesScale CalibrateClockCycles();
+
+inline const tClockCyclesScale& GetClockCyclesScale()
+{
+	static const tClockCyclesScale Scale = CalibrateClockCycles();
+	return Scale;
+}
+
+inline std::uint64_t GetCycles()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+	std::uint64_t Val;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(Val));
+	return Val;
+#elif defined(__arm__) && defined(__linux__) && __ARM_ARCH >= 7
+	std::uint64_t Val;
+	asm volatile("mrrc p15, 1, %Q0, %R0, c14" : "=r"(Val)); // CNTVCT
+	return Val;
+#else
+	return 0;
+#endif
+}
+
+}
+
+// Cycle counter: TSC (x86), CNTVCT of the generic timer (ARM). It is read in a few ns,
+// steady_clock takes 20..50 ns (vDSO) and much more when the kernel has no vDSO clock source.
+// The rate is read from CNTFRQ (ARM) or it is calibrated against steady_clock (x86, ~10 ms when the clock is used first).
+// Without the counter (no invariant TSC, ARM without the generic timer) it is steady_clock.
+class tClockCycles
+{
+public:
+	using rep = std::int64_t;
+	using period = std::nano;
+	using duration = std::chrono::nanoseconds;
+	using time_point = std::chrono::time_point<tClockCycles>;
+	static constexpr bool is_steady = true;
+
+	static time_point now() noexcept { return time_point(ToDuration(GetTicks())); }
+
+	static std::uint64_t GetTicks() noexcept
+	{
+		if (!hidden::GetClockCyclesScale().Counter)
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<duration>(tClock::now().time_since_epoch()).count());
+		return hidden::GetCycles();
+	}
+
+	static duration ToDuration(std::uint64_t ticks) noexcept // no 128-bit product on 32-bit platforms
+	{
+		const std::uint64_t Mult = hidden::GetClockCyclesScale().Mult;
+		const std::uint64_t TicksHi = ticks >> 32;
+		const std::uint64_t TicksLo = ticks & 0xFFFFFFFF;
+		const std::uint64_t Ns = TicksHi * Mult + TicksLo * (Mult >> 32) + ((TicksLo * (Mult & 0xFFFFFFFF)) >> 32);
+		return duration(static_cast<rep>(Ns));
+	}
+};
+
 template<class _Period, class T>
 std::uint32_t GetDuration(std::chrono::time_point<T> timeStart, std::chrono::time_point<T> timeNow)
 {
@@ -33,18 +112,34 @@ std::uint32_t GetDuration(std::chrono::time_point<T> timeStart, std::chrono::tim
 	return static_cast<std::uint32_t>(Duration);
 }
 
-class tTimeDuration
+template<class _Period, class T>
+std::uint64_t GetDuration64(std::chrono::time_point<T> timeStart, std::chrono::time_point<T> timeNow)
 {
-	tTimePoint m_TimeStart = tClock::now();
+	if (timeStart >= timeNow)
+		return 0;
+
+	auto Duration = std::chrono::duration_cast<_Period>(timeNow - timeStart).count();
+	return static_cast<std::uint64_t>(Duration);
+}
+
+template<class TClock>
+class tTimeDurationBase
+{
+	typename TClock::time_point m_TimeStart = TClock::now();
 
 public:
-	tTimeDuration() = default;
-	virtual ~tTimeDuration() {}
+	tTimeDurationBase() = default;
+	virtual ~tTimeDurationBase() {}
 
 	template<typename T>
-	std::uint32_t Get() const { return GetDuration<T>(m_TimeStart, tClock::now()); }
+	std::uint32_t Get() const { return GetDuration<T>(m_TimeStart, TClock::now()); }
+	template<typename T>
+	std::uint64_t Get64() const { return GetDuration64<T>(m_TimeStart, TClock::now()); }
 };
 
+using tTimeDuration = tTimeDurationBase<tClock>;
+using tTimeDurationCycles = tTimeDurationBase<tClockCycles>; // hot paths, e.g. per packet
+
 class tTimePeriod
 {
 	std::uint32_t m_Period = 0;//in seconds
@@ -95,5 +190,95 @@ private:
 	void SetRep(uint32_t repPeriod, int repQty);
 };
 
+// Hierarchical timing wheel: the timers are inserted and cancelled in O(1), a tick costs O(1) plus the timers which are cascaded.
+// Level 0 has 256 slots of one tick, levels 1..4 have 64 slots of 256, 256 * 64, ... ticks (2^32 ticks, longer delays are cascaded again).
+// The periodic timers keep the semantics of tTimePeriod (sync - drift-free, the missed periods are skipped; not sync - postponed
+// from the time it has fired) and tTimePeriodCount (a burst of repQty repetitions with repPeriod after every period, Complete() stops it).
+// Advance() is called by one task; Add...(), Cancel(), Complete() are thread safe and can be called by the callbacks.
+// The callbacks are called by Advance() after the lock is released or posted to the executor.
+class tTimerWheel
+{
+public:
+	using tCallback = std::function<void()>;
+	using tExecutor = std::function<void(tCallback)>; // e.g. [&ioc](auto cb) { boost::asio::post(ioc, std::move(cb)); }
+	using tTimerId = std::uint64_t; // the generation and the index of the timer, an id of an expired timer is not reused
+
+	static constexpr tTimerId NoTimer = 0;
+
+private:
+	static constexpr std::uint32_t NoIndex = 0xFFFFFFFF;
+	static constexpr std::uint32_t Level0Bits = 8;
+	static constexpr std::uint32_t LevelBits = 6;
+	static constexpr std::uint32_t LevelQty = 4; // above level 0
+	static constexpr std::uint32_t SlotQty = (1 << Level0Bits) + LevelQty * (1 << LevelBits);
+	static constexpr std::uint64_t NoTick = ~0ULL;
+
+	struct tTimer
+	{
+		std::uint64_t Expiry = 0; // [tick]
+		std::uint32_t Prev = NoIndex;
+		std::uint32_t Next = NoIndex;
+		std::uint32_t Slot = NoIndex; // NoIndex - the timer is not in the wheel (free)
+		std::uint32_t Generation = 1;
+
+		std::shared_ptr<const tCallback> Callback; // it is kept by a call in progress when the timer is cancelled
+
+		std::uint64_t Period = 0; // [tick], 0 - one-shot
+		bool Sync = false;
+		std::uint64_t NextStart = 0; // [tick]
+		std::uint64_t RepPeriod = 0; // [tick], 0 - no repetitions
+		int RepQty = 0;
+		int RepQtyCount = 0;
+		std::uint64_t RepNextStart = 0; // [tick]
+	};
+
+	const tTimePoint m_TimeStart = tClock::now();
+	const ttime_ms m_Tick;
+	const tExecutor m_Executor;
+
+	mutable std::mutex m_Mtx;
+	std::uint64_t m_TickNow = 0; // the next tick to be handled
+	std::vector<tTimer> m_Timers;
+	std::vector<std::uint32_t> m_TimersFree;
+	std::array<std::uint32_t, SlotQty> m_Slots; // the heads of the lists
+	std::size_t m_Qty = 0;
+
+	std::vector<std::shared_ptr<const tCallback>> m_Fired; // Advance()
+
+public:
+	explicit tTimerWheel(ttime_ms tick = ttime_ms(1), tExecutor executor = {});
+	tTimerWheel(const tTimerWheel&) = delete;
+	tTimerWheel(tTimerWheel&&) = delete;
+
+	tTimerWheel& operator=(const tTimerWheel&) = delete;
+	tTimerWheel& operator=(tTimerWheel&&) = delete;
+
+	tTimerId AddOnce(ttime_ms delay, tCallback callback);
+	tTimerId AddPeriod(bool sync, ttime_ms period, bool postpone, tCallback callback); // like tTimePeriod, period > 0
+	tTimerId AddPeriodCount(bool sync, ttime_ms period, ttime_ms repPeriod, int repQty, bool postpone, tCallback callback); // like tTimePeriodCount
+
+	bool Cancel(tTimerId id); // false - the timer has expired (one-shot) or has been cancelled
+	void Complete(tTimerId id); // the burst of repetitions is stopped, like tTimePeriodCount::Complete()
+
+	std::size_t Advance() { return Advance(tClock::now()); }
+	std::size_t Advance(tTimePoint timeNow); // returns the number of the callbacks which have been called or posted
+
+	std::size_t GetSize() const;
+	ttime_ms GetTick() const { return m_Tick; }
+
+private:
+	tTimerId Add(tTimer&& timer);
+	tTimer* Find(tTimerId id);
+	std::uint64_t ToTicks(ttime_ms time) const;
+
+	void Link(std::uint32_t index);
+	void Unlink(std::uint32_t index);
+	void Free(std::uint32_t index);
+	void Cascade(std::uint32_t level);
+	void Expire(std::uint32_t index, std::uint64_t tickNow); // tickNow - the time of Advance(), the wheel can be behind it
+
+	static std::uint64_t GetStartTime(bool sync, std::uint64_t tickNow, std::uint64_t startTime, std::uint64_t period);
+};
+
 }
 }
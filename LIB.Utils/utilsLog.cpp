@@ -1,12 +1,21 @@
 #include "utilsLog.h"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
+#include <cstring>
 #include <time.h>
 
 #ifdef LIB_UTILS_LOG
 
+#ifndef LIB_UTILS_LOG_ASYNC_RING_SIZE
+#define LIB_UTILS_LOG_ASYNC_RING_SIZE (64 * 1024) // bytes per thread, power of 2
+#endif
+
+#ifndef LIB_UTILS_LOG_ASYNC_PERIOD
+#define LIB_UTILS_LOG_ASYNC_PERIOD 10 // ms
+#endif
+
 namespace utils
 {
 namespace log
@@ -51,11 +60,69 @@ void tLog::WriteLine(bool timestamp, tColor colorText, const std::string& msg)
 }
 #endif // LIB_UTILS_LOG_DEPRECATED
 
-static bool IsSymbol(char value)
+static constexpr bool IsSymbol(char value)
 {
 	return value > 0x20 && value != 0x25 && value != 0x7F;
 }
 
+// The lines are written straight into the string through the tables, one entry per byte value.
+struct tHexTable
+{
+	std::array<std::array<char, 2>, 256> Hex{};
+	std::array<char, 256> Symbol{};
+
+	constexpr tHexTable()
+	{
+		constexpr char Digits[] = "0123456789abcdef";
+		for (std::size_t i = 0; i < 256; ++i)
+		{
+			Hex[i] = { Digits[i >> 4], Digits[i & 0x0F] };
+			const char Value = static_cast<char>(i);
+			Symbol[i] = IsSymbol(Value) ? Value : '.';
+		}
+	}
+};
+
+static constexpr tHexTable HexTable;
+
+constexpr std::size_t HexLineSize = 4 + 3 + 16 * 3 + 2 + 2 + 16 + 1; // offset, bytes, symbols, '\n'
+
+static char* PutHexLine(char* dst, std::size_t offset, const std::uint8_t* data, std::size_t size) // size <= 16
+{
+	int OffsetDigits = 4;
+	while (OffsetDigits < 16 && (offset >> (4 * OffsetDigits)))
+		++OffsetDigits;
+	for (int i = OffsetDigits - 1; i >= 0; --i)
+		*dst++ = HexTable.Hex[(offset >> (4 * i)) & 0x0F][1];
+	std::memcpy(dst, "   ", 3);
+	dst += 3;
+
+	for (std::size_t i = 0; i < 16; ++i)
+	{
+		if (i == 8)
+		{
+			std::memcpy(dst, "  ", 2);
+			dst += 2;
+		}
+		if (i < size)
+		{
+			std::memcpy(dst, HexTable.Hex[data[i]].data(), 2);
+			dst[2] = ' ';
+		}
+		else
+		{
+			std::memcpy(dst, "   ", 3);
+		}
+		dst += 3;
+	}
+
+	std::memcpy(dst, "  ", 2);
+	dst += 2;
+	for (std::size_t i = 0; i < size; ++i)
+		*dst++ = HexTable.Symbol[data[i]];
+	return dst;
+}
+
 template <typename T>
 static std::enable_if<std::is_same<T, char>::value || std::is_same<T, unsigned char>::value, std::string>::type MakeStringHex(const std::vector<T>& data, int dataLinesBegin, int dataLinesEnd)
 {
@@ -69,7 +136,13 @@ static std::enable_if<std::is_same<T, char>::value || std::is_same<T, unsigned c
 
 	const auto IsLineSkipped = [&dataLinesBegin, &dataLinesEnd, &LinesToSkip](int linesCounter)->bool { return LinesToSkip > 0 && linesCounter > dataLinesBegin && linesCounter < dataLinesEnd; };
 
-	std::stringstream Stream;
+	const std::string SkipMsg = LinesToSkip > 0 ? "< " + std::to_string(LinesToSkip) + " lines are skipped >\n" : "";
+
+	std::string Str;
+	Str.resize(static_cast<std::size_t>(LinesQty) * (HexLineSize + 12) + SkipMsg.size()); // the offset may be longer than 4 digits
+	char* Begin = Str.data();
+	char* Dst = Begin;
+	const std::uint8_t* Data = reinterpret_cast<const std::uint8_t*>(data.data());
 	bool SkipMsgInserted = false;
 	for (int i = 0; i < LinesQty; ++i)
 	{
@@ -78,38 +151,21 @@ static std::enable_if<std::is_same<T, char>::value || std::is_same<T, unsigned c
 			if (!SkipMsgInserted)
 			{
 				SkipMsgInserted = true;
-				Stream << "< " + std::to_string(LinesToSkip) + " lines are skipped >\n";
+				std::memcpy(Dst, SkipMsg.data(), SkipMsg.size());
+				Dst += SkipMsg.size();
 			}
 			continue;
 		}
 
-		Stream << std::setfill('0') << std::setw(4) << std::hex << (16 * i) << "   ";
-
-		std::string Substr;
-		std::size_t byteCount = 0;
-		for (std::size_t k = (16 * i); byteCount < 16 && k < data.size(); ++byteCount, ++k)
-		{
-			if (byteCount == 8)
-				Stream << "  ";
-
-			Stream << std::setfill('0') << std::setw(2) << std::hex << static_cast<int>(data[k]) << ' ';
-
-			Substr += IsSymbol(data[k]) ? data[k] : '.';
-		}
-		for (; byteCount < 16; ++byteCount)
-		{
-			if (byteCount == 8)
-				Stream << "  ";
-			Stream << "   ";
-		}
-		Stream << "  " + Substr;
-		
+		const std::size_t Offset = 16 * static_cast<std::size_t>(i);
+		Dst = PutHexLine(Dst, Offset, Data + Offset, std::min<std::size_t>(16, data.size() - Offset));
 
 		if (i < LinesQty - 1) // It's not needed for the last string
-			Stream << '\n';
+			*Dst++ = '\n';
 	}
+	Str.resize(Dst - Begin);
 
-	return Stream.str();
+	return Str;
 }
 
 #ifdef LIB_UTILS_LOG_DEPRECATED
@@ -121,7 +177,11 @@ void tLog::WriteHex(bool timestamp, tColor colorText, const std::string& msg, co
 
 void tLog::WriteHex(const std::vector<std::uint8_t>& data, tColor dataColor, int dataLinesBegin, int dataLinesEnd)
 {
+#ifdef LIB_UTILS_LOG_ASYNC
+	Push(hidden::tLogRing::tKind::Hex, false, true, {}, dataColor, &data, dataLinesBegin, dataLinesEnd); // it's formatted by the task of the log
+#else // LIB_UTILS_LOG_ASYNC
 	WriteLog(false, true, MakeStringHex(data, dataLinesBegin, dataLinesEnd), dataColor);
+#endif // LIB_UTILS_LOG_ASYNC
 }
 
 void tLog::WriteHex(const std::vector<std::uint8_t>& data, tColor dataColor)
@@ -167,39 +227,80 @@ void tLog::WriteHex(bool timestamp, const std::string& msg, const std::vector<st
 
 void tLog::WriteLog(bool timestamp, bool endl, const std::string& text, tColor textColor)
 {
+#ifdef LIB_UTILS_LOG_ASYNC
+	Push(hidden::tLogRing::tKind::Text, timestamp, endl, text, textColor, nullptr, 0, 0);
+#else // LIB_UTILS_LOG_ASYNC
 	std::lock_guard<std::mutex> Lock(m_Mtx);
+	WriteLog(std::chrono::system_clock::now(), timestamp, endl, text, textColor);
+#endif // LIB_UTILS_LOG_ASYNC
+}
 
-	std::string Str;
-	Str.reserve(80); // [#]
-
-	if (timestamp)
+// HH:MM:SS is formatted once a second (localtime is slow), the fraction of a second is put for every line.
+static void PutTimestamp(std::string& str, std::chrono::system_clock::time_point time)
+{
+	struct tCache
 	{
-		const auto TimeNow = std::chrono::system_clock::now();
-#ifdef LIB_UTILS_LOG_TIMESTAMP_MICROSECONDS
-		const auto Time_us = std::chrono::time_point_cast<std::chrono::microseconds>(TimeNow);
-		const auto TimeFract = static_cast<unsigned int>(Time_us.time_since_epoch().count() % 1000000);
-		const int Digits = 6;
-#else // LIB_UTILS_LOG_TIMESTAMP_MICROSECONDS
-		const auto Time_ms = std::chrono::time_point_cast<std::chrono::milliseconds>(TimeNow);
-		const auto TimeFract = static_cast<unsigned int>(Time_ms.time_since_epoch().count() % 1000);
-		const int Digits = 3;
-#endif // LIB_UTILS_LOG_TIMESTAMP_MICROSECONDS
-		time_t Time = std::chrono::system_clock::to_time_t(TimeNow);
-
-		tm TmBuf;
+		std::int64_t Second = -1;
+		char Text[8] = {};
+	};
+	thread_local tCache Cache;
+
+	const auto TimeSince = time.time_since_epoch();
+	const std::int64_t Second = std::chrono::duration_cast<std::chrono::seconds>(TimeSince).count();
+	if (Second != Cache.Second)
+	{
+		const time_t Time = static_cast<time_t>(Second);
+		tm TmBuf{};
 #ifdef _WIN32
 		localtime_s(&TmBuf, &Time);
 #else // _WIN32
 		localtime_r(&Time, &TmBuf);
 #endif // _WIN32
-		std::stringstream SStr;
-		SStr << std::put_time(&TmBuf, "%T") << '.';
-		SStr << std::setfill('0') << std::setw(Digits) << TimeFract << ' ';
+		const int Fields[] = { TmBuf.tm_hour, TmBuf.tm_min, TmBuf.tm_sec };
+		for (int i = 0; i < 3; ++i)
+		{
+			Cache.Text[i * 3] = static_cast<char>('0' + Fields[i] / 10);
+			Cache.Text[i * 3 + 1] = static_cast<char>('0' + Fields[i] % 10);
+			if (i < 2)
+				Cache.Text[i * 3 + 2] = ':';
+		}
+		Cache.Second = Second;
+	}
+
+#ifdef LIB_UTILS_LOG_TIMESTAMP_MICROSECONDS
+	auto TimeFract = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(TimeSince).count() % 1000000);
+	constexpr int Digits = 6;
+#else // LIB_UTILS_LOG_TIMESTAMP_MICROSECONDS
+	auto TimeFract = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(TimeSince).count() % 1000);
+	constexpr int Digits = 3;
+#endif // LIB_UTILS_LOG_TIMESTAMP_MICROSECONDS
+
+	char Text[8 + 1 + Digits + 1];
+	std::memcpy(Text, Cache.Text, 8);
+	Text[8] = '.';
+	for (int i = 8 + Digits; i > 8; --i, TimeFract /= 10)
+		Text[i] = static_cast<char>('0' + TimeFract % 10);
+	Text[sizeof(Text) - 1] = ' ';
+	str.append(Text, sizeof(Text));
+}
+
+void tLog::WriteLog(std::chrono::system_clock::time_point time, bool timestamp, bool endl, const std::string& text, tColor textColor)
+{
+	std::string Str;
+	Str.reserve(80); // [#]
+
+	if (timestamp)
+	{
+		PutTimestamp(Str, time);
 
 		const std::string Label = GetLabel();
 		if (!Label.empty())
-			SStr << std::setfill(' ') << std::setw(4) << Label << ' ';
-		Str = SStr.str();
+		{
+			if (Label.size() < 4)
+				Str.append(4 - Label.size(), ' ');
+			Str += Label;
+			Str += ' ';
+		}
 	}
 
 	std::string StrNoColor = Str + text + (endl ? "\n" : "");
@@ -237,6 +338,248 @@ void tLog::WriteLog(bool timestamp, bool endl, const std::string& text, tColor t
 #endif // LIB_UTILS_LOG_COLOR
 }
 
+
+#ifdef LIB_UTILS_LOG_ASYNC
+namespace hidden
+{
+
+tLogRing::tLogRing(std::size_t capacity)
+	:m_Buffer(capacity), m_Mask(capacity - 1)
+{
+}
+
+std::size_t tLogRing::GetRecordSize(std::size_t textSize, std::size_t dataSize)
+{
+	constexpr std::size_t Align = sizeof(tRecordHeader); // the padding always has room for the header
+	return (sizeof(tRecordHeader) + textSize + dataSize + Align - 1) / Align * Align;
+}
+
+bool tLogRing::Push(const tRecordHeader& header, std::string_view text, const std::uint8_t* data)
+{
+	const std::size_t Size = GetRecordSize(text.size(), header.DataSize);
+
+	const std::size_t Head = m_Head.load(std::memory_order_relaxed);
+	const std::size_t Index = Head & m_Mask;
+	const std::size_t PaddingSize = Index + Size > m_Buffer.size() ? m_Buffer.size() - Index : 0;
+	if (Size > m_Buffer.size() / 2 || m_Buffer.size() - (Head - m_Tail.load(std::memory_order_acquire)) < PaddingSize + Size)
+	{
+		m_DroppedQty.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	std::uint8_t* Record = m_Buffer.data() + Index;
+	if (PaddingSize)
+	{
+		tRecordHeader Padding;
+		Padding.Size = static_cast<std::uint32_t>(PaddingSize);
+		std::memcpy(Record, &Padding, sizeof(Padding));
+		Record = m_Buffer.data();
+	}
+
+	tRecordHeader Header = header;
+	Header.Size = static_cast<std::uint32_t>(Size);
+	Header.TextSize = static_cast<std::uint32_t>(text.size());
+	std::memcpy(Record, &Header, sizeof(Header));
+	std::memcpy(Record + sizeof(Header), text.data(), text.size());
+	if (Header.DataSize)
+		std::memcpy(Record + sizeof(Header) + text.size(), data, Header.DataSize);
+
+	m_Head.store(Head + PaddingSize + Size, std::memory_order_release);
+	return true;
+}
+
+// The rings of the thread are detached when it exits, they are removed by the task of the log when they are empty.
+struct tLogRingsOfThread
+{
+	std::vector<std::pair<std::uint64_t, std::shared_ptr<tLogRing>>> Rings; // tLog::m_Id
+
+	~tLogRingsOfThread()
+	{
+		for (auto& Ring : Rings)
+			Ring.second->Detach();
+	}
+};
+
+static std::atomic<std::uint64_t> g_LogIdNext = 0;
+
+}
+
+tLog::tLog()
+	:m_Id(++hidden::g_LogIdNext)
+{
+}
+
+tLog::~tLog()
+{
+	// The derived class is destroyed, so the records left are not written out.
+	if (m_Thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> Lock(m_ThreadMtx);
+			m_ThreadStop = true;
+		}
+		m_ThreadCv.notify_all();
+		m_Thread.join();
+	}
+}
+
+void tLog::StopAsync()
+{
+	Flush();
+
+	{
+		std::lock_guard<std::mutex> Lock(m_ThreadMtx);
+		m_ThreadStop = true; // the thread is not started after it
+	}
+
+	if (!m_Thread.joinable())
+		return;
+
+	m_ThreadCv.notify_all();
+	m_Thread.join();
+}
+
+void tLog::Flush()
+{
+	std::unique_lock<std::mutex> Lock(m_ThreadMtx);
+	if (m_ThreadStop || !m_Thread.joinable()) // nothing has been written yet
+		return;
+	const std::uint64_t Request = ++m_FlushRequested;
+	m_ThreadCv.notify_all();
+	m_ThreadCv.wait(Lock, [&]() { return m_FlushDone >= Request || m_ThreadStop; });
+}
+
+hidden::tLogRing* tLog::GetRing()
+{
+	thread_local hidden::tLogRingsOfThread RingsOfThread;
+
+	for (auto& Ring : RingsOfThread.Rings)
+	{
+		if (Ring.first == m_Id)
+			return Ring.second.get();
+	}
+
+	auto Ring = std::make_shared<hidden::tLogRing>(LIB_UTILS_LOG_ASYNC_RING_SIZE);
+	{
+		std::lock_guard<std::mutex> Lock(m_RingsMtx);
+		m_Rings.push_back(Ring);
+	}
+	RingsOfThread.Rings.emplace_back(m_Id, Ring);
+	return Ring.get();
+}
+
+void tLog::Push(hidden::tLogRing::tKind kind, bool timestamp, bool endl, std::string_view text, tColor color, const std::vector<std::uint8_t>* data, int dataLinesBegin, int dataLinesEnd)
+{
+	hidden::tLogRing::tRecordHeader Header;
+	Header.Kind = kind;
+	Header.Color = color;
+	Header.Timestamp = timestamp;
+	Header.Endl = endl;
+	Header.DataLinesBegin = dataLinesBegin;
+	Header.DataLinesEnd = dataLinesEnd;
+	Header.DataSize = data ? static_cast<std::uint32_t>(data->size()) : 0;
+	Header.Time = std::chrono::system_clock::now().time_since_epoch().count();
+
+	if (!m_ThreadStarted.load(std::memory_order_acquire))
+		StartThread();
+
+	if (hidden::tLogRing::GetRecordSize(text.size(), Header.DataSize) > LIB_UTILS_LOG_ASYNC_RING_SIZE / 2)
+	{
+		// It doesn't fit the ring, it's written out by this thread after the records pushed before it.
+		Flush();
+		std::lock_guard<std::mutex> Lock(m_Mtx);
+		const std::chrono::system_clock::time_point Time{ std::chrono::system_clock::duration(Header.Time) };
+		WriteLog(Time, timestamp, endl, kind == hidden::tLogRing::tKind::Hex ? MakeStringHex(*data, dataLinesBegin, dataLinesEnd) : std::string(text), color);
+		return;
+	}
+
+	hidden::tLogRing* Ring = GetRing();
+	if (!Ring->Push(Header, text, data ? data->data() : nullptr))
+		++m_DroppedQty;
+
+	if (Ring->IsHalfFull() && !m_ThreadWake.exchange(true))
+		m_ThreadCv.notify_one();
+}
+
+void tLog::StartThread()
+{
+	std::lock_guard<std::mutex> Lock(m_ThreadMtx);
+	if (m_ThreadStarted || m_ThreadStop)
+		return;
+	m_Thread = std::thread(&tLog::TaskLog, this);
+	m_ThreadStarted.store(true, std::memory_order_release);
+}
+
+void tLog::TaskLog()
+{
+	std::unique_lock<std::mutex> Lock(m_ThreadMtx);
+	for (;;)
+	{
+		m_ThreadCv.wait_for(Lock, std::chrono::milliseconds(LIB_UTILS_LOG_ASYNC_PERIOD), [&]() { return m_ThreadStop || m_ThreadWake || m_FlushRequested > m_FlushDone; });
+		if (m_ThreadStop)
+			break;
+
+		m_ThreadWake = false;
+		const std::uint64_t FlushRequested = m_FlushRequested;
+		Lock.unlock();
+		while (WriteRings()); // the records written during the writing out are written out as well
+		Lock.lock();
+
+		m_FlushDone = FlushRequested;
+		m_ThreadCv.notify_all();
+	}
+}
+
+bool tLog::WriteRings()
+{
+	struct tRecord
+	{
+		hidden::tLogRing::tRecordHeader Header;
+		std::string Text;
+		std::vector<std::uint8_t> Data;
+	};
+
+	std::vector<std::shared_ptr<hidden::tLogRing>> Rings;
+	{
+		std::lock_guard<std::mutex> Lock(m_RingsMtx);
+		// The rings of the threads which have exited are removed when everything has been read from them.
+		m_Rings.erase(std::remove_if(m_Rings.begin(), m_Rings.end(), [](const auto& ring) { return ring->IsDetached() && ring->IsEmpty(); }), m_Rings.end());
+		Rings = m_Rings;
+	}
+
+	std::vector<tRecord> Records;
+	std::uint64_t DroppedQty = 0;
+	for (auto& Ring : Rings)
+	{
+		DroppedQty += Ring->ExchangeDroppedQty();
+		Ring->Pop([&](const hidden::tLogRing::tRecordHeader& header, std::string_view text, const std::uint8_t* data)
+			{
+				Records.push_back({ header, std::string(text), std::vector<std::uint8_t>(data, data + header.DataSize) });
+			});
+	}
+
+	if (Records.empty() && !DroppedQty)
+		return false;
+
+	// The records of different threads are ordered by the time, the order of the records of one thread is kept.
+	std::stable_sort(Records.begin(), Records.end(), [](const tRecord& a, const tRecord& b) { return a.Header.Time < b.Header.Time; });
+
+	std::lock_guard<std::mutex> Lock(m_Mtx);
+
+	if (DroppedQty)
+		WriteLog(std::chrono::system_clock::now(), true, true, "< " + std::to_string(DroppedQty) + " log records are dropped >", tColor::LightRed);
+
+	for (auto& Record : Records)
+	{
+		const std::chrono::system_clock::time_point Time{ std::chrono::system_clock::duration(Record.Header.Time) };
+		if (Record.Header.Kind == hidden::tLogRing::tKind::Hex)
+			Record.Text = MakeStringHex(Record.Data, Record.Header.DataLinesBegin, Record.Header.DataLinesEnd);
+		WriteLog(Time, Record.Header.Timestamp, Record.Header.Endl, Record.Text, Record.Header.Color);
+	}
+	return true;
+}
+#endif // LIB_UTILS_LOG_ASYNC
+
 }
 }
 
@@ -9,10 +9,20 @@
 
 #include <cstdint>
 
+#include <chrono>
 #include <mutex>
 #include <string>
 #include <vector>
 
+#ifdef LIB_UTILS_LOG_ASYNC
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <thread>
+#endif // LIB_UTILS_LOG_ASYNC
+
 namespace utils
 {
 namespace log
@@ -41,13 +51,114 @@ enum class tColor
 
 #ifdef LIB_UTILS_LOG
 
+#ifdef LIB_UTILS_LOG_ASYNC
+namespace hidden
+{
+
+// Byte ring of one thread writing to the log (single producer), it is read by the task of the log (single consumer).
+// A record is the header followed by the text and the data (WriteHex), the record is not split at the end of the buffer.
+// A record larger than half of the buffer is not pushed, it's written out by its thread (tLog::Push).
+class tLogRing
+{
+public:
+	enum class tKind : std::uint8_t
+	{
+		Padding, // the rest of the buffer up to its end
+		Text,
+		Hex,
+	};
+
+	struct tRecordHeader
+	{
+		std::uint32_t Size = 0; // of the whole record, aligned to the header size
+		tKind Kind = tKind::Padding;
+		tColor Color = tColor::Default;
+		bool Timestamp = false;
+		bool Endl = false;
+		std::int32_t DataLinesBegin = 0;
+		std::int32_t DataLinesEnd = 0;
+		std::uint32_t TextSize = 0;
+		std::uint32_t DataSize = 0;
+		std::int64_t Time = 0; // std::chrono::system_clock
+	};
+
+private:
+	std::vector<std::uint8_t> m_Buffer;
+	const std::size_t m_Mask;
+	alignas(64) std::atomic<std::size_t> m_Head = 0; // written by the producer
+	alignas(64) std::atomic<std::size_t> m_Tail = 0; // written by the consumer
+	alignas(64) std::atomic<std::uint64_t> m_DroppedQty = 0;
+	std::atomic<bool> m_Detached = false; // the producer thread has exited
+
+public:
+	explicit tLogRing(std::size_t capacity); // power of 2
+
+	static std::size_t GetRecordSize(std::size_t textSize, std::size_t dataSize);
+	bool Push(const tRecordHeader& header, std::string_view text, const std::uint8_t* data); // returns false if there is no room for the record (it's dropped)
+
+	// The record is passed to the handler as (const tRecordHeader& header, std::string_view text, const std::uint8_t* data).
+	template<class THandler>
+	std::size_t Pop(THandler handler)
+	{
+		std::size_t Qty = 0;
+		std::size_t Tail = m_Tail.load(std::memory_order_relaxed);
+		const std::size_t Head = m_Head.load(std::memory_order_acquire);
+		while (Tail != Head)
+		{
+			const std::uint8_t* Record = m_Buffer.data() + (Tail & m_Mask);
+			tRecordHeader Header;
+			std::memcpy(&Header, Record, sizeof(Header));
+			if (Header.Kind != tKind::Padding)
+			{
+				const std::string_view Text(reinterpret_cast<const char*>(Record + sizeof(Header)), Header.TextSize);
+				handler(Header, Text, Record + sizeof(Header) + Header.TextSize);
+				++Qty;
+			}
+			Tail += Header.Size;
+			m_Tail.store(Tail, std::memory_order_release);
+		}
+		return Qty;
+	}
+
+	bool IsEmpty() const { return m_Tail.load(std::memory_order_acquire) == m_Head.load(std::memory_order_acquire); }
+	bool IsHalfFull() const { return m_Head.load(std::memory_order_relaxed) - m_Tail.load(std::memory_order_relaxed) >= m_Buffer.size() / 2; }
+
+	void Detach() { m_Detached = true; }
+	bool IsDetached() const { return m_Detached; }
+
+	std::uint64_t ExchangeDroppedQty() { return m_DroppedQty.exchange(0); }
+};
+
+}
+#endif // LIB_UTILS_LOG_ASYNC
+
 class tLog
 {
 	mutable std::mutex m_Mtx;
 
+#ifdef LIB_UTILS_LOG_ASYNC
+	const std::uint64_t m_Id; // the rings of a thread are found by it
+	std::mutex m_RingsMtx;
+	std::vector<std::shared_ptr<hidden::tLogRing>> m_Rings;
+	std::thread m_Thread; // it's started by the first record, so the derived class has been constructed
+	std::atomic<bool> m_ThreadStarted = false;
+	std::mutex m_ThreadMtx;
+	std::condition_variable m_ThreadCv;
+	bool m_ThreadStop = false;
+	std::atomic<bool> m_ThreadWake = false; // a ring is half full, it's not waited for the period
+	std::uint64_t m_FlushRequested = 0;
+	std::uint64_t m_FlushDone = 0;
+	std::atomic<std::uint64_t> m_DroppedQty = 0;
+#endif // LIB_UTILS_LOG_ASYNC
+
 public:
+#ifdef LIB_UTILS_LOG_ASYNC
+	tLog();
+	virtual ~tLog();
+#else // LIB_UTILS_LOG_ASYNC
 	tLog() = default;
 	virtual ~tLog() {}
+#endif // LIB_UTILS_LOG_ASYNC
 
 	void Write(bool timestamp, const std::string& msg, tColor color);
 	void Write(bool timestamp, const std::string& msg);
@@ -74,14 +185,35 @@ public:
 	void WriteHex(bool timestamp, const std::string& msg, const std::vector<std::uint8_t>& data, int dataLinesBegin, int dataLinesEnd);
 	void WriteHex(bool timestamp, const std::string& msg, const std::vector<std::uint8_t>& data);
 
+#ifdef LIB_UTILS_LOG_ASYNC
+	void Flush(); // it returns when the records written before the call have been written out
+	std::uint64_t GetDroppedQty() const { return m_DroppedQty; }
+#endif // LIB_UTILS_LOG_ASYNC
+
 protected:
 	virtual std::string GetLabel() const { return {}; }
 
 	virtual void WriteLog(const std::string& text) = 0;
 	virtual void WriteLogFile(const std::string& text) {}
 
+#ifdef LIB_UTILS_LOG_ASYNC
+	// The records are written out by WriteLog(text) which is overridden by the derived class,
+	// so the derived class shall call it in its destructor.
+	void StopAsync();
+#endif // LIB_UTILS_LOG_ASYNC
+
 private:
 	virtual void WriteLog(bool timestamp, bool endl, const std::string& text, tColor textColor);
+
+	void WriteLog(std::chrono::system_clock::time_point time, bool timestamp, bool endl, const std::string& text, tColor textColor); // m_Mtx is locked
+
+#ifdef LIB_UTILS_LOG_ASYNC
+	void Push(hidden::tLogRing::tKind kind, bool timestamp, bool endl, std::string_view text, tColor color, const std::vector<std::uint8_t>* data, int dataLinesBegin, int dataLinesEnd);
+	hidden::tLogRing* GetRing();
+	void StartThread();
+	void TaskLog();
+	bool WriteRings(); // returns false if nothing has been written
+#endif // LIB_UTILS_LOG_ASYNC
 };
 
 #else // LIB_UTILS_LOG
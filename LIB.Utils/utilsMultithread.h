@@ -5,7 +5,10 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <deque>
+#include <memory>
 #include <mutex>
 
 namespace utils
@@ -29,19 +32,23 @@ public:
 		m_Queue.pop_front();
 		return Pack;
 	}
-	void push_back(const T& val)
+	bool push_back(const T& val) // returns false if the oldest element has been dropped
 	{
 		std::lock_guard<std::mutex> guard(m_QueueMtx);
-		if (m_Queue.size() >= Size)
+		const bool Full = m_Queue.size() >= Size;
+		if (Full)
 			m_Queue.pop_front();
 		m_Queue.push_back(val);
+		return !Full;
 	}
-	void push_back(T&& val)
+	bool push_back(T&& val) // returns false if the oldest element has been dropped
 	{
 		std::lock_guard<std::mutex> guard(m_QueueMtx);
-		if (m_Queue.size() >= Size)
+		const bool Full = m_Queue.size() >= Size;
+		if (Full)
 			m_Queue.pop_front();
 		m_Queue.push_back(std::move(val));
+		return !Full;
 	}
 	void clear()
 	{
@@ -55,5 +62,43 @@ public:
 	}
 };
 
+// Lock-free ring for one producer and one consumer, Size is a power of 2.
+// The elements are moved in and out, a popped slot is left with the moved-from element.
+template <class T, std::size_t Size>
+class tQueueSPSC
+{
+	static_assert(Size > 0 && (Size & (Size - 1)) == 0, "Size must be a power of 2");
+
+	std::unique_ptr<T[]> m_Items{ new T[Size] };
+	alignas(64) std::atomic<std::size_t> m_Head{ 0 }; // the consumer
+	alignas(64) std::atomic<std::size_t> m_Tail{ 0 }; // the producer
+
+public:
+	bool try_push(T&& val) // returns false if the queue is full, val is not moved then
+	{
+		const std::size_t Tail = m_Tail.load(std::memory_order_relaxed);
+		if (Tail - m_Head.load(std::memory_order_acquire) >= Size)
+			return false;
+		m_Items[Tail & (Size - 1)] = std::move(val);
+		m_Tail.store(Tail + 1, std::memory_order_release);
+		return true;
+	}
+	bool try_pop(T& val) // returns false if the queue is empty
+	{
+		const std::size_t Head = m_Head.load(std::memory_order_relaxed);
+		if (Head == m_Tail.load(std::memory_order_acquire))
+			return false;
+		val = std::move(m_Items[Head & (Size - 1)]);
+		m_Head.store(Head + 1, std::memory_order_release);
+		return true;
+	}
+	std::size_t size() const
+	{
+		const std::size_t Head = m_Head.load(std::memory_order_acquire); // before the tail, so it's not ahead of it
+		return m_Tail.load(std::memory_order_acquire) - Head;
+	}
+	bool empty() const { return size() == 0; }
+};
+
 }
 }
@@ -1,6 +1,7 @@
 #include "utilsPacketMQTTv3_1_1.h"
 
 #include <algorithm>
+#include <array>
 #include <variant>
 
 namespace utils
@@ -175,7 +176,7 @@ std::optional<tString> tString::Parse(tSpan& data)
 std::vector<std::uint8_t> tString::ToVector() const
 {
 	std23::vector<std::uint8_t> Data;
-	tUInt16 StrSize = static_cast<std::uint8_t>(size());
+	tUInt16 StrSize = static_cast<std::uint16_t>(size());
 	Data.append_range(StrSize.ToVector());
 	Data.insert(Data.end(), begin(), end());
 	return Data;
@@ -214,7 +215,16 @@ std::optional<std::uint32_t> tRemainingLength::Parse(tSpan& data)
 std::vector<std::uint8_t> tRemainingLength::ToVector(std::uint32_t val)
 {
 	std::vector<std::uint8_t> Data;
-	for (std::size_t i = 0; i < m_SizeMax; ++i)
+	if (!Append(Data, val))
+		return {};
+	return Data;
+}
+
+bool tRemainingLength::Append(std::vector<std::uint8_t>& data, std::uint32_t val)
+{
+	std::array<std::uint8_t, m_SizeMax> Parts{};
+	std::size_t Size = 0;
+	for (; Size < m_SizeMax; ++Size)
 	{
 		tLengthPart Part{};
 		Part.Field.Num = val;
@@ -223,16 +233,17 @@ std::vector<std::uint8_t> tRemainingLength::ToVector(std::uint32_t val)
 		if (val)
 			Part.Field.Continuation = 1;
 
-		Data.push_back(Part.Value);
+		Parts[Size] = Part.Value;
 
 		if (!val)
 			break;
 	}
 
 	if (val)
-		return {};
+		return false;
 
-	return Data;
+	data.insert(data.end(), Parts.begin(), Parts.begin() + Size + 1);
+	return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -253,13 +264,23 @@ std::string tFixedHeaderBase::ToStringControlPacketType() const
 
 std::vector<std::uint8_t> tFixedHeaderBase::ToVector(std::size_t dataSize) const
 {
-	std23::vector<std::uint8_t> Vect = tRemainingLength::ToVector(static_cast<std::uint32_t>(dataSize));
-	if (Vect.empty())
+	std::vector<std::uint8_t> Vect;
+	if (!Append(Vect, dataSize))
 		return {};
-	Vect.insert(Vect.begin(), Data.Value);
 	return Vect;
 }
 
+bool tFixedHeaderBase::Append(std::vector<std::uint8_t>& data, std::size_t dataSize) const
+{
+	if (dataSize > UINT32_MAX)
+		return false;
+	data.push_back(Data.Value);
+	if (tRemainingLength::Append(data, static_cast<std::uint32_t>(dataSize)))
+		return true;
+	data.pop_back();
+	return false;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // CONNECT
 
@@ -577,32 +598,40 @@ tContentPUBLISH::tVariableHeader& tContentPUBLISH::tVariableHeader::operator=(tV
 	return *this;
 }
 
-tContentPUBLISH::tContentPUBLISH(bool retain, const std::string& topicName)
+tContentPUBLISH::tContentPUBLISH(bool retain, std::string_view topicName)
 	:FixedHeader(retain, tQoS::AtMostOnceDelivery, false) // 738 [MQTT-3.3.1.-1]. The DUP flag MUST be set to 0 for all QoS 0 messages [MQTT-3.3.1-2].
 {
-	VariableHeader.TopicName = topicName;
+	VariableHeader.TopicName = std::string(topicName);
 }
 
-tContentPUBLISH::tContentPUBLISH(bool retain, const std::string& topicName, const std::vector<std::uint8_t>& payload)
-	:FixedHeader(retain, tQoS::AtMostOnceDelivery, false) // 738 [MQTT-3.3.1.-1]. The DUP flag MUST be set to 0 for all QoS 0 messages [MQTT-3.3.1-2].
+tContentPUBLISH::tContentPUBLISH(bool retain, std::string_view topicName, std::vector<std::uint8_t> payload)
+	:FixedHeader(retain, tQoS::AtMostOnceDelivery, false), Payload(std::move(payload)) // 738 [MQTT-3.3.1.-1]. The DUP flag MUST be set to 0 for all QoS 0 messages [MQTT-3.3.1-2].
+{
+	VariableHeader.TopicName = std::string(topicName);
+}
+
+tContentPUBLISH::tContentPUBLISH(bool retain, std::string_view topicName, std::span<const std::uint8_t> payload)
+	:tContentPUBLISH(retain, topicName, std::vector<std::uint8_t>(payload.begin(), payload.end()))
 {
-	VariableHeader.TopicName = topicName;
-	Payload = payload;
 }
 
-tContentPUBLISH::tContentPUBLISH(bool retain, bool dup, const std::string& topicName, tQoS qos, tUInt16 packetId)
+tContentPUBLISH::tContentPUBLISH(bool retain, bool dup, std::string_view topicName, tQoS qos, tUInt16 packetId)
 	:FixedHeader(retain, qos, dup)
 {
-	VariableHeader.TopicName = topicName;
+	VariableHeader.TopicName = std::string(topicName);
 	VariableHeader.PacketId = packetId;
 }
 
-tContentPUBLISH::tContentPUBLISH(bool retain, bool dup, const std::string& topicName, tQoS qos, tUInt16 packetId, const std::vector<std::uint8_t>& payload)
-	:FixedHeader(retain, qos, dup)
+tContentPUBLISH::tContentPUBLISH(bool retain, bool dup, std::string_view topicName, tQoS qos, tUInt16 packetId, std::vector<std::uint8_t> payload)
+	:FixedHeader(retain, qos, dup), Payload(std::move(payload))
 {
-	VariableHeader.TopicName = topicName;
+	VariableHeader.TopicName = std::string(topicName);
 	VariableHeader.PacketId = packetId;
-	Payload = payload;
+}
+
+tContentPUBLISH::tContentPUBLISH(bool retain, bool dup, std::string_view topicName, tQoS qos, tUInt16 packetId, std::span<const std::uint8_t> payload)
+	:tContentPUBLISH(retain, dup, topicName, qos, packetId, std::vector<std::uint8_t>(payload.begin(), payload.end()))
+{
 }
 
 tContentPUBLISH::tContentPUBLISH(tContentPUBLISH&& val) noexcept
@@ -645,21 +674,46 @@ std::optional<tContentPUBLISH> tContentPUBLISH::Parse(tSpan& data)
 
 std::string tContentPUBLISH::ToString() const
 {
-	std::string Str = FixedHeader.ToString(true);
-	Str += " Topic name: " + VariableHeader.TopicName;
-	Str += mqtt_main::ToString("; Packet ID: ", VariableHeader.PacketId);
-	Str += std::string("; Payload size: ") + std::to_string(Payload.size());
+	return ToString(FixedHeader, VariableHeader.TopicName, VariableHeader.PacketId, Payload.size());
+}
+
+std::string tContentPUBLISH::ToString(const tFixedHeader& fixedHeader, std::string_view topicName, const std::optional<tUInt16>& packetId, std::size_t payloadSize)
+{
+	std::string Str = fixedHeader.ToString(true);
+	Str += " Topic name: ";
+	Str += topicName;
+	Str += mqtt_main::ToString("; Packet ID: ", packetId);
+	Str += std::string("; Payload size: ") + std::to_string(payloadSize);
 	return Str;
 }
 
 std::vector<std::uint8_t> tContentPUBLISH::ToVector() const
 {
-	std23::vector<std::uint8_t> Data;
-	Data.append_range(VariableHeader.TopicName.ToVector());
-	if (VariableHeader.PacketId.has_value())
-		Data.append_range(VariableHeader.PacketId->ToVector());
-	Data.append_range(Payload);
-	Data.insert_range(Data.begin(), FixedHeader.ToVector(Data.size()));
+	return ToVector(FixedHeader, VariableHeader.TopicName, VariableHeader.PacketId, Payload);
+}
+
+std::vector<std::uint8_t> tContentPUBLISH::ToVector(const tFixedHeader& fixedHeader, std::string_view topicName, const std::optional<tUInt16>& packetId, std::span<const std::uint8_t> payload)
+{
+	if (topicName.size() > UINT16_MAX)
+		return {};
+
+	const std::size_t DataSize = tString::GetSizeMin() + topicName.size() + (packetId.has_value() ? tUInt16::GetSize() : 0) + payload.size();
+
+	std::vector<std::uint8_t> Data;
+	Data.reserve(1 + tRemainingLength::GetSizeMax() + DataSize);
+	if (!fixedHeader.Append(Data, DataSize))
+		return {};
+
+	const tUInt16 TopicNameSize = static_cast<std::uint16_t>(topicName.size());
+	Data.push_back(static_cast<std::uint8_t>(TopicNameSize.Field.MSB));
+	Data.push_back(static_cast<std::uint8_t>(TopicNameSize.Field.LSB));
+	Data.insert(Data.end(), topicName.begin(), topicName.end());
+	if (packetId.has_value())
+	{
+		Data.push_back(static_cast<std::uint8_t>(packetId->Field.MSB));
+		Data.push_back(static_cast<std::uint8_t>(packetId->Field.LSB));
+	}
+	Data.insert(Data.end(), payload.begin(), payload.end());
 	return Data;
 }
 
@@ -905,6 +959,73 @@ std::optional<tPacketDataSpan> TestPacket(const std::vector<std::uint8_t>& data)
 	return TestPacket(DataSpan);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool IsTopicNameValid(std::string_view topicName)
+{
+	return !topicName.empty() && topicName.find_first_of(std::string_view("+#\0", 3)) == std::string_view::npos;
+}
+
+bool IsTopicFilterValid(std::string_view topicFilter)
+{
+	if (topicFilter.empty() || topicFilter.find('\0') != std::string_view::npos)
+		return false;
+
+	for (std::size_t i = 0; i < topicFilter.size(); ++i)
+	{
+		const bool LevelBegin = i == 0 || topicFilter[i - 1] == '/';
+		const bool LevelEnd = i + 1 == topicFilter.size() || topicFilter[i + 1] == '/';
+		switch (topicFilter[i])
+		{
+		case '#':
+			if (!LevelBegin || i + 1 != topicFilter.size())
+				return false;
+			break;
+		case '+':
+			if (!LevelBegin || !LevelEnd)
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+bool IsTopicFilterMatch(std::string_view topicFilter, std::string_view topicName)
+{
+	if (!topicName.empty() && topicName[0] == '$' && !topicFilter.empty() && (topicFilter[0] == '+' || topicFilter[0] == '#'))
+		return false;
+
+	std::size_t f = 0;
+	std::size_t n = 0;
+	while (f < topicFilter.size())
+	{
+		if (topicFilter[f] == '#') // 1213 ... "sport/tennis/player1/#" would receive messages published using ... "sport/tennis/player1"
+			return true;
+
+		if (topicFilter[f] == '+')
+		{
+			const std::size_t LevelEnd = topicName.find('/', n);
+			n = LevelEnd == std::string_view::npos ? topicName.size() : LevelEnd;
+			++f;
+		}
+		else
+		{
+			if (n >= topicName.size() || topicFilter[f] != topicName[n])
+				return false;
+			++f;
+			++n;
+		}
+
+		if (f == topicFilter.size())
+			break;
+
+		// "sport/#" matches "sport" as well: the separator before '#' is the parent level
+		if (n == topicName.size() && topicFilter.size() - f == 2 && topicFilter[f] == '/' && topicFilter[f + 1] == '#')
+			return true;
+	}
+	return n == topicName.size();
+}
+
 }
 }
 }
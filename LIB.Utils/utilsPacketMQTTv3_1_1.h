@@ -14,6 +14,7 @@
 #include <optional>
 #include <span> // C++ 20
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -157,7 +158,7 @@ public:
 	tString() = default;
 	tString(const char* val) :std::string(val) {} // not explicit
 	tString(const std::string& val) :std::string(val) {} // not explicit
-	tString(std::string&& val) :std::string(val) {} // not explicit
+	tString(std::string&& val) :std::string(std::move(val)) {} // not explicit
 
 	std::size_t GetSize() const { return size() + GetSizeMin(); }
 	static constexpr std::size_t GetSizeMin() { return tUInt16::GetSize(); }
@@ -222,6 +223,9 @@ class tRemainingLength
 public:
 	static std::optional<std::uint32_t> Parse(tSpan& data);
 	static std::vector<std::uint8_t> ToVector(std::uint32_t val);
+	static bool Append(std::vector<std::uint8_t>& data, std::uint32_t val); // false - the value is too large, nothing is appended
+
+	static constexpr std::size_t GetSizeMax() { return m_SizeMax; }
 };
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -287,6 +291,7 @@ public:
 	std::string ToStringControlPacketType() const;
 
 	std::vector<std::uint8_t> ToVector(std::size_t dataSize) const;
+	bool Append(std::vector<std::uint8_t>& data, std::size_t dataSize) const; // false - dataSize is too large, nothing is appended
 
 	bool operator==(const tFixedHeaderBase& val) const { return Data.Value == val.Data.Value; }
 };
@@ -360,6 +365,7 @@ private:
 
 protected:
 	explicit tPacketBase(const TCont& content) :m_Content(content) {}
+	explicit tPacketBase(TCont&& content) :m_Content(std::move(content)) {}
 
 public:
 	tPacketBase(const tPacketBase&) = default;
@@ -636,18 +642,24 @@ struct tContentPUBLISH
 	using payload_type = std::vector<std::uint8_t>;
 
 	tContentPUBLISH() = default;
-	tContentPUBLISH(bool retain, const std::string& topicName);
-	tContentPUBLISH(bool retain, const std::string& topicName, const std::vector<std::uint8_t>& payload);
-	tContentPUBLISH(bool retain, bool dup, const std::string& topicName, tQoS qos, tUInt16 packetId);
-	tContentPUBLISH(bool retain, bool dup, const std::string& topicName, tQoS qos, tUInt16 packetId, const std::vector<std::uint8_t>& payload);
+	tContentPUBLISH(bool retain, std::string_view topicName);
+	tContentPUBLISH(bool retain, std::string_view topicName, std::vector<std::uint8_t> payload); // the payload is moved in
+	tContentPUBLISH(bool retain, std::string_view topicName, std::span<const std::uint8_t> payload);
+	tContentPUBLISH(bool retain, bool dup, std::string_view topicName, tQoS qos, tUInt16 packetId);
+	tContentPUBLISH(bool retain, bool dup, std::string_view topicName, tQoS qos, tUInt16 packetId, std::vector<std::uint8_t> payload); // the payload is moved in
+	tContentPUBLISH(bool retain, bool dup, std::string_view topicName, tQoS qos, tUInt16 packetId, std::span<const std::uint8_t> payload);
 	tContentPUBLISH(const tContentPUBLISH&) = default;
 	tContentPUBLISH(tContentPUBLISH&& val) noexcept;
 
 	static std::optional<tContentPUBLISH> Parse(tSpan& data);
 
 	std::string ToString() const;
+	static std::string ToString(const tFixedHeader& fixedHeader, std::string_view topicName, const std::optional<tUInt16>& packetId, std::size_t payloadSize);
 
 	std::vector<std::uint8_t> ToVector() const;
+	// The packet is encoded into one allocation, the fixed header is followed by the variable header and the payload.
+	// No value (empty) if the Topic Name or the packet is too large.
+	static std::vector<std::uint8_t> ToVector(const tFixedHeader& fixedHeader, std::string_view topicName, const std::optional<tUInt16>& packetId, std::span<const std::uint8_t> payload);
 
 	tContentPUBLISH& operator=(const tContentPUBLISH& val) = default;
 	tContentPUBLISH& operator=(tContentPUBLISH&& val) noexcept;
@@ -939,6 +951,7 @@ class tPacketPUBLISH : public hidden::tPacketBase<hidden::tContentPUBLISH>
 {
 };
 
+// The payload given as std::vector<std::uint8_t> is moved into the packet (it's copied if it's an lvalue), std::span is copied.
 template<>
 class tPacketPUBLISH<tQoS::AtMostOnceDelivery> : public hidden::tPacketBase<hidden::tContentPUBLISH>
 {
@@ -946,11 +959,15 @@ public:
 	using response_type = tPacketNOACK;
 
 	tPacketPUBLISH() = delete;
-	tPacketPUBLISH(bool retain, const std::string& topicName)
+	tPacketPUBLISH(bool retain, std::string_view topicName)
 		:tPacketBase(hidden::tContentPUBLISH(retain, topicName))
 	{
 	}
-	tPacketPUBLISH(bool retain, const std::string& topicName, const std::vector<std::uint8_t>& payload)
+	tPacketPUBLISH(bool retain, std::string_view topicName, std::vector<std::uint8_t> payload)
+		:tPacketBase(hidden::tContentPUBLISH(retain, topicName, std::move(payload)))
+	{
+	}
+	tPacketPUBLISH(bool retain, std::string_view topicName, std::span<const std::uint8_t> payload)
 		:tPacketBase(hidden::tContentPUBLISH(retain, topicName, payload))
 	{
 	}
@@ -963,11 +980,15 @@ public:
 	using response_type = tPacketPUBACK;
 
 	tPacketPUBLISH() = delete;
-	tPacketPUBLISH(bool retain, bool dup, const std::string& topicName, tUInt16 packetId)
-		:tPacketBase(hidden::tContentPUBLISH(dup, retain, topicName, tQoS::AtLeastOnceDelivery, packetId))
+	tPacketPUBLISH(bool retain, bool dup, std::string_view topicName, tUInt16 packetId)
+		:tPacketBase(hidden::tContentPUBLISH(retain, dup, topicName, tQoS::AtLeastOnceDelivery, packetId))
+	{
+	}
+	tPacketPUBLISH(bool retain, bool dup, std::string_view topicName, tUInt16 packetId, std::vector<std::uint8_t> payload)
+		:tPacketBase(hidden::tContentPUBLISH(retain, dup, topicName, tQoS::AtLeastOnceDelivery, packetId, std::move(payload)))
 	{
 	}
-	tPacketPUBLISH(bool retain, bool dup, const std::string& topicName, tUInt16 packetId, const std::vector<std::uint8_t>& payload)
+	tPacketPUBLISH(bool retain, bool dup, std::string_view topicName, tUInt16 packetId, std::span<const std::uint8_t> payload)
 		:tPacketBase(hidden::tContentPUBLISH(retain, dup, topicName, tQoS::AtLeastOnceDelivery, packetId, payload))
 	{
 	}
@@ -980,11 +1001,15 @@ public:
 	using response_type = tPacketPUBREC;
 
 	tPacketPUBLISH() = delete;
-	tPacketPUBLISH(bool retain, bool dup, const std::string& topicName, tUInt16 packetId)
+	tPacketPUBLISH(bool retain, bool dup, std::string_view topicName, tUInt16 packetId)
 		:tPacketBase(hidden::tContentPUBLISH(retain, dup, topicName, tQoS::ExactlyOnceDelivery, packetId))
 	{
 	}
-	tPacketPUBLISH(bool retain, bool dup, const std::string& topicName, tUInt16 packetId, const std::vector<std::uint8_t>& payload)
+	tPacketPUBLISH(bool retain, bool dup, std::string_view topicName, tUInt16 packetId, std::vector<std::uint8_t> payload)
+		:tPacketBase(hidden::tContentPUBLISH(retain, dup, topicName, tQoS::ExactlyOnceDelivery, packetId, std::move(payload)))
+	{
+	}
+	tPacketPUBLISH(bool retain, bool dup, std::string_view topicName, tUInt16 packetId, std::span<const std::uint8_t> payload)
 		:tPacketBase(hidden::tContentPUBLISH(retain, dup, topicName, tQoS::ExactlyOnceDelivery, packetId, payload))
 	{
 	}
@@ -992,6 +1017,76 @@ public:
 
 using tPacketPUBLISH_Parse = tPacketPUBLISH<tQoS::AtMostOnceDelivery>;
 
+namespace hidden
+{
+
+class tPacketPUBLISH_ViewBase : public tPacket
+{
+	tContentPUBLISH::tFixedHeader m_FixedHeader;
+	std::string_view m_TopicName;
+	std::optional<tUInt16> m_PacketId;
+	std::span<const std::uint8_t> m_Payload;
+
+protected:
+	tPacketPUBLISH_ViewBase(const tContentPUBLISH::tFixedHeader& fixedHeader, std::string_view topicName, std::optional<tUInt16> packetId, std::span<const std::uint8_t> payload)
+		:m_FixedHeader(fixedHeader), m_TopicName(topicName), m_PacketId(packetId), m_Payload(payload)
+	{
+	}
+
+public:
+	static tControlPacketType GetControlPacketType() { return tControlPacketType::PUBLISH; }
+
+	std::string ToString() const override { return tContentPUBLISH::ToString(m_FixedHeader, m_TopicName, m_PacketId, m_Payload.size()); }
+	std::string ToStringControlPacketType() const override { return m_FixedHeader.ToStringControlPacketType(); }
+
+	std::vector<std::uint8_t> ToVector() const override { return tContentPUBLISH::ToVector(m_FixedHeader, m_TopicName, m_PacketId, m_Payload); }
+};
+
+}
+
+// PUBLISH to be sent: the Topic Name and the payload are viewed, they are copied once - into the encoded packet (ToVector()).
+// The data viewed must be kept while the packet exists.
+template<tQoS qos>
+class tPacketPUBLISH_View : public hidden::tPacketPUBLISH_ViewBase
+{
+};
+
+template<>
+class tPacketPUBLISH_View<tQoS::AtMostOnceDelivery> : public hidden::tPacketPUBLISH_ViewBase
+{
+public:
+	using response_type = tPacketNOACK;
+
+	tPacketPUBLISH_View(bool retain, std::string_view topicName, std::span<const std::uint8_t> payload)
+		:tPacketPUBLISH_ViewBase(hidden::tContentPUBLISH::tFixedHeader(retain, tQoS::AtMostOnceDelivery, false), topicName, {}, payload) // [MQTT-3.3.1-2] DUP is 0 for QoS 0
+	{
+	}
+};
+
+template<>
+class tPacketPUBLISH_View<tQoS::AtLeastOnceDelivery> : public hidden::tPacketPUBLISH_ViewBase
+{
+public:
+	using response_type = tPacketPUBACK;
+
+	tPacketPUBLISH_View(bool retain, bool dup, std::string_view topicName, tUInt16 packetId, std::span<const std::uint8_t> payload)
+		:tPacketPUBLISH_ViewBase(hidden::tContentPUBLISH::tFixedHeader(retain, tQoS::AtLeastOnceDelivery, dup), topicName, packetId, payload)
+	{
+	}
+};
+
+template<>
+class tPacketPUBLISH_View<tQoS::ExactlyOnceDelivery> : public hidden::tPacketPUBLISH_ViewBase
+{
+public:
+	using response_type = tPacketPUBREC;
+
+	tPacketPUBLISH_View(bool retain, bool dup, std::string_view topicName, tUInt16 packetId, std::span<const std::uint8_t> payload)
+		:tPacketPUBLISH_ViewBase(hidden::tContentPUBLISH::tFixedHeader(retain, tQoS::ExactlyOnceDelivery, dup), topicName, packetId, payload)
+	{
+	}
+};
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // 901 The PUBCOMP Packet is the response to a PUBREL Packet.It is the fourth and final packet of the QoS
@@ -1127,6 +1222,23 @@ using tPacketDataSpan = std::pair<tControlPacketType, tSpan>;
 std::optional<tPacketDataSpan> TestPacket(tSpan& data);
 std::optional<tPacketDataSpan> TestPacket(const std::vector<std::uint8_t>& data);
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 4.7 Topic Names and Topic Filters
+
+// 1264 Topic Names and Topic Filters MUST be at least one character long [MQTT-4.7.3-1].
+// 1265 Topic Names and Topic Filters can include the space character.
+// 1268 Topic Names and Topic Filters MUST NOT include the null character (Unicode U+0000) [Unicode] [MQTT-4.7.3-2].
+// 1253 The wildcard characters can be used in Topic Filters, but MUST NOT be used within a Topic Name [MQTT-4.7.1-1].
+bool IsTopicNameValid(std::string_view topicName);
+// 1220 The multi-level wildcard character MUST be specified either on its own or following a topic level separator.
+// 1221 In either case it MUST be the last character specified in the Topic Filter [MQTT-4.7.1-2].
+// 1233 The single-level wildcard can be used at any level in the Topic Filter, including first and last levels. Where it
+// 1234 is used it MUST occupy an entire level of the filter [MQTT-4.7.1-3].
+bool IsTopicFilterValid(std::string_view topicFilter);
+// 1246 The Server MUST NOT match Topic Filters starting with a wildcard character (# or +) with Topic Names
+// 1247 beginning with a $ character [MQTT-4.7.2-1].
+bool IsTopicFilterMatch(std::string_view topicFilter, std::string_view topicName); // both of them are valid
+
 }
 }
 }
@@ -1,6 +1,7 @@
 #include "utilsTime.h"
 
 #include <iomanip>
+#include <limits>
 #include <sstream>
 
 namespace utils
@@ -11,6 +12,58 @@ namespace time
 constexpr char g_format_datetime[] = "%Y-%m-%d %H:%M:%S"; // "%F %T"; - date & time are not parsed with "%F %T" (2024-11-12 14:53:26)
 constexpr char g_format_path[] = "%Y-%m-%d_%H-%M-%S";
 
+namespace hidden
+{
+
+constexpr std::int64_t OffsetWindow = 15 * 60; // [s] the local time offset is changed at a quarter of an hour (DST, the zones)
+
+constexpr char Digits2[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+inline char* Put2(char* dst, unsigned value) // value < 100
+{
+	dst[0] = Digits2[value * 2];
+	dst[1] = Digits2[value * 2 + 1];
+	return dst + 2;
+}
+
+inline bool Get(std::string_view value, std::size_t pos, std::size_t size, unsigned& result)
+{
+	result = 0;
+	for (std::size_t i = pos; i < pos + size; ++i)
+	{
+		const unsigned Digit = static_cast<unsigned>(value[i] - '0');
+		if (Digit > 9)
+			return false;
+		result = result * 10 + Digit;
+	}
+	return true;
+}
+
+constexpr std::int64_t FloorDiv(std::int64_t value, std::int64_t divisor)
+{
+	return value / divisor - (value % divisor < 0);
+}
+
+struct tUTCOffsetCache
+{
+	std::int64_t Window = std::numeric_limits<std::int64_t>::min();
+	std::int64_t Offset = 0; // [s]
+};
+
+thread_local tUTCOffsetCache g_UTCOffsetCache;
+
+}
+
 tDateTime tDateTime::Now()
 {
 	const auto TimeNow = std::chrono::system_clock::now();
@@ -25,14 +78,14 @@ tDateTime tDateTime::Parse(const std::string& value, const std::string& format)
 	return tDateTime{ mktime(&DateTime) };
 }
 
-tDateTime tDateTime::Parse(const std::string& value)
+tDateTime tDateTime::Parse(std::string_view value)
 {
-	return Parse(value, g_format_datetime);
+	return Parse(value, '-', ' ', ':');
 }
 
-tDateTime tDateTime::ParsePath(const std::string& value)
+tDateTime tDateTime::ParsePath(std::string_view value)
 {
-	return Parse(value, g_format_path);
+	return Parse(value, '-', '_', '-');
 }
 
 tm tDateTime::GetTM() const
@@ -56,13 +109,111 @@ std::string tDateTime::ToString(const std::string& format) const
 
 std::string tDateTime::ToString() const
 {
-	return ToString(g_format_datetime);
+	std::string Str(StringSize, '\0');
+	ToChars(Str.data());
+	return Str;
 }
 
 std::string tDateTime::ToStringPath() const
 {
-	return ToString(g_format_path);
+	std::string Str(StringSize, '\0');
+	ToCharsPath(Str.data());
+	return Str;
 }
 
+std::size_t tDateTime::ToChars(char* dst) const
+{
+	return ToChars(dst, Value, '-', ' ', ':');
+}
+
+std::size_t tDateTime::ToCharsPath(char* dst) const
+{
+	return ToChars(dst, Value, '-', '_', '-');
+}
+
+std::size_t tDateTime::ToChars(char* dst, std::chrono::system_clock::time_point time, int fracDigits)
+{
+	const auto Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	const std::int64_t Sec = hidden::FloorDiv(Ns, 1000000000);
+	std::size_t Size = ToChars(dst, static_cast<std::time_t>(Sec), '-', ' ', ':');
+	if (fracDigits <= 0)
+		return Size;
+
+	if (fracDigits > 9)
+		fracDigits = 9;
+	std::uint32_t Frac = static_cast<std::uint32_t>(Ns - Sec * 1000000000);
+	for (int i = fracDigits; i < 9; ++i)
+		Frac /= 10;
+	dst[Size++] = '.';
+	for (int i = fracDigits; i > 0; --i, Frac /= 10)
+		dst[Size + i - 1] = static_cast<char>('0' + Frac % 10);
+	return Size + fracDigits;
+}
+
+tDateTime tDateTime::Parse(std::string_view value, char sepDate, char sepDateTime, char sepTime)
+{
+	if (value.size() < StringSize || value[4] != sepDate || value[7] != sepDate || value[10] != sepDateTime || value[13] != sepTime || value[16] != sepTime)
+		return {};
+
+	unsigned Year = 0, Month = 0, Day = 0, Hour = 0, Minute = 0, Second = 0;
+	if (!hidden::Get(value, 0, 4, Year) || !hidden::Get(value, 5, 2, Month) || !hidden::Get(value, 8, 2, Day) ||
+		!hidden::Get(value, 11, 2, Hour) || !hidden::Get(value, 14, 2, Minute) || !hidden::Get(value, 17, 2, Second))
+		return {};
+	if (Month < 1 || Month > 12 || Day < 1 || Day > 31 || Hour > 23 || Minute > 59 || Second > 60)
+		return {};
+
+	const std::int64_t Local = hidden::DaysFromCivil(Year, Month, Day) * 86400 + Hour * 3600 + Minute * 60 + Second;
+
+	// The offset is the one of the time, which is not known yet: the last one is taken and checked (a DST change - once more).
+	std::int64_t Offset = hidden::g_UTCOffsetCache.Offset;
+	for (int i = 0; i < 2; ++i)
+	{
+		const std::int64_t OffsetTime = GetUTCOffset(static_cast<std::time_t>(Local - Offset));
+		if (OffsetTime == Offset)
+			break;
+		Offset = OffsetTime;
+	}
+
+	return tDateTime{ static_cast<std::time_t>(Local - Offset) };
+}
+
+std::size_t tDateTime::ToChars(char* dst, std::time_t value, char sepDate, char sepDateTime, char sepTime)
+{
+	const std::int64_t Local = static_cast<std::int64_t>(value) + GetUTCOffset(value);
+	const std::int64_t Days = hidden::FloorDiv(Local, 86400);
+	const unsigned SecOfDay = static_cast<unsigned>(Local - Days * 86400);
+	const hidden::tCivil Civil = hidden::CivilFromDays(Days);
+	const unsigned Year = static_cast<unsigned>(Civil.Year < 0 ? 0 : Civil.Year > 9999 ? 9999 : Civil.Year);
+
+	char* Ptr = hidden::Put2(dst, Year / 100);
+	Ptr = hidden::Put2(Ptr, Year % 100);
+	*Ptr++ = sepDate;
+	Ptr = hidden::Put2(Ptr, Civil.Month);
+	*Ptr++ = sepDate;
+	Ptr = hidden::Put2(Ptr, Civil.Day);
+	*Ptr++ = sepDateTime;
+	Ptr = hidden::Put2(Ptr, SecOfDay / 3600);
+	*Ptr++ = sepTime;
+	Ptr = hidden::Put2(Ptr, SecOfDay / 60 % 60);
+	*Ptr++ = sepTime;
+	Ptr = hidden::Put2(Ptr, SecOfDay % 60);
+	return static_cast<std::size_t>(Ptr - dst);
+}
+
+std::int64_t tDateTime::GetUTCOffset(std::time_t value)
+{
+	hidden::tUTCOffsetCache& Cache = hidden::g_UTCOffsetCache;
+
+	const std::int64_t Window = hidden::FloorDiv(static_cast<std::int64_t>(value), hidden::OffsetWindow);
+	if (Window == Cache.Window)
+		return Cache.Offset;
+
+	const tm TmBuf = tDateTime(value).GetTM();
+	const std::int64_t Local = hidden::DaysFromCivil(TmBuf.tm_year + 1900LL, TmBuf.tm_mon + 1, TmBuf.tm_mday) * 86400 + TmBuf.tm_hour * 3600 + TmBuf.tm_min * 60 + TmBuf.tm_sec;
+	Cache.Window = Window;
+	Cache.Offset = Local - static_cast<std::int64_t>(value);
+	return Cache.Offset;
+}
+
+}
 }
-}
\ No newline at end of file
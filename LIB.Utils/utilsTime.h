@@ -1,7 +1,9 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 #include <time.h>
 
@@ -9,26 +11,80 @@ namespace utils
 {
 namespace time
 {
+namespace hidden
+{
+
+// Proleptic Gregorian calendar, days since 1970-01-01 (H. Hinnant, chrono-Compatible Low-Level Date Algorithms).
+constexpr std::int64_t DaysFromCivil(std::int64_t year, unsigned month, unsigned day)
+{
+	year -= month <= 2;
+	const std::int64_t Era = (year >= 0 ? year : year - 399) / 400;
+	const unsigned YearOfEra = static_cast<unsigned>(year - Era * 400);
+	const unsigned DayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	const unsigned DayOfEra = YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + DayOfYear;
+	return Era * 146097 + static_cast<std::int64_t>(DayOfEra) - 719468;
+}
+
+struct tCivil
+{
+	std::int64_t Year = 1970;
+	unsigned Month = 1;
+	unsigned Day = 1;
+};
+
+constexpr tCivil CivilFromDays(std::int64_t days)
+{
+	days += 719468;
+	const std::int64_t Era = (days >= 0 ? days : days - 146096) / 146097;
+	const unsigned DayOfEra = static_cast<unsigned>(days - Era * 146097);
+	const unsigned YearOfEra = (DayOfEra - DayOfEra / 1460 + DayOfEra / 36524 - DayOfEra / 146096) / 365;
+	const unsigned DayOfYear = DayOfEra - (365 * YearOfEra + YearOfEra / 4 - YearOfEra / 100);
+	const unsigned MonthP = (5 * DayOfYear + 2) / 153;
+	tCivil Civil;
+	Civil.Day = DayOfYear - (153 * MonthP + 2) / 5 + 1;
+	Civil.Month = MonthP < 10 ? MonthP + 3 : MonthP - 9;
+	Civil.Year = static_cast<std::int64_t>(YearOfEra) + Era * 400 + (Civil.Month <= 2);
+	return Civil;
+}
+
+static_assert(DaysFromCivil(1970, 1, 1) == 0 && DaysFromCivil(2000, 3, 1) == 11017 && CivilFromDays(11017).Month == 3);
+
+}
 
+// ToString(), Parse() and the path variants are fixed formats, they are formatted and parsed without iostreams and locales
+// (years 0000..9999); the local time offset is taken from the OS once per 15 minutes of the time (a task keeps it).
 class tDateTime
 {
 	std::time_t Value = 0;
 
 public:
+	static constexpr std::size_t StringSize = 19; // "2024-11-12 14:53:26", "2024-11-12_14-53-26"
+	static constexpr std::size_t StringFracSizeMax = StringSize + 10; // "2024-11-12 14:53:26.123456789"
+
 	tDateTime() = default;
 	tDateTime(time_t val) :Value(val) {} // it is not explicit
 
 	static tDateTime Now();
 
 	static tDateTime Parse(const std::string& value, const std::string& format);
-	static tDateTime Parse(const std::string& value);
-	static tDateTime ParsePath(const std::string& value);
+	static tDateTime Parse(std::string_view value); // 0 if it's not "%Y-%m-%d %H:%M:%S"
+	static tDateTime ParsePath(std::string_view value); // 0 if it's not "%Y-%m-%d_%H-%M-%S"
 
 	tm GetTM() const;
 
 	std::string ToString(const std::string& format) const;
 	std::string ToString() const;
 	std::string ToStringPath() const;
+
+	// The string is written to the buffer without the terminating zero, the number of the chars is returned.
+	std::size_t ToChars(char* dst) const; // StringSize
+	std::size_t ToCharsPath(char* dst) const; // StringSize
+	static std::size_t ToChars(char* dst, std::chrono::system_clock::time_point time, int fracDigits); // StringSize + 1 + fracDigits (1..9), 0 - no fraction
+
+private:
+	static tDateTime Parse(std::string_view value, char sepDate, char sepDateTime, char sepTime);
+	static std::size_t ToChars(char* dst, std::time_t value, char sepDate, char sepDateTime, char sepTime);
+	static std::int64_t GetUTCOffset(std::time_t value); // [s]
 };
 
 }
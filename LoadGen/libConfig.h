@@ -0,0 +1,8 @@
+#pragma once
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0601
+#endif // _WIN32
+
+#define LIB_UTILS_LOG
+#define LIB_UTILS_LOG_COLOR
@@ -0,0 +1,311 @@
+#include "main.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif // _WIN32
+
+#include <boost/asio.hpp>
+
+#include <utilsChrono.h>
+#include <utilsException.h>
+#include <utilsExits.h>
+#include <shareBroker.h>
+#include <shareLog.h>
+#include <shareMQTT.h>
+#include <shareTransport.h>
+
+namespace mqtt = utils::packet::mqtt_3_1_1;
+
+struct tSettings
+{
+	std::size_t Clients = 10;
+	std::size_t Topics = 10; // loadgen/0 .. loadgen/<Topics - 1>
+	std::size_t Payload = 64; // bytes
+	std::array<unsigned int, 3> QoS{ 100, 0, 0 }; // the shares of QoS 0, 1, 2 [%]
+	unsigned int Rate = 10; // messages/s of a client, 0 - as fast as possible
+	unsigned int Duration = 10; // sec.
+	std::string Host; // an external broker, otherwise the broker is run in the process
+	std::string Port; // 1883 for the external broker, an ephemeral one for the in-process broker (TCP)
+	bool TransportMemory = true; // the in-process broker: the memory pipes or TCP (loopback)
+};
+
+struct tCounters
+{
+	std::array<std::atomic<std::uint64_t>, 3> Messages{}; // QoS 0, 1, 2
+	std::atomic<std::uint64_t> Bytes = 0; // payload
+	std::atomic<std::uint64_t> ClientsConnected = 0;
+	std::atomic<std::uint64_t> ClientsFailed = 0;
+};
+
+std::optional<tSettings> ParseSettings(int argc, char* argv[])
+{
+	tSettings Settings;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string Arg = argv[i];
+		const std::size_t Pos = Arg.find('=');
+		if (Pos == std::string::npos)
+			return {};
+		const std::string Key = Arg.substr(0, Pos);
+		const std::string Value = Arg.substr(Pos + 1);
+		try
+		{
+			if (Key == "clients")
+				Settings.Clients = std::stoul(Value);
+			else if (Key == "topics")
+				Settings.Topics = std::max<std::size_t>(std::stoul(Value), 1);
+			else if (Key == "payload")
+				Settings.Payload = std::stoul(Value);
+			else if (Key == "rate")
+				Settings.Rate = static_cast<unsigned int>(std::stoul(Value));
+			else if (Key == "duration")
+				Settings.Duration = static_cast<unsigned int>(std::stoul(Value));
+			else if (Key == "host")
+				Settings.Host = Value;
+			else if (Key == "port")
+			{
+				const unsigned long Port = std::stoul(Value);
+				if (Port == 0 || Port > 0xFFFF)
+					return {};
+				Settings.Port = Value;
+			}
+			else if (Key == "transport" && (Value == "memory" || Value == "tcp"))
+				Settings.TransportMemory = Value == "memory";
+			else if (Key == "qos")
+			{
+				std::size_t PosValue = 0;
+				for (auto& Share : Settings.QoS)
+				{
+					std::size_t Size = 0;
+					Share = static_cast<unsigned int>(std::stoul(Value.substr(PosValue), &Size));
+					PosValue += Size + 1; // ','
+					if (PosValue > Value.size())
+						break;
+				}
+				if (Settings.QoS[0] + Settings.QoS[1] + Settings.QoS[2] == 0)
+					return {};
+			}
+			else
+				return {};
+		}
+		catch (...)
+		{
+			return {};
+		}
+	}
+	return Settings;
+}
+
+// CPU time of the process (user + system) [us].
+std::int64_t GetProcessTime_us()
+{
+#ifdef _WIN32
+	FILETIME TimeCreation{}, TimeExit{}, TimeKernel{}, TimeUser{};
+	if (!GetProcessTimes(GetCurrentProcess(), &TimeCreation, &TimeExit, &TimeKernel, &TimeUser))
+		return 0;
+	auto ToInt = [](const FILETIME& time) { return (static_cast<std::int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+	return (ToInt(TimeKernel) + ToInt(TimeUser)) / 10; // 100 ns
+#else
+	rusage Usage{};
+	if (getrusage(RUSAGE_SELF, &Usage) != 0)
+		return 0;
+	auto ToInt = [](const timeval& time) { return static_cast<std::int64_t>(time.tv_sec) * 1000000 + time.tv_usec; };
+	return ToInt(Usage.ru_utime) + ToInt(Usage.ru_stime);
+#endif // _WIN32
+}
+
+// A simulated SensorA: it connects, publishes on its topics at the rate (the periods don't drift) until the time is over and disconnects.
+// The topics of the clients are spread over the topic range; the QoS of every message is chosen by the mix.
+void TaskClient(const tSettings& settings, const share::tTransportFactory& transportFactory, std::shared_ptr<share::tConnectionLatency> latency, std::size_t index,
+	utils::chrono::tTimePoint timeStart, utils::chrono::tTimePoint timeEnd, tCounters& counters)
+{
+	try
+	{
+		share::tConnection Connection(transportFactory, 60);
+		Connection.SetLatency(latency);
+		Connection.Connect(mqtt::tSessionStateRequest::Clean, "loadgen_" + std::to_string(index));
+		if (!Connection.IsConnected())
+		{
+			++counters.ClientsFailed;
+			return;
+		}
+		++counters.ClientsConnected;
+
+		std::mt19937 Random(static_cast<std::mt19937::result_type>(index));
+		std::discrete_distribution<int> QoS({ static_cast<double>(settings.QoS[0]), static_cast<double>(settings.QoS[1]), static_cast<double>(settings.QoS[2]) });
+		const std::vector<std::uint8_t> Payload(settings.Payload, static_cast<std::uint8_t>('a' + index % 26));
+		std::vector<std::string> Topics;
+		for (std::size_t i = 0; i < settings.Topics; ++i)
+			Topics.push_back("loadgen/" + std::to_string(i));
+
+		const auto Period = settings.Rate ? std::chrono::duration_cast<utils::chrono::tClock::duration>(std::chrono::seconds(1)) / settings.Rate : utils::chrono::tClock::duration::zero();
+		std::this_thread::sleep_until(timeStart + Period * index / std::max<std::size_t>(settings.Clients, 1)); // the clients don't publish at the same moment
+		utils::chrono::tTimePoint TimeNext = utils::chrono::tClock::now();
+
+		for (std::size_t i = index; Connection.IsConnected() && utils::chrono::tClock::now() < timeEnd; ++i)
+		{
+			const std::string& Topic = Topics[i % Topics.size()];
+			const int MsgQoS = QoS(Random);
+			switch (MsgQoS)
+			{
+			case 0: Connection.Publish_AtMostOnceDelivery(false, Topic, Payload); break;
+			case 1: Connection.Publish_AtLeastOnceDelivery(false, false, Topic, Payload); break;
+			case 2: Connection.Publish_ExactlyOnceDelivery(false, false, Topic, Payload); break;
+			}
+			++counters.Messages[MsgQoS];
+			counters.Bytes += Payload.size();
+
+			if (Period != utils::chrono::tClock::duration::zero())
+			{
+				TimeNext += Period;
+				std::this_thread::sleep_until(TimeNext);
+			}
+		}
+
+		Connection.Disconnect();
+	}
+	catch (std::exception& ex)
+	{
+		++counters.ClientsFailed;
+		g_Log.Exception("client " + std::to_string(index) + ": " + ex.what());
+	}
+}
+
+void Report(const tSettings& settings, const share::tConnectionLatency& latency, const tCounters& counters, std::int64_t time_us, std::int64_t timeCPU_us)
+{
+	const std::uint64_t MsgQty = counters.Messages[0] + counters.Messages[1] + counters.Messages[2];
+	const double MsgRate = static_cast<double>(MsgQty) * 1000000 / std::max<std::int64_t>(time_us, 1);
+
+	g_Log.MeasureDuration("CLIENTS " + std::to_string(counters.ClientsConnected.load()) + " connected, " + std::to_string(counters.ClientsFailed.load()) + " failed");
+	g_Log.MeasureDuration("PUBLISHED " + std::to_string(MsgQty) + " messages (QoS 0: " + std::to_string(counters.Messages[0].load()) + ", QoS 1: " + std::to_string(counters.Messages[1].load()) +
+		", QoS 2: " + std::to_string(counters.Messages[2].load()) + ") in " + std::to_string(time_us / 1000) + " ms: " + std::to_string(static_cast<std::uint64_t>(MsgRate)) + " msg/s, " +
+		std::to_string(static_cast<double>(counters.Bytes) / std::max<std::int64_t>(time_us, 1)) + " MB/s");
+
+	for (auto Type : { share::tLatencyType::CONNACK, share::tLatencyType::PUBACK, share::tLatencyType::PUBCOMP })
+	{
+		const share::tHistogramSnapshot Snapshot = latency.GetSnapshot(Type);
+		if (Snapshot.Count)
+			g_Log.MeasureDuration("LATENCY " + share::tConnectionLatency::ToString(Type) + ": " + Snapshot.ToString());
+	}
+
+	// The CPU time includes the in-process broker.
+	const double CPU = static_cast<double>(timeCPU_us) * 100 / std::max<std::int64_t>(time_us, 1); // [%] of a core
+	std::string Msg = "CPU " + std::to_string(CPU) + " % of a core";
+	if (MsgRate >= 1)
+		Msg += ", " + std::to_string(CPU * 1000 / MsgRate) + " % per 1k msg/s";
+	if (settings.Host.empty())
+		Msg += " (including the broker)";
+	g_Log.MeasureDuration(Msg);
+}
+
+// loadgen [key=value ...]
+//   clients=10        - the simulated sensors, a connection and a thread each
+//   topics=10         - loadgen/0 .. loadgen/9
+//   payload=64        - bytes
+//   qos=100,0,0       - the shares of QoS 0, 1, 2 [%]
+//   rate=10           - messages/s of a client, 0 - as fast as possible
+//   duration=10       - sec.
+//   host=, port=1883  - an external broker; without the host the broker is run in the process (no network is needed)
+//   transport=memory  - the in-process broker is connected with memory pipes (memory) or with TCP on the loopback (tcp),
+//                       the TCP port is an ephemeral one unless it's set
+// LOG_CONFIG - the log configuration (share::tLogger::Configure), by default the exceptions and the results are logged only.
+int main(int argc, char* argv[])
+{
+	int ExitCode = utils::exit_code::EX_OK;
+
+	try
+	{
+		const auto Settings = ParseSettings(argc, argv);
+		if (!Settings.has_value())
+		{
+			std::cerr << "loadgen [clients=10] [topics=10] [payload=64] [qos=100,0,0] [rate=10] [duration=10] [host=<host>] [port=<port>] [transport=memory|tcp]\n";
+			return utils::exit_code::EX_USAGE;
+		}
+
+		const char* LogConfigPath = std::getenv("LOG_CONFIG");
+		if (LogConfigPath == nullptr)
+			g_Log.Configure("categories=exception"); // the transactions are not logged
+		else if (!g_Log.LoadConfig(LogConfigPath))
+			g_Log.Exception("The log configuration has errors: " + std::string(LogConfigPath));
+
+		std::unique_ptr<share::tBroker> Broker;
+		share::tTransportFactory TransportFactory;
+		if (!Settings->Host.empty())
+		{
+			TransportFactory = [&, Service = Settings->Port.empty() ? std::string("1883") : Settings->Port](boost::asio::io_context& ioc) { return std::make_unique<share::tTransportTCP>(ioc, Settings->Host, Service); };
+		}
+		else if (Settings->TransportMemory)
+		{
+			Broker = std::make_unique<share::tBroker>("127.0.0.1", 0);
+			TransportFactory = [&](boost::asio::io_context& ioc)
+			{
+				auto Pipe = std::make_shared<share::tMemoryPipe>();
+				Broker->Attach(Pipe);
+				return std::make_unique<share::tTransportMemory>(ioc, Pipe, share::tMemoryPipe::tEnd::Client);
+			};
+		}
+		else
+		{
+			Broker = Settings->Port.empty() ? std::make_unique<share::tBroker>("127.0.0.1") : std::make_unique<share::tBroker>("127.0.0.1", static_cast<std::uint16_t>(std::stoul(Settings->Port)));
+			TransportFactory = [&, Service = std::to_string(Broker->GetPortTCP())](boost::asio::io_context& ioc) { return std::make_unique<share::tTransportTCP>(ioc, "127.0.0.1", Service); };
+		}
+
+		auto Latency = std::make_shared<share::tConnectionLatency>();
+		tCounters Counters;
+
+		const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now() + std::chrono::milliseconds(100 + 2 * Settings->Clients); // the clients are connected before
+		const utils::chrono::tTimePoint TimeEnd = TimeStart + std::chrono::seconds(Settings->Duration);
+
+		std::vector<std::thread> Clients;
+		for (std::size_t i = 0; i < Settings->Clients; ++i)
+			Clients.emplace_back(TaskClient, std::cref(*Settings), std::cref(TransportFactory), Latency, i, TimeStart, TimeEnd, std::ref(Counters));
+
+		std::this_thread::sleep_until(TimeStart);
+		const std::int64_t TimeCPUStart = GetProcessTime_us();
+		utils::chrono::tTimeDuration Duration;
+		std::this_thread::sleep_until(TimeEnd);
+		const std::int64_t TimeCPU = GetProcessTime_us() - TimeCPUStart;
+		const std::int64_t Time_us = Duration.Get<utils::chrono::ttime_us>();
+
+		for (auto& Client : Clients)
+			Client.join();
+
+		if (LogConfigPath == nullptr)
+			g_Log.SetCategory(share::tLogCategory::Measure, true);
+
+		Report(*Settings, *Latency, Counters, Time_us, TimeCPU);
+
+		if (Broker)
+		{
+			const share::tBrokerStats Stats = Broker->GetStats();
+			g_Log.MeasureDuration("BROKER received " + std::to_string(Stats.MessagesReceived) + ", sent " + std::to_string(Stats.MessagesSent) + ", dropped " + std::to_string(Stats.MessagesDropped));
+		}
+
+		if (Counters.ClientsFailed)
+			ExitCode = utils::exit_code::EX_UNAVAILABLE;
+	}
+	catch (std::exception& ex)
+	{
+		g_Log.Exception(ex.what());
+		ExitCode = utils::exit_code::EX_IOERR;
+	}
+
+	return ExitCode;
+}
@@ -0,0 +1,197 @@
+#include "main.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <utilsChrono.h>
+#include <utilsException.h>
+#include <utilsExits.h>
+#include <utilsPacketMQTTv3_1_1.h>
+#include <shareCapture.h>
+#include <shareLog.h>
+#include <shareTransport.h>
+
+namespace mqtt = utils::packet::mqtt_3_1_1;
+
+template<class T>
+bool ParsePacket(mqtt::tSpan data)
+{
+	return T::Parse(data).has_value();
+}
+
+bool ParsePacket(mqtt::tControlPacketType packType, mqtt::tSpan data)
+{
+	switch (packType)
+	{
+	case mqtt::tControlPacketType::CONNECT: return ParsePacket<mqtt::tPacketCONNECT>(data);
+	case mqtt::tControlPacketType::CONNACK: return ParsePacket<mqtt::tPacketCONNACK>(data);
+	case mqtt::tControlPacketType::PUBLISH: return ParsePacket<mqtt::tPacketPUBLISH_Parse>(data);
+	case mqtt::tControlPacketType::PUBACK: return ParsePacket<mqtt::tPacketPUBACK>(data);
+	case mqtt::tControlPacketType::PUBREC: return ParsePacket<mqtt::tPacketPUBREC>(data);
+	case mqtt::tControlPacketType::PUBREL: return ParsePacket<mqtt::tPacketPUBREL>(data);
+	case mqtt::tControlPacketType::PUBCOMP: return ParsePacket<mqtt::tPacketPUBCOMP>(data);
+	case mqtt::tControlPacketType::SUBSCRIBE: return ParsePacket<mqtt::tPacketSUBSCRIBE>(data);
+	case mqtt::tControlPacketType::SUBACK: return ParsePacket<mqtt::tPacketSUBACK>(data);
+	case mqtt::tControlPacketType::UNSUBSCRIBE: return ParsePacket<mqtt::tPacketUNSUBSCRIBE>(data);
+	case mqtt::tControlPacketType::UNSUBACK: return ParsePacket<mqtt::tPacketUNSUBACK>(data);
+	case mqtt::tControlPacketType::PINGREQ: return ParsePacket<mqtt::tPacketPINGREQ>(data);
+	case mqtt::tControlPacketType::PINGRESP: return ParsePacket<mqtt::tPacketPINGRESP>(data);
+	case mqtt::tControlPacketType::DISCONNECT: return ParsePacket<mqtt::tPacketDISCONNECT>(data);
+	default: return false;
+	}
+}
+
+std::vector<share::tCaptureRecord> ReadCapture(const std::string& path)
+{
+	std::vector<share::tCaptureRecord> Records;
+	share::tCaptureReader Reader(path);
+	while (auto Record = Reader.Read())
+		Records.push_back(std::move(*Record));
+	return Records;
+}
+
+// The frames of each stream and direction are put together and they are split and parsed as the receiver does it.
+void ReplayParse(const std::vector<share::tCaptureRecord>& records)
+{
+	std::map<std::pair<std::uint16_t, share::tCaptureDirection>, std::vector<std::uint8_t>> Streams;
+	std::size_t DataSize = 0;
+	for (const auto& Record : records)
+	{
+		auto& Stream = Streams[{ Record.Stream, Record.Direction }];
+		Stream.insert(Stream.end(), Record.Frame.begin(), Record.Frame.end());
+		DataSize += Record.Frame.size();
+	}
+
+	std::size_t PacketQty = 0;
+	std::size_t ErrorQty = 0;
+	utils::chrono::tTimeDuration Duration;
+	for (const auto& [Key, Stream] : Streams)
+	{
+		mqtt::tSpan Span(Stream);
+		while (!Span.empty())
+		{
+			auto Res = mqtt::TestPacket(Span);
+			if (!Res.has_value())
+			{
+				++ErrorQty; // the rest of the stream is not a packet
+				break;
+			}
+			++PacketQty;
+			if (!ParsePacket(Res->first, Res->second))
+				++ErrorQty;
+		}
+	}
+	const auto Time_us = std::max<std::int64_t>(Duration.Get<utils::chrono::ttime_us>(), 1);
+
+	g_Log.Operation("PARSED " + std::to_string(PacketQty) + " packets, " + std::to_string(DataSize) + " bytes, " + std::to_string(ErrorQty) + " errors in " + std::to_string(Time_us) + " us: " +
+		std::to_string(PacketQty * 1000000 / Time_us) + " packets/s, " + std::to_string(DataSize / Time_us) + " MB/s");
+}
+
+// The frames sent by the clients are sent to the server, a connection per stream; the frames sent by the server are read and dropped.
+void ReplaySend(const std::vector<share::tCaptureRecord>& records, std::string_view host, std::string_view service, bool paceOriginal)
+{
+	boost::asio::io_context ioc;
+	auto Work = boost::asio::make_work_guard(ioc);
+	std::thread Thread([&]() { ioc.run(); });
+
+	std::map<std::uint16_t, std::unique_ptr<share::tTransport>> Transports;
+	std::vector<std::uint8_t> ReadBuffer(64 * 1024);
+	std::function<void(share::tTransport*)> ReadAsync = [&](share::tTransport* transport)
+	{
+		transport->AsyncReadSome(boost::asio::buffer(ReadBuffer), [&, transport](const boost::system::error_code& error, std::size_t size)
+			{
+				if (!error && size)
+					ReadAsync(transport);
+			});
+	};
+
+	std::size_t FrameQty = 0;
+	utils::chrono::tTimeDuration Duration;
+	const utils::chrono::tTimePoint TimeStart = utils::chrono::tClock::now();
+	try
+	{
+		for (const auto& Record : records)
+		{
+			if (Record.Direction != share::tCaptureDirection::Sent)
+				continue;
+
+			auto& Transport = Transports[Record.Stream];
+			if (!Transport)
+			{
+				Transport = std::make_unique<share::tTransportTCP>(ioc, host, service);
+				boost::asio::post(ioc, [&, Ptr = Transport.get()]() { ReadAsync(Ptr); });
+			}
+
+			if (paceOriginal)
+				std::this_thread::sleep_until(TimeStart + Record.Time);
+
+			Transport->Write(boost::asio::buffer(Record.Frame));
+			++FrameQty;
+		}
+	}
+	catch (...)
+	{
+		// The thread is joined before the exception leaves the function (a joinable std::thread terminates the process).
+		Work.reset();
+		ioc.stop();
+		Thread.join();
+		throw;
+	}
+	const auto Time_us = std::max<std::int64_t>(Duration.Get<utils::chrono::ttime_us>(), 1);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(500)); // the responses
+	boost::asio::post(ioc, [&]()
+		{
+			for (auto& Transport : Transports)
+				Transport.second->Close();
+		});
+	Work.reset();
+	Thread.join();
+
+	g_Log.Operation("SENT " + std::to_string(FrameQty) + " frames over " + std::to_string(Transports.size()) + " connections in " + std::to_string(Time_us) + " us: " +
+		std::to_string(FrameQty * 1000000 / Time_us) + " frames/s");
+}
+
+// replay <capture>                          - the frames are parsed, the throughput of TestPacket(..) and Parse(..) is reported
+// replay <capture> <host> <port> [max]      - the frames sent by the clients are sent to the server at the original pace (or at the maximum one)
+int main(int argc, char* argv[])
+{
+	int ExitCode = utils::exit_code::EX_OK;
+
+	try
+	{
+		if (argc < 2)
+		{
+			std::cerr << "replay <capture> [<host> <port> [max]]\n";
+			return utils::exit_code::EX_USAGE;
+		}
+
+		const std::vector<share::tCaptureRecord> Records = ReadCapture(argv[1]);
+		g_Log.Operation("CAPTURE " + std::string(argv[1]) + ": " + std::to_string(Records.size()) + " frames");
+
+		if (argc < 4)
+		{
+			ReplayParse(Records);
+		}
+		else
+		{
+			const bool PaceOriginal = argc < 5 || std::string(argv[4]) != "max";
+			ReplaySend(Records, argv[2], argv[3], PaceOriginal);
+		}
+	}
+	catch (std::exception& ex)
+	{
+		g_Log.Exception(ex.what());
+		ExitCode = utils::exit_code::EX_IOERR;
+	}
+
+	return ExitCode;
+}
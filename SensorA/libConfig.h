@@ -6,3 +6,6 @@
 
 #define LIB_UTILS_LOG
 #define LIB_UTILS_LOG_COLOR
+//#define LIB_UTILS_LOG_ASYNC // the records are written out by the task of the log
+
+//#define LIB_SHARE_MQTT_TLS // link with OpenSSL (libssl, libcrypto)
@@ -1,18 +1,62 @@
 #include "main.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
 #include <future>
 #include <thread>
 #include <utility>
 
+#include <utilsChrono.h>
 #include <utilsException.h>
 #include <utilsExits.h>
 #include <shareLog.h>
 #include <utilsTime.h>
 
 void TaskConnectionHandler(std::string_view host, std::string_view service, const std::string& sensorData);
+void TaskConnectionPersistentHandler(std::string_view host, std::string_view service, utils::chrono::tTimePeriod& period);
 
+int MainPersistent(std::uint32_t period)
+{
+	utils::chrono::tTimePeriod Period(true, period, false); // drift-free over the reconnections, the first measurement is sent at once
+
+	constexpr std::uint32_t PauseMax = 60; // sec.
+	std::uint32_t Pause = 1;
+
+	while (true)
+	{
+		utils::chrono::tTimeDuration Connected;
+
+		try
+		{
+			std::future<void> TaskConnectionFuture = std::async(std::launch::async, TaskConnectionPersistentHandler, "test.mosquitto.org", "1883", std::ref(Period));
+			TaskConnectionFuture.get();
+		}
+		catch (std::exception& ex)
+		{
+			g_Log.Exception(ex.what());
+		}
+
+		g_Log.TestMessage("NO CONNECTION");
+
+		if (Connected.Get<std::chrono::seconds>() > PauseMax) // it was the link, not the broker refusing the connection
+			Pause = 1;
+
+		share::tMeasureDuration Measure("Sleeping...");
+		std::this_thread::sleep_for(std::chrono::seconds(Pause));
+		Pause = std::min(Pause * 2, PauseMax);
+	}
+
+	return utils::exit_code::EX_OK;
+}
+
+// SENSOR_PERIOD - [s] the connection is kept open, the measurements are published every period;
+// otherwise a connection is made for every measurement (every 60 s).
 int main()
 {
+	if (const char* Period = std::getenv("SENSOR_PERIOD"))
+		return MainPersistent(std::max(static_cast<std::uint32_t>(std::strtoul(Period, nullptr, 10)), 1u));
+
 	while (true)
 	{
 		try
@@ -1,25 +1,84 @@
 #include "main.h"
 
+#include <thread>
+
 #include <shareLog.h>
 #include <shareMQTT.h>
+#include <shareSeries.h>
+#include <utilsTime.h>
 
-void TaskConnectionHandler(std::string_view host, std::string_view service, const std::string& sensorData)
+namespace hidden
 {
-	constexpr std::uint16_t KeepAlive = 15; // sec. //[#] - TaskTransactionWait(..) should be taken into consideration
 
-	share::tConnection Connection(host, service, KeepAlive);
+constexpr std::uint16_t KeepAlive = 15; // sec. //[#] - TaskTransactionWait(..) should be taken into consideration
+constexpr std::size_t SeriesQty = 10; // samples in a message
+
+bool Connect(share::tConnection& connection)
+{
+	return connection.Connect(mqtt::tSessionStateRequest::Continue, "duper_star_SensorA", mqtt::tQoS::AtMostOnceDelivery, true, "SensorA_will", "something wrong has happened"); // 1883
+}
+
+void Publish(share::tConnection& connection, const std::string& sensorData)
+{
+	connection.Publish_AtMostOnceDelivery(true, "SensorA_DateTime_0", share::ToPayload(sensorData));
+
+	connection.Publish_AtLeastOnceDelivery(true, false, "SensorA_DateTime_1", share::ToPayload(sensorData));
+
+	connection.Publish_ExactlyOnceDelivery(true, false, "SensorA_DateTime_2", share::ToPayload(sensorData));
+}
+
+}
+
+void TaskConnectionHandler(std::string_view host, std::string_view service, const std::string& sensorData)
+{
+	share::tConnection Connection(host, service, hidden::KeepAlive);
 
 	//const bool SessionPresent = 
-	Connection.Connect(mqtt::tSessionStateRequest::Continue, "duper_star_SensorA", mqtt::tQoS::AtMostOnceDelivery, true, "SensorA_will", "something wrong has happened"); // 1883
+	hidden::Connect(Connection);
 
 	//if (!SessionContinue)
 	Connection.Subscribe({ "SensorA_Settings", mqtt::tQoS::ExactlyOnceDelivery });
 
-	Connection.Publish_AtMostOnceDelivery(true, "SensorA_DateTime_0", std::vector<std::uint8_t>(sensorData.begin(), sensorData.end()));
+	hidden::Publish(Connection, sensorData);
 
-	Connection.Publish_AtLeastOnceDelivery(true, false, "SensorA_DateTime_1", std::vector<std::uint8_t>(sensorData.begin(), sensorData.end()));
+	Connection.Disconnect();
+}
 
-	Connection.Publish_ExactlyOnceDelivery(true, false, "SensorA_DateTime_2", std::vector<std::uint8_t>(sensorData.begin(), sensorData.end()));
+// The connection is kept open, it is closed by the broker or by the link only (the will message is published then).
+// The subscription is kept by the broker in the session, the settings are received when they are published.
+// The durations of the publishing [us] are published as a series (a batch of samples) on SensorA_Series.
+void TaskConnectionPersistentHandler(std::string_view host, std::string_view service, utils::chrono::tTimePeriod& period)
+{
+	share::tConnection Connection(host, service, hidden::KeepAlive);
 
-	Connection.Disconnect();
+	const bool SessionPresent = hidden::Connect(Connection);
+	if (!SessionPresent)
+		Connection.Subscribe({ "SensorA_Settings", mqtt::tQoS::ExactlyOnceDelivery });
+
+	share::tSeriesBatch<std::int64_t> Series(hidden::SeriesQty);
+
+	while (Connection.IsConnected())
+	{
+		while (!Connection.IsIncomingEmpty())
+		{
+			auto IncMsg = Connection.GetIncoming();
+			if (g_Log.IsEnabled(share::tLogCategory::Publish))
+				g_Log.PublishMessage(std::string(IncMsg.TopicName), IncMsg.Payload.ToVector());
+		}
+
+		if (period.IsReady())
+		{
+			share::tMeasureDuration Measure("Sending measurements...");
+			utils::chrono::tTimeDurationCycles Duration;
+			hidden::Publish(Connection, utils::time::tDateTime::Now().ToString());
+
+			const auto TimeNow = std::chrono::duration_cast<utils::chrono::ttime_ms>(std::chrono::system_clock::now().time_since_epoch());
+			if (Series.Add(static_cast<std::uint64_t>(TimeNow.count()), static_cast<std::int64_t>(Duration.Get64<utils::chrono::ttime_us>())))
+				Connection.Publish_AtLeastOnceDelivery(false, false, "SensorA_Series", Series.Take());
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	THROW_RUNTIME_ERROR("The connection has been broken.");
 }